@@ -1,8 +1,13 @@
 #include "mysql.h"
 #include "../inc/log.h"
 #include "../inc/helpc.h"
+#include "../inc/blocking.h"
+#include "../inc/cancel.h"
 #include <mysql/mysql.h>
+#include <algorithm>
+#include <string.h>
 #include <string>
+#include <type_traits>
 
 namespace fang {
 
@@ -15,6 +20,29 @@ struct MySQLThreadIniter {
 };
 }
 
+//请求已经取消时mysql_blocking返回的失败值
+template<class R>
+static R mysql_cancelled_value(std::true_type) { return nullptr; }
+
+template<class R>
+static R mysql_cancelled_value(std::false_type) { return -1; }
+
+//libmysqlclient的调用会阻塞线程，放到阻塞线程池执行，池中的线程第一次使用前初始化mysql的线程环境
+//调用开始后不能打断，当前请求已经取消时不再提交，直接返回失败
+template<class F>
+static auto mysql_blocking(F fn) -> decltype(fn()) {
+    typedef decltype(fn()) R;
+    if (CancelToken::CheckCurrent()) {
+        FANG_LOG_ERROR(g_logger) << "mysql call cancelled errno=" << errno
+            << " errstr=" << strerror(errno);
+        return mysql_cancelled_value<R>(std::is_pointer<R>());
+    }
+    return fang::await_blocking([&fn]() {
+        static thread_local MySQLThreadIniter s_thread_initer;
+        return fn();
+    });
+}
+
 static MYSQL* mysql_init(std::map<std::string, std::string>& params
         , const int& timeout) {
     static thread_local MySQLThreadIniter s_thread_initer;
@@ -25,8 +53,17 @@ static MYSQL* mysql_init(std::map<std::string, std::string>& params
         return nullptr;
     }
 
-    if (timeout > 0) {
-        mysql_options(mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+    //连接超时(秒)不超过当前请求的剩余时间
+    unsigned int connect_timeout = timeout > 0 ? timeout : 0;
+    CancelToken* token = CancelToken::GetCurrent();
+    if (token && token->getRemainingMs() != ~0ull) {
+        uint64_t remain = (token->getRemainingMs() + 999) / 1000;
+        if (connect_timeout == 0 || remain < connect_timeout) {
+            connect_timeout = std::max<uint64_t>(1, remain);
+        }
+    }
+    if (connect_timeout > 0) {
+        mysql_options(mysql, MYSQL_OPT_CONNECT_TIMEOUT, &connect_timeout);
     }
 
     bool close = false;
@@ -39,8 +76,10 @@ static MYSQL* mysql_init(std::map<std::string, std::string>& params
     std::string& passwd = fang::GetParmaValue<std::string>(params, "passwd");
     std::string& dbname = fang::GetParmaValue<std::string>(params, "dbname");
 
-    if (mysql_real_connect(mysql, host.c_str(), user.c_str(), passwd.c_str()
-                , dbname.c_str(), port, nullptr, 0) == nullptr) {
+    if (mysql_blocking([&]() {
+                return mysql_real_connect(mysql, host.c_str(), user.c_str(), passwd.c_str()
+                    , dbname.c_str(), port, nullptr, 0);
+            }) == nullptr) {
         FANG_LOG_ERROR(g_logger) << "mysql_real_connect(" << host
             << ", " << port << ", " << dbname
             << ") error: " << mysql_error(mysql);
@@ -59,12 +98,16 @@ static MYSQL_RES* my_mysql_query(MYSQL* mysql, const char* sql) {
         fang::FANG_LOG_ERROR(g_logger) << "mysql_query sql is null";
         return nullptr;
     }
-    if (::mysql_query(mysql, sql)) {
+    int rt = -1;
+    MYSQL_RES* res = mysql_blocking([&]() -> MYSQL_RES* {
+        rt = ::mysql_query(mysql, sql);
+        return rt ? nullptr : mysql_store_result(mysql);
+    });
+    if (rt) {
         fang::FANG_LOG_ERROR(g_logger) << "mysql_query(" << sql << ") error:"
             << mysql_error(mysql);
         return nullptr;
     }
-    MYSQL_RES* res = mysql_store_result(mysql);
     if (res == nullptr) {
         fang::FANG_LOG_ERROR(g_logger) << "mysql_store_result() error:"
             << mysql_error(mysql);
@@ -392,7 +435,7 @@ bool MySQL::ping() {
     if (!m_mysql) {
         return false;
     }
-    if (mysql_ping(mysql.get())) {
+    if (mysql_blocking([&]() { return mysql_ping(mysql.get()); })) {
         m_hasError = true;
         return false;
     }
@@ -410,7 +453,7 @@ int MySQL::execute(const char* format, ...) {
 
 int MySQL::execute(const std::string& sql) {
     m_cmd = sql;
-    int r = ::mysql_query(m_mysql.get(), m_cmd.c_str());
+    int r = mysql_blocking([this]() { return ::mysql_query(m_mysql.get(), m_cmd.c_str()); });
     if (r) {
         FANG_LOG_ERROR(g_logger) << "cmd=" << cmd()
             << ", error: " << getErrStr();
@@ -767,7 +810,7 @@ int MySQLStmt::bindNull(int idx) {
 
 int MySQLStmt::execute() {
     mysql_stmt_bind_param(m_stmt, &m_binds[0]);
-    return mysql_stmt_execute(m_stmt);
+    return mysql_blocking([this]() { return mysql_stmt_execute(m_stmt); });
 }
 
 int64_t MySQLStmt::getLastInsertId() {
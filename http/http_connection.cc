@@ -1,7 +1,10 @@
 #include "../stream/zlib_stream.h"
 #include "http_connection.h"
 #include "../inc/log.h"
+#include "../inc/blocking.h"
+#include "../inc/cancel.h"
 #include "http_parser.h"
+#include <algorithm>
 #include <functional>
 #include <memory>
 #include <string>
@@ -13,6 +16,8 @@ namespace http {
 
 static fang::Logger::ptr g_logger = FANG_LOG_NAME("system");
 
+static const size_t BLOCKING_INFLATE_SIZE = 64 * 1024;   //超过这个大小的压缩body在阻塞线程池解压
+
 std::string HttpResult::toSting() const {
     std::stringstream ss;
     ss << "[HttpResult result=" << result
@@ -146,15 +151,24 @@ HttpResponse::ptr HttpConnection::recvResponse() {
         FANG_LOG_DEBUG(g_logger) << "content_encoding: " << content_encoding
             << " size=" << body.size();
 
+        ZlibStream::ptr zs;
         if (strcasecmp(content_encoding.c_str(), "gzip") == 0) {
-            auto zs = ZlibStream::CreateGzip(false);
-            zs->write(body.c_str(), body.size());
-            zs->flush();
-            zs->getResult().swap(body);
+            zs = ZlibStream::CreateGzip(false);
         } else if (strcasecmp(content_encoding.c_str(), "deflate") == 0){
-            auto zs = ZlibStream::CreateDeflate(false);
-            zs->flush();
-            zs->getResult().swap(body);
+            zs = ZlibStream::CreateDeflate(false);
+        }
+        if (zs) {
+            auto inflate = [&zs, &body]() {
+                zs->write(body.c_str(), body.size());
+                zs->flush();
+                zs->getResult().swap(body);
+            };
+            //大的body解压耗时长，放到阻塞线程池，不占住io线程
+            if (body.size() >= BLOCKING_INFLATE_SIZE) {
+                await_blocking(inflate);
+            } else {
+                inflate();
+            }
         }
         parser->getData()->setBody(body);
     }
@@ -475,6 +489,16 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method
 
 HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req
                                         , uint64_t timeout_ms) {
+    //请求已经超过截止时间时不再占用连接，否则等待时间不超过剩余时间
+    CancelToken* token = CancelToken::GetCurrent();
+    if (token) {
+        uint64_t remain = token->getRemainingMs();
+        if (remain == 0) {
+            return std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
+                    , nullptr, "deadline exceeded before request, pool host:" + m_host);
+        }
+        timeout_ms = std::min(timeout_ms, remain);
+    }
     auto conn = getConnection();
     if(!conn) {
         return std::make_shared<HttpResult>((int)HttpResult::Error::POOL_GET_CONNECTION
@@ -492,12 +516,20 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req
                 , nullptr, "send request closed by peer: " + sock->getRemoteAddress()->toString());
     }
     if(rt < 0) {
+        //发送了一部分的连接不能复用
+        sock->close();
+        if (token && token->isCancelled()) {
+            return std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
+                    , nullptr, "deadline exceeded while sending: " + sock->getRemoteAddress()->toString());
+        }
         return std::make_shared<HttpResult>((int)HttpResult::Error::SEND_SOCKET_ERROR
                     , nullptr, "send request socket error errno=" + std::to_string(errno)
                     + " errstr=" + std::string(strerror(errno)));
     }
     auto rsp = conn->recvResponse();
     if(!rsp) {
+        //响应没有读完的连接不能复用
+        sock->close();
         return std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
                     , nullptr, "recv response timeout: " + sock->getRemoteAddress()->toString()
                     + " timeout_ms:" + std::to_string(timeout_ms));
@@ -0,0 +1,53 @@
+/**
+ * @file affinity.h
+ * @Synopsis  线程的CPU绑定和NUMA节点相关的辅助函数，直接使用系统调用，不依赖libnuma
+ * @author Fang
+ * @version 1.0
+ * @date 2022-04-05
+ */
+#ifndef __FANG_AFFINITY_H__
+#define __FANG_AFFINITY_H__
+
+#include <stddef.h>
+#include <vector>
+
+namespace fang {
+
+/**
+ * @Synopsis  把当前线程绑定到指定的CPU上
+ *
+ * @Param[in] cpus CPU编号，为空时不绑定
+ *
+ * @Returns   是否成功
+ */
+bool SetThreadAffinity(const std::vector<int>& cpus);
+
+/**
+ * @Synopsis  NUMA节点数量，非NUMA机器返回1，结果只检测一次
+ */
+int GetNumaNodeCount();
+
+/**
+ * @Synopsis  CPU所在的NUMA节点，未知返回-1
+ */
+int GetCpuNumaNode(int cpu);
+
+/**
+ * @Synopsis  当前线程绑定的CPU全部在同一个NUMA节点上时返回该节点，否则返回-1
+ */
+int GetThreadNumaNode();
+
+/**
+ * @Synopsis  让一段内存优先从指定NUMA节点分配物理页，只对还没有分配物理页的部分有效
+ *
+ * @Param[in] addr 按页对齐的起始地址
+ * @Param[in] len 长度
+ * @Param[in] node NUMA节点
+ *
+ * @Returns   是否成功，只有一个节点时直接返回true
+ */
+bool BindToNumaNode(void* addr, size_t len, int node);
+
+}
+
+#endif
@@ -0,0 +1,148 @@
+/**
+ * @file blocking.h
+ * @Synopsis  阻塞任务线程池，无法通过hook变为非阻塞的调用(mysql、zlib、getaddrinfo、文件)
+ *            放到池中执行，发起的协程挂起，完成后回到原来的调度器继续
+ * @author Fang
+ * @version 1.0
+ * @date 2022-04-08
+ */
+#ifndef __FANG_BLOCKING_H__
+#define __FANG_BLOCKING_H__
+
+#include <deque>
+#include <exception>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "mutex.h"
+#include "thread.h"
+#include "task.h"
+
+namespace fang {
+
+/**
+* @Synopsis  执行阻塞任务的固定大小线程池，池中的线程不开启hook
+*/
+class BlockingPool : Noncopyable {
+public:
+    typedef std::shared_ptr<BlockingPool> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @Synopsis  线程池的统计
+     */
+    struct Stats {
+        size_t threads = 0;         //线程数
+        size_t busy = 0;            //正在执行任务的线程数
+        size_t queued = 0;          //排队中的任务数
+        size_t maxQueued = 0;       //排队任务数的最大值
+        uint64_t submitted = 0;     //提交的任务数
+        uint64_t completed = 0;     //执行完的任务数
+        uint64_t saturated = 0;     //提交时所有线程都在忙、需要排队的次数
+        uint64_t totalWaitUs = 0;   //任务排队时间之和
+        uint64_t maxWaitUs = 0;     //最长的排队时间
+
+        double avgWaitUs() const { return completed ? (double)totalWaitUs / completed : 0; }
+    };
+
+    /**
+     * @Synopsis  构造器，立即创建线程
+     *
+     * @Param[in] threads 线程数，至少为1
+     * @Param[in] name 线程名前缀
+     */
+    BlockingPool(size_t threads, const std::string& name = "blocking");
+
+    /**
+     * @Synopsis  执行完已经提交的任务后结束线程
+     */
+    ~BlockingPool();
+
+    /**
+     * @Synopsis  提交任务，在池中的线程上执行，任务抛出的异常只记录日志
+     */
+    void submit(Task task);
+
+    /**
+     * @Synopsis  在池中执行task，当前协程挂起直到执行完，之后在原来的调度器上恢复
+     *            不在调度器的协程中(普通线程、调度协程上的TASK_INLINE回调)或者是共享栈协程时
+     *            直接在当前线程执行
+     */
+    void await(Task task);
+
+    Stats getStats();
+    const std::string& getName() const { return m_name; }
+    std::ostream& dump(std::ostream& os);
+
+    /**
+     * @Synopsis  默认线程池，第一次使用时按配置blocking.threads创建
+     */
+    static BlockingPool* GetDefault();
+
+private:
+    void run();
+
+private:
+    struct Item {
+        Task task;
+        uint64_t enqueueUs = 0;
+    };
+
+    std::string m_name;
+    MutexType m_mutex;
+    Semaphore m_sem;                    //每个任务和每个停止通知各post一次
+    std::deque<Item> m_queue;
+    std::vector<Thread::ptr> m_threads;
+    bool m_stopping = false;
+    Stats m_stats;                      //由m_mutex保护，threads和queued在getStats时填写
+};
+
+/**
+* @Synopsis  await_blocking的返回值，void单独处理
+*/
+template<class R>
+class BlockingResult {
+public:
+    template<class F>
+    void run(F& fn) { m_value.reset(new R(fn())); }
+    R get() { return std::move(*m_value); }
+private:
+    std::unique_ptr<R> m_value;
+};
+
+template<>
+class BlockingResult<void> {
+public:
+    template<class F>
+    void run(F& fn) { fn(); }
+    void get() {}
+};
+
+/**
+ * @Synopsis  在默认阻塞线程池中执行fn，当前协程挂起直到完成，返回fn的结果，fn抛出的异常在这里重新抛出
+ *            fn在其他线程执行，引用当前协程栈上的变量是安全的，但不能使用协程相关的功能
+ *
+ * @Param[in] fn 无参可调用对象
+ */
+template<class F>
+auto await_blocking(F fn) -> decltype(fn()) {
+    BlockingResult<decltype(fn())> result;
+    std::exception_ptr error;
+    BlockingPool::GetDefault()->await([&fn, &result, &error]() {
+        try {
+            result.run(fn);
+        } catch (...) {
+            error = std::current_exception();
+        }
+    });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return result.get();
+}
+
+}
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * @file cancel.h
+ * @Synopsis  请求的截止时间和取消令牌，保存在可继承的协程局部变量中，
+ *            hook的io、connect、带超时的协程等待在令牌取消后立即以错误返回
+ * @author Fang
+ * @version 1.0
+ * @date 2022-04-16
+ */
+#ifndef __FANG_CANCEL_H__
+#define __FANG_CANCEL_H__
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <errno.h>
+#include <stdint.h>
+#include "mutex.h"
+#include "singleton.h"
+#include "task.h"
+
+namespace fang {
+
+class Timer;
+class TimerManager;
+
+/**
+* @Synopsis  取消令牌，一个请求一个，由处理请求的协程以及它创建的协程和回调共享
+*            截止时间只使用一个定时器，等待中的操作登记取消回调而不是各自添加定时器
+*/
+class CancelToken : public std::enable_shared_from_this<CancelToken>, Noncopyable {
+public:
+    typedef std::shared_ptr<CancelToken> ptr;
+    typedef Mutex MutexType;
+
+    CancelToken();
+    ~CancelToken();
+
+    /**
+     * @Synopsis  创建timeout_ms后以ETIMEDOUT取消的令牌
+     *
+     * @Param[in] timeout_ms 超时时间
+     * @Param[in] timers 添加定时器的TimerManager，nullptr使用当前IoManager，
+     *            都没有时只在检查时比较截止时间
+     */
+    static ptr WithTimeout(uint64_t timeout_ms, TimerManager* timers = nullptr);
+
+    /**
+     * @Synopsis  取消并执行所有登记的回调，已经取消过时返回false
+     *
+     * @Param[in] error 等待中的操作返回的错误码
+     */
+    bool cancel(int error = ECANCELED);
+
+    /**
+     * @Synopsis  是否已经取消，超过截止时间但定时器还没有触发时在这里取消
+     */
+    bool isCancelled();
+
+    /**
+     * @Synopsis  取消的错误码，没有取消时为0
+     */
+    int getError() const { return m_error.load(std::memory_order_acquire); }
+
+    /**
+     * @Synopsis  截止时间(GetMonotonicMS)，~0ull表示没有
+     */
+    uint64_t getDeadline() const { return m_deadline; }
+
+    /**
+     * @Synopsis  距离截止时间的毫秒数，没有截止时间返回~0ull，已经取消返回0
+     */
+    uint64_t getRemainingMs();
+
+    /**
+     * @Synopsis  登记取消时执行的回调，回调在取消的线程上执行，不能挂起
+     *
+     * @Returns   回调的id，已经取消时不登记并返回0
+     */
+    uint64_t addCallback(Task cb);
+
+    /**
+     * @Synopsis  删除回调，返回后回调不会再执行(正在执行时等它执行完)
+     */
+    void removeCallback(uint64_t id);
+
+    /**
+     * @Synopsis  当前协程的令牌，没有时返回nullptr
+     */
+    static CancelToken* GetCurrent();
+
+    /**
+     * @Synopsis  当前协程的令牌已经取消时设置errno并返回true
+     */
+    static bool CheckCurrent();
+
+private:
+    MutexType m_mutex;                  //同时保证回调执行期间不会被删除
+    std::atomic<int> m_error = {0};
+    uint64_t m_deadline = ~0ull;
+    uint64_t m_nextId = 0;
+    std::map<uint64_t, Task> m_callbacks;
+    std::shared_ptr<Timer> m_timer;
+};
+
+/**
+* @Synopsis  在当前协程上设置令牌，析构时恢复原来的令牌
+*            之后当前协程创建的协程和提交的回调沿用该令牌
+*/
+class CancelScope : Noncopyable {
+public:
+    CancelScope(CancelToken::ptr token);
+    ~CancelScope();
+
+private:
+    CancelToken::ptr m_prev;
+};
+
+}
+
+#endif
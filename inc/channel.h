@@ -0,0 +1,357 @@
+/**
+ * @file channel.h
+ * @Synopsis  协程间传递数据的有界通道，类似go的channel
+ * @author Fang
+ * @version 1.0
+ * @date 2022-03-12
+ */
+#ifndef __FANG_CHANNEL_H__
+#define __FANG_CHANNEL_H__
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include "mutex.h"
+#include "fiber.h"
+
+namespace fang {
+
+class Scheduler;
+class Selector;
+
+/**
+* @Synopsis  通道公共部分: 关闭状态与收发两个方向的等待协程
+*            数据存取不加锁，只有协程需要挂起/唤醒时才使用m_mutex
+*/
+class ChannelBase : Noncopyable {
+friend class Selector;
+public:
+    virtual ~ChannelBase() {}
+
+    /**
+     * @Synopsis  关闭通道，唤醒所有等待的协程
+     *            关闭后send失败，recv取完剩余数据后失败
+     */
+    void close();
+
+    bool isClosed() const { return m_closed.load(std::memory_order_acquire); }
+
+protected:
+    enum Direction {
+        RECV = 0,
+        SEND = 1
+    };
+
+    /**
+     * @Synopsis  挂起的协程，select时同一个Waiter登记在多个通道上，
+     *            通过fired保证只被唤醒一次
+     */
+    struct Waiter {
+        typedef std::shared_ptr<Waiter> ptr;
+        Scheduler* scheduler = nullptr;
+        Fiber::ptr fiber;
+        std::atomic<bool> fired{false};
+        bool timeout = false;
+    };
+
+    ChannelBase();
+
+    /**
+     * @Synopsis  有数据可读或者已经关闭
+     */
+    virtual bool readable() const = 0;
+
+    /**
+     * @Synopsis  有空位可写或者已经关闭
+     */
+    virtual bool writable() const = 0;
+
+    /**
+     * @Synopsis  通道状态变化后唤醒dir方向的一个等待协程
+     *            调用前需要一个seq_cst屏障，与Selector登记等待者的屏障配对
+     */
+    void notify(Direction dir) {
+        if (m_waiting[dir].load(std::memory_order_relaxed) > 0) {
+            notifySlow(dir);
+        }
+    }
+
+private:
+    void notifySlow(Direction dir);
+    void addWaiter(Direction dir, Waiter::ptr waiter);
+    void removeWaiter(Direction dir, Waiter::ptr waiter);
+
+private:
+    Spinlock m_mutex;
+    std::list<Waiter::ptr> m_waiters[2];
+    std::atomic<int> m_waiting[2];
+    std::atomic<bool> m_closed;
+};
+
+/**
+* @Synopsis  有界通道，数据区是按槽位序号同步的无锁环形队列(Vyukov bounded queue)，
+*            单生产者/单消费者时每次存取只有一次无竞争的CAS，多生产者多消费者同样安全
+*            队列满/空时send/recv挂起当前协程，可以跨IoManager线程使用
+*
+* @tparam T 数据类型，需要可默认构造、可移动赋值，存取都是移动而不是拷贝
+*/
+template<class T>
+class Channel : public ChannelBase {
+public:
+    typedef std::shared_ptr<Channel> ptr;
+
+    /**
+     * @Synopsis  构造器
+     *
+     * @Param[in] capacity 容量，向上取整为2的幂，最小为2
+     */
+    Channel(size_t capacity = 64)
+        :m_mask(RoundUp(capacity) - 1)
+        ,m_cells(new Cell[m_mask + 1]) {
+        for (size_t i = 0; i <= m_mask; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        m_enqueue.store(0, std::memory_order_relaxed);
+        m_dequeue.store(0, std::memory_order_relaxed);
+    }
+
+    ~Channel() {
+        delete [] m_cells;
+    }
+
+    /**
+     * @Synopsis  非阻塞发送，成功时v被移走
+     *
+     * @Returns   通道已满或已关闭返回false，v保持不变
+     */
+    bool trySend(T& v) {
+        if (isClosed() || !push(v)) {
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        notify(RECV);
+        return true;
+    }
+
+    bool trySend(T&& v) { return trySend(v); }
+
+    /**
+     * @Synopsis  阻塞发送，通道满时挂起当前协程
+     *
+     * @Returns   通道已关闭返回false
+     */
+    bool send(T v);
+
+    /**
+     * @Synopsis  非阻塞接收
+     *
+     * @Returns   通道为空返回false
+     */
+    bool tryRecv(T& out) {
+        if (!pop(out)) {
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        notify(SEND);
+        return true;
+    }
+
+    /**
+     * @Synopsis  阻塞接收，通道空时挂起当前协程
+     *
+     * @Returns   通道已关闭且数据已取完返回false
+     */
+    bool recv(T& out);
+
+    /**
+     * @Synopsis  当前数据数量(近似值)
+     */
+    size_t size() const {
+        size_t e = m_enqueue.load(std::memory_order_acquire);
+        size_t d = m_dequeue.load(std::memory_order_acquire);
+        return e > d ? e - d : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    size_t capacity() const { return m_mask + 1; }
+
+protected:
+    bool readable() const override { return !empty() || isClosed(); }
+    bool writable() const override { return size() <= m_mask || isClosed(); }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    bool push(T& v) {
+        size_t pos = m_enqueue.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_enqueue.compare_exchange_weak(pos, pos + 1
+                            , std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(v);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& out) {
+        size_t pos = m_dequeue.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeue.compare_exchange_weak(pos, pos + 1
+                            , std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_dequeue.load(std::memory_order_relaxed);
+            }
+        }
+        out = std::move(cell->data);
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    static size_t RoundUp(size_t v) {
+        size_t cap = 2;
+        while (cap < v) {
+            cap <<= 1;
+        }
+        return cap;
+    }
+
+private:
+    size_t m_mask;
+    Cell* m_cells;
+    std::atomic<size_t> m_enqueue;      //生产者位置
+    char m_pad[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_dequeue;      //消费者位置
+};
+
+/**
+* @Synopsis  同时等待多个通道的收发，类似go的select
+*
+*   fang::Selector sel;
+*   sel.recv(ch1, v1);
+*   sel.send(ch2, v2);
+*   int idx = sel.select(100);  //idx为完成的分支下标，超时返回-1
+*/
+class Selector : Noncopyable {
+public:
+    /**
+     * @Synopsis  添加接收分支
+     *
+     * @Param[out] out 接收到的数据
+     * @Param[out] ok 通道关闭且为空时分支也算完成，*ok为false
+     */
+    template<class T>
+    void recv(Channel<T>& ch, T& out, bool* ok = nullptr) {
+        Channel<T>* c = &ch;
+        T* o = &out;
+        addCase(c, ChannelBase::RECV, [c, o]() {
+            if (c->tryRecv(*o)) {
+                return 1;
+            }
+            //关闭之前发送的数据在关闭后仍然可以读到
+            if (c->isClosed()) {
+                return c->tryRecv(*o) ? 1 : -1;
+            }
+            return 0;
+        }, ok);
+    }
+
+    /**
+     * @Synopsis  添加发送分支，只有该分支完成时v才会被移走
+     *
+     * @Param[out] ok 通道已关闭时分支也算完成，*ok为false
+     */
+    template<class T>
+    void send(Channel<T>& ch, T& v, bool* ok = nullptr) {
+        Channel<T>* c = &ch;
+        T* p = &v;
+        addCase(c, ChannelBase::SEND, [c, p]() {
+            if (c->isClosed()) {
+                return -1;
+            }
+            return c->trySend(*p) ? 1 : 0;
+        }, ok);
+    }
+
+    /**
+     * @Synopsis  等待任一分支完成，都没有就绪时挂起当前协程
+     *
+     * @Param[in] timeout_ms 超时时间，~0ull表示不超时，0表示不等待，超时需要在IoManager中使用
+     *
+     * @Returns   完成的分支下标，超时返回-1
+     */
+    int select(uint64_t timeout_ms = ~0ull);
+
+private:
+    struct Case {
+        ChannelBase* chan;
+        ChannelBase::Direction dir;
+        std::function<int()> op;    //1: 完成 -1: 通道已关闭 0: 未就绪
+        bool* ok;
+    };
+
+    void addCase(ChannelBase* chan, ChannelBase::Direction dir
+            , std::function<int()> op, bool* ok) {
+        m_cases.push_back(Case{chan, dir, std::move(op), ok});
+    }
+
+    int poll(size_t start);
+
+private:
+    std::vector<Case> m_cases;
+};
+
+template<class T>
+bool Channel<T>::send(T v) {
+    if (trySend(v)) {
+        return true;
+    }
+    bool ok = false;
+    Selector sel;
+    sel.send(*this, v, &ok);
+    sel.select();
+    return ok;
+}
+
+template<class T>
+bool Channel<T>::recv(T& out) {
+    if (tryRecv(out)) {
+        return true;
+    }
+    bool ok = false;
+    Selector sel;
+    sel.recv(*this, out, &ok);
+    sel.select();
+    return ok;
+}
+
+}
+
+#endif
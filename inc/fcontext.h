@@ -0,0 +1,56 @@
+/**
+ * @file fcontext.h
+ * @Synopsis  协程上下文切换的汇编实现
+ *            只保存被调用者保存寄存器，不像swapcontext那样每次切换都
+ *            调用rt_sigprocmask保存/恢复信号掩码
+ * @author Fang
+ * @version 1.0
+ * @date 2022-03-05
+ */
+#ifndef __FANG_FCONTEXT_H__
+#define __FANG_FCONTEXT_H__
+
+#include <stddef.h>
+
+/**
+ * 编译时通过 -DFANG_FIBER_ASM 开启(cmake -DFANG_FIBER_ASM=ON)，
+ * 只支持x86-64与aarch64，其他平台回退到ucontext
+ */
+#if defined(FANG_FIBER_ASM) && (defined(__x86_64__) || defined(__aarch64__))
+#define FANG_USE_FCONTEXT 1
+#else
+#define FANG_USE_FCONTEXT 0
+#endif
+
+#if FANG_USE_FCONTEXT
+
+extern "C" {
+
+/**
+ * @Synopsis  保存当前上下文到 *from_sp，并切换到 to_sp 指向的上下文
+ *
+ * @Param[out] from_sp 保存当前栈顶指针
+ * @Param[in] to_sp 目标上下文的栈顶指针
+ */
+void fang_jump_fcontext(void** from_sp, void* to_sp);
+
+}
+
+namespace fang {
+
+/**
+ * @Synopsis  在给定的栈上构造初始上下文，首次切入时执行fn
+ *
+ * @Param[in] stack 栈内存起始地址
+ * @Param[in] size 栈大小
+ * @Param[in] fn 入口函数，不允许返回
+ *
+ * @Returns   可以传给 fang_jump_fcontext 的栈顶指针
+ */
+void* MakeFContext(void* stack, size_t size, void (*fn)());
+
+}
+
+#endif
+
+#endif
@@ -8,21 +8,22 @@
 #ifndef __FD_MANAGER_H__
 #define __FD_MANAGER_H__
 
+#include "fd_table.h"
 #include "mutex.h"
 #include "singleton.h"
-#include <memory>
-#include <vector>
+#include <atomic>
 
 namespace fang{
 
 /**
 * @Synopsis  文件描述符上下文类，记录一个文件描述符上的信息
+*            由FdManager持有，fd关闭后留给复用该fd的文件，不会释放
+*            关闭时代数加一，持有旧指针的协程比较代数判断fd是否已经关闭或者被复用
+*            字段会被无锁的读者并发读取，都是原子变量
 */
-class FdCtx : public std::enable_shared_from_this<FdCtx> {
-
+class FdCtx : Noncopyable {
+friend class FdManager;
 public:
-    typedef std::shared_ptr<FdCtx> ptr;
-    
     /**
      * @Synopsis  构造器
      *
@@ -34,25 +35,31 @@ public:
     /**
      * @Synopsis  是否初始化
      */
-    bool isInit() const { return m_isInit; }
+    bool isInit() const { return m_isInit.load(std::memory_order_relaxed); }
     
     /**
      * @Synopsis  是否socket
      */
-    bool isSocket() const { return m_isSocket; }
+    bool isSocket() const { return m_isSocket.load(std::memory_order_relaxed); }
     
     /**
      * @Synopsis  是否已经关闭
      */
-    bool isClose() const { return  m_isClose; }
+    bool isClose() const { return m_isClose.load(std::memory_order_acquire); }
 
-    void setUserNonblock(bool v) { m_userNonblock = v; }
+    /**
+     * @Synopsis  代数，每次关闭加一
+     *            取得ctx时记下，之后不相等说明fd已经关闭，编号可能已经属于另一个文件
+     */
+    uint32_t getGeneration() const { return m_generation.load(std::memory_order_acquire); }
+
+    void setUserNonblock(bool v) { m_userNonblock.store(v, std::memory_order_relaxed); }
     
-    bool getUserNonblock() const { return m_userNonblock; }
+    bool getUserNonblock() const { return m_userNonblock.load(std::memory_order_relaxed); }
     
-    void setSysNonblock(bool v) { m_sysNonblock = v; }
+    void setSysNonblock(bool v) { m_sysNonblock.store(v, std::memory_order_relaxed); }
     
-    bool getSysNonblock() const {return m_sysNonblock;}
+    bool getSysNonblock() const {return m_sysNonblock.load(std::memory_order_relaxed);}
     
     /**
      * @Synopsis  设置超时时间
@@ -71,20 +78,32 @@ public:
      */
     uint64_t getTimeout(int type);
 
+    /**
+     * @Synopsis  提交到io_uring还没有完成的操作数量，关闭时需要先让这些操作结束
+     */
+    void addPendingIo(int v) { m_pendingIo += v; }
+    int getPendingIo() const { return m_pendingIo; }
+
 private:
     bool init();
 
 private:
-    bool m_isInit: 1;       // 是否初始化
-    bool m_isSocket: 1;     // 是否socket
-    bool m_sysNonblock: 1;  // 是否系统设置非阻塞
-    bool m_userNonblock: 1; // 是否用户主动设置非阻塞
-    bool m_isClose: 1;      // 是否关闭
-    int m_fd;               // 文件描述符
-    uint64_t m_recvTimeout; // 读超时时间
-    uint64_t m_sendTimeout; // 写超时时间
+    std::atomic<bool> m_isInit;         // 是否初始化
+    std::atomic<bool> m_isSocket;       // 是否socket
+    std::atomic<bool> m_sysNonblock;    // 是否系统设置非阻塞
+    std::atomic<bool> m_userNonblock;   // 是否用户主动设置非阻塞
+    std::atomic<bool> m_isClose;        // 是否关闭
+    std::atomic<uint32_t> m_generation; // 关闭的次数
+    int m_fd;                           // 文件描述符
+    std::atomic<uint64_t> m_recvTimeout;    // 读超时时间
+    std::atomic<uint64_t> m_sendTimeout;    // 写超时时间
+    std::atomic<int> m_pendingIo;   // io_uring上未完成的操作数量
 };
 
+/**
+* @Synopsis  文件描述符管理类，get不加锁也不增加引用计数，hook的每次io都会调用
+*            返回的指针在进程内一直有效，fd关闭后isClose()为true、代数加一
+*/
 class FdManager {
 
 public:
@@ -96,9 +115,9 @@ public:
      * @Param[in] fd 文件描述符
      * @Param[in] auto_create 是否自动创建
      *
-     * @Returns   对应文件描述符的fdctx类
+     * @Returns   对应文件描述符的fdctx类，不存在返回nullptr
      */
-    FdCtx::ptr get(int fd, bool auto_create = false);
+    FdCtx* get(int fd, bool auto_create = false);
 
     /**
      * @Synopsis  删除对应的文件描述符的fdctx类
@@ -108,8 +127,16 @@ public:
     void del(int fd);
 
 private:
-    RWMutex m_mutex;
-    std::vector<FdCtx::ptr> m_datas;
+    /**
+     * @Synopsis  ctx为当前打开的fd，关闭后置空，storage保留给下一次复用
+     */
+    struct Slot {
+        std::atomic<FdCtx*> ctx{nullptr};
+        FdCtx* storage = nullptr;
+    };
+
+    Mutex m_mutex;  //创建和删除互斥
+    FdTable<Slot> m_slots;
 };
 
 typedef Singleton<FdManager> FdMgr;
@@ -0,0 +1,112 @@
+/**
+ * @file fd_table.h
+ * @Synopsis  按文件描述符索引的分段数组，读不加锁，段只增不减
+ * @author Fang
+ * @version 1.0
+ * @date 2022-03-26
+ */
+#ifndef __FANG_FD_TABLE_H__
+#define __FANG_FD_TABLE_H__
+
+#include "singleton.h"
+#include <atomic>
+#include <functional>
+#include <stddef.h>
+
+namespace fang {
+
+/**
+* @Synopsis  以fd为下标的表，每段SEGMENT_SIZE个元素，第一次用到时分配
+*            段分配后直到表析构都不会释放或移动，取到的元素指针一直有效
+*            读只有一次acquire加载，不加锁
+*/
+template <class T>
+class FdTable : Noncopyable {
+public:
+    static const int SEGMENT_BITS = 10;
+    static const int SEGMENT_SIZE = 1 << SEGMENT_BITS;
+    static const int MAX_SEGMENTS = 1024;   //最多支持1M个fd
+
+    /**
+     * @Synopsis  构造器
+     *
+     * @Param[in] init 新段中每个元素的初始化函数，参数为元素和它的fd
+     */
+    FdTable(std::function<void(T&, int)> init = nullptr)
+        :m_init(init) {
+        for (auto& i : m_segments) {
+            i.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~FdTable() {
+        for (auto& i : m_segments) {
+            delete[] i.load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @Synopsis  获取fd对应的元素
+     *
+     * @Param[in] auto_create 所在的段不存在时是否分配
+     *
+     * @Returns   fd超出范围或者段不存在返回nullptr
+     */
+    T* get(int fd, bool auto_create = false) {
+        if (fd < 0 || fd >= SEGMENT_SIZE * MAX_SEGMENTS) {
+            return nullptr;
+        }
+        std::atomic<T*>& slot = m_segments[fd >> SEGMENT_BITS];
+        T* segment = slot.load(std::memory_order_acquire);
+        if (!segment) {
+            if (!auto_create) {
+                return nullptr;
+            }
+            segment = allocSegment(slot, fd & ~(SEGMENT_SIZE - 1));
+        }
+        return &segment[fd & (SEGMENT_SIZE - 1)];
+    }
+
+    /**
+     * @Synopsis  遍历所有已经分配的元素
+     */
+    void foreach(std::function<void(T&)> cb) {
+        for (auto& i : m_segments) {
+            T* segment = i.load(std::memory_order_acquire);
+            if (!segment) {
+                continue;
+            }
+            for (int j = 0; j < SEGMENT_SIZE; ++j) {
+                cb(segment[j]);
+            }
+        }
+    }
+
+private:
+    /**
+     * @Synopsis  分配一个段，多个线程同时分配时只有一个发布成功
+     */
+    T* allocSegment(std::atomic<T*>& slot, int base) {
+        T* segment = new T[SEGMENT_SIZE];
+        if (m_init) {
+            for (int i = 0; i < SEGMENT_SIZE; ++i) {
+                m_init(segment[i], base + i);
+            }
+        }
+        T* expected = nullptr;
+        if (!slot.compare_exchange_strong(expected, segment
+                    , std::memory_order_acq_rel, std::memory_order_acquire)) {
+            delete[] segment;
+            return expected;
+        }
+        return segment;
+    }
+
+private:
+    std::function<void(T&, int)> m_init;
+    std::atomic<T*> m_segments[MAX_SEGMENTS];
+};
+
+}
+
+#endif
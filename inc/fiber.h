@@ -3,16 +3,36 @@
 
 #include <memory>
 #include <functional>
+#include <vector>
 #include <ucontext.h>
+#include <stdint.h>
 #include <string.h>
+#include "fcontext.h"
+#include "task.h"
 namespace fang {
 class Scheduler;
+struct SharedStack;
+
+/**
+* @Synopsis  协程栈分配统计
+*/
+struct FiberStackStats {
+    uint64_t allocs = 0;        //栈分配次数
+    uint64_t hits = 0;          //从空闲栈链表取得的次数
+    uint64_t pooled = 0;        //空闲栈数量
+    uint64_t mappedBytes = 0;   //已映射的栈内存
+    uint64_t residentBytes = 0; //常驻栈内存上限(不含已madvise归还的空闲栈)
+
+    double hitRate() const { return allocs ? (double)hits / allocs : 0; }
+};
 
 class Fiber : public std::enable_shared_from_this<Fiber> {
 public:
     friend  class Scheduler;
     typedef std::shared_ptr<Fiber> ptr;
 
+    static const size_t MAX_LOCALS = 64;    //协程局部变量槽的数量上限
+
     enum State {//协程状态
         INIT,   //初始状态
         HOLD,   //暂停状态
@@ -23,13 +43,35 @@ public:
     };
 
 public:
-    Fiber(std::function<void()> cb, size_t stacksize = 0, bool use_caller = false);
+    /**
+     * @Synopsis  构造器
+     *
+     * @Param[in] cb 协程执行函数
+     * @Param[in] stacksize 独立栈大小，0使用fiber.stack.size
+     * @Param[in] use_caller 是否在调度器的主协程上执行
+     * @Param[in] shared_stack 是否使用共享栈，协程切出后只保存栈上已使用的部分，
+     *            第一次执行时绑定到所在线程，之后只能在该线程上执行
+     *            只有汇编上下文切换(FANG_USE_FCONTEXT)支持，否则退化为独立栈
+     */
+    Fiber(Task cb, size_t stacksize = 0, bool use_caller = false
+            , bool shared_stack = false);
     ~Fiber();
 
     uint64_t getId() const { return m_id; }
     State getState() const { return m_state; }
+    bool isSharedStack() const { return m_sharedMode; }
+
+    /**
+     * @Synopsis  共享栈协程绑定的线程id，未绑定或独立栈返回-1
+     */
+    int getBoundThread() const { return m_boundThread; }
+
+    /**
+     * @Synopsis  最近一次调度时的优先级(Scheduler::Priority)，不指定优先级重新调度时沿用
+     */
+    int getPriority() const { return m_priority; }
 
-    void reset(std::function<void()> cb);   //重置协程的执行函数
+    void reset(Task cb);    //重置协程的执行函数
 
     void swapIn();      //将协程切入为执行协程
     void swapOut();     //将协程切出到后台
@@ -43,6 +85,44 @@ public:
 
     static uint64_t GetFiberId();       //返回当前协程的id
     static uint64_t GetTotalFibers();   //返回当前协程的总数
+    static FiberStackStats GetStackStats(); //返回协程栈池的统计
+
+    /**
+     * @Synopsis  注册协程局部变量槽，程序启动时由FiberLocal分配，之后不能释放
+     *
+     * @Param[in] destroy 释放槽中的值
+     * @Param[in] clone 复制槽中的值，inherit为true时用于传递给子协程
+     * @Param[in] inherit 当前协程创建的协程、提交的回调是否复制一份该值
+     *
+     * @Returns   槽的下标
+     */
+    static size_t AllocLocalSlot(void (*destroy)(void*), void* (*clone)(const void*), bool inherit);
+
+    /**
+     * @Synopsis  当前协程槽中的值，没有设置过返回nullptr
+     */
+    static void* GetLocal(size_t slot);
+
+    /**
+     * @Synopsis  交换当前协程槽中的值，value得到原来的值，所有权随之转移
+     *            不在协程中时使用线程的主协程
+     */
+    static void SwapLocal(size_t slot, void*& value);
+
+    /**
+     * @Synopsis  当前协程是否有设置了值的可继承槽
+     */
+    static bool HasInheritableLocals();
+
+    /**
+     * @Synopsis  复制当前协程所有可继承槽的值，(槽下标, 值)追加到values
+     */
+    static void CloneInheritableLocals(std::vector<std::pair<size_t, void*> >& values);
+
+    /**
+     * @Synopsis  释放槽中的值
+     */
+    static void DestroyLocal(size_t slot, void* value);
 
 
     static void YieldToReady();     //将当前协程切换到后台挂起，并设置为可执行状态(ready)
@@ -53,13 +133,35 @@ public:
 private:
     Fiber();
 
+    void initContext(void (*fn)());                     //在协程栈上构造入口为fn的上下文
+    static void SwapContext(Fiber* from, Fiber* to);    //保存from的上下文并切换到to
+
+    void restoreSharedStack();  //切入前把自己的栈内容恢复到共享栈上
+    void saveSharedStack();     //把共享栈上已使用的部分拷贝出来
+
+    void clearLocals();         //释放所有局部变量，复用协程时调用
+
 private:
-    uint64_t m_id;              //协程id
-    uint32_t m_stacksize;       //协程栈大小
-    State m_state;              //协程状态
+    uint64_t m_id = 0;          //协程id
+    uint32_t m_stacksize = 0;   //协程栈大小
+    State m_state = INIT;       //协程状态
+#if FANG_USE_FCONTEXT
+    void* m_ctx = nullptr;      //协程上下文(保存的栈顶指针)
+#else
     ucontext_t m_ctx;           //协程上下文
-    void* m_stack;              //协程运行栈指针
-    std::function<void()> m_cb; //协程运行函数
+#endif
+    void* m_stack = nullptr;    //协程运行栈指针
+    Task m_cb;                  //协程运行函数
+
+    bool m_sharedMode = false;                  //是否共享栈模式
+    int m_boundThread = -1;                     //共享栈所在线程
+    std::shared_ptr<SharedStack> m_sharedStack; //绑定的共享栈
+    char* m_saveBuf = nullptr;                  //切出时保存的栈内容
+    size_t m_saveSize = 0;
+    size_t m_saveCap = 0;
+    int m_priority = 1;                         //调度优先级，默认PRIORITY_NORMAL
+    std::vector<void*> m_locals;                //协程局部变量，按槽下标存放
+    uint64_t m_inheritMask = 0;                 //设置了值的可继承槽
 };
 
 }
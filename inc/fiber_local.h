@@ -0,0 +1,102 @@
+/**
+ * @file fiber_local.h
+ * @Synopsis  协程局部变量，值跟随协程而不是线程，协程迁移到其他线程后仍然有效
+ *            可继承的变量(如跟踪id)会复制给当前协程创建的协程和提交的回调
+ * @author Fang
+ * @version 1.0
+ * @date 2022-04-14
+ */
+#ifndef __FANG_FIBER_LOCAL_H__
+#define __FANG_FIBER_LOCAL_H__
+
+#include <memory>
+#include <utility>
+#include <vector>
+#include "fiber.h"
+#include "singleton.h"
+#include "task.h"
+
+namespace fang {
+
+/**
+* @Synopsis  类型为T的协程局部变量，定义为全局或静态变量，构造时分配槽，访问为O(1)
+*            没有设置过值的协程get返回nullptr
+*/
+template<class T>
+class FiberLocal : Noncopyable {
+public:
+    /**
+     * @Synopsis  构造器
+     *
+     * @Param[in] inherit 是否传递给当前协程创建的协程和提交的回调，T需要可以拷贝
+     */
+    FiberLocal(bool inherit = false)
+        :m_slot(Fiber::AllocLocalSlot(&Destroy, &Clone, inherit)) {}
+
+    T* get() const { return static_cast<T*>(Fiber::GetLocal(m_slot)); }
+
+    /**
+     * @Synopsis  设置当前协程的值
+     */
+    void set(const T& v) { reset(new T(v)); }
+    void set(T&& v) { reset(new T(std::move(v))); }
+
+    /**
+     * @Synopsis  替换当前协程的值并取得所有权，nullptr表示清除
+     */
+    void reset(T* v = nullptr) {
+        void* value = v;
+        Fiber::SwapLocal(m_slot, value);
+        Destroy(value);
+    }
+
+    /**
+     * @Synopsis  当前协程的值，没有设置过返回def
+     */
+    const T& getOr(const T& def) const {
+        T* v = get();
+        return v ? *v : def;
+    }
+
+    size_t getSlot() const { return m_slot; }
+
+private:
+    static void Destroy(void* v) { delete static_cast<T*>(v); }
+    static void* Clone(const void* v) { return new T(*static_cast<const T*>(v)); }
+
+private:
+    size_t m_slot;
+};
+
+/**
+* @Synopsis  当前协程可继承的局部变量的快照，在执行任务的协程上恢复
+*            调度器提交回调、Future的后续任务都会自动带上，跨线程传递时手动使用
+*/
+class FiberLocalContext {
+public:
+    /**
+     * @Synopsis  复制当前协程的可继承局部变量，没有时返回空的快照
+     */
+    static FiberLocalContext Capture();
+
+    bool empty() const { return !m_values; }
+
+    /**
+     * @Synopsis  包装cb: 执行时把快照设置到执行它的协程上，执行完恢复原来的值
+     *            快照为空时原样返回，每个快照只能包装一个回调
+     */
+    Task wrap(Task cb) const;
+
+private:
+    typedef std::vector<std::pair<size_t, void*> > Values;
+
+    struct ValuesDeleter {
+        void operator()(Values* values) const;
+    };
+
+    std::shared_ptr<Values> m_values;
+};
+
+}
+
+#endif
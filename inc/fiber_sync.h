@@ -0,0 +1,205 @@
+/**
+ * @file fiber_sync.h
+ * @Synopsis  协程同步原语，等待时挂起当前协程而不是阻塞整个调度线程
+ * @author Fang
+ * @version 1.0
+ * @date 2022-03-10
+ */
+#ifndef __FANG_FIBER_SYNC_H__
+#define __FANG_FIBER_SYNC_H__
+
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include "mutex.h"
+#include "fiber.h"
+
+namespace fang {
+
+class Scheduler;
+
+/**
+* @Synopsis  协程等待队列，所有协程同步原语的基础
+*            等待的协程挂起，唤醒时通过其所属的调度器重新调度
+*/
+class FiberWaitQueue : Noncopyable {
+public:
+    typedef Spinlock MutexType;
+
+    struct Waiter {
+        typedef std::shared_ptr<Waiter> ptr;
+        Scheduler* scheduler = nullptr; //协程所属调度器
+        Fiber::ptr fiber;               //等待的协程
+        int type = 0;                   //等待类型，由使用者定义
+        bool notified = false;          //是否已经被唤醒(或超时)
+        bool timeout = false;           //是否超时
+    };
+
+    FiberWaitQueue();
+
+    /**
+     * @Synopsis  挂起当前协程
+     *
+     * @Param[in] lock 已经锁住mutex()的锁，挂起前释放，返回时不重新加锁
+     * @Param[in] timeout_ms 超时时间，~0ull表示不超时，超时需要在IoManager中使用
+     *            带超时时当前协程的CancelToken取消也会结束等待
+     * @Param[in] type 等待类型
+     *
+     * @Returns   被唤醒返回true，超时或取消返回false
+     */
+    bool wait(MutexType::Lock& lock, uint64_t timeout_ms = ~0ull, int type = 0);
+
+    /**
+     * @Synopsis  取出队首的等待者，需要持有mutex()，释放锁后调用Wake
+     */
+    Waiter::ptr pop();
+
+    /**
+     * @Synopsis  队首等待者的类型，队列为空返回-1，需要持有mutex()
+     */
+    int frontType() const {
+        return m_state->waiters.empty() ? -1 : m_state->waiters.front()->type;
+    }
+
+    bool empty() const { return m_state->waiters.empty(); }
+
+    MutexType& mutex() { return m_state->mutex; }
+
+    /**
+     * @Synopsis  唤醒等待者
+     */
+    static void Wake(Waiter::ptr waiter);
+
+private:
+    /**
+    * @Synopsis  锁和等待者放在共享的状态中，超时和取消的回调只持有弱引用
+    *            定时器回调可能在等待者被唤醒、同步原语析构之后才执行
+    */
+    struct State {
+        MutexType mutex;
+        std::list<Waiter::ptr> waiters;
+    };
+
+    /**
+     * @Synopsis  超时或者取消时把还没有被唤醒的等待者移出队列并唤醒
+     */
+    static void Expire(const std::weak_ptr<State>& state, const Waiter::ptr& waiter);
+
+private:
+    std::shared_ptr<State> m_state;
+};
+
+/**
+* @Synopsis  协程互斥量，unlock时直接把锁交给第一个等待的协程
+*/
+class FiberMutex : Noncopyable {
+public:
+    typedef ScopedLockImpl<FiberMutex> Lock;
+
+    void lock();
+
+    /**
+     * @Synopsis  带超时的加锁
+     *
+     * @Param[in] timeout_ms 超时时间(毫秒)
+     *
+     * @Returns   超时返回false
+     */
+    bool lockFor(uint64_t timeout_ms);
+
+    bool tryLock();
+
+    void unlock();
+
+private:
+    FiberWaitQueue m_queue;
+    bool m_locked = false;
+};
+
+/**
+* @Synopsis  协程条件变量，配合FiberMutex使用
+*/
+class FiberCondition : Noncopyable {
+public:
+    /**
+     * @Synopsis  释放mutex并挂起，被唤醒后重新加锁
+     */
+    void wait(FiberMutex& mutex);
+
+    /**
+     * @Synopsis  带超时的等待，超时返回false，返回前都会重新加锁
+     */
+    bool waitFor(FiberMutex& mutex, uint64_t timeout_ms);
+
+    void notify();
+
+    void notifyAll();
+
+private:
+    FiberWaitQueue m_queue;
+};
+
+/**
+* @Synopsis  协程信号量
+*/
+class FiberSemaphore : Noncopyable {
+public:
+    FiberSemaphore(size_t count = 0);
+
+    void wait();
+
+    /**
+     * @Synopsis  带超时的获取信号量，超时返回false
+     */
+    bool waitFor(uint64_t timeout_ms);
+
+    bool tryWait();
+
+    void post();
+
+    size_t getCount();
+
+private:
+    FiberWaitQueue m_queue;
+    size_t m_count;
+};
+
+/**
+* @Synopsis  协程读写锁，有写者等待时新的读者需要排队，避免写者饥饿
+*/
+class FiberRWMutex : Noncopyable {
+public:
+    typedef ReadScopedLockImpl<FiberRWMutex> RdLock;
+    typedef WriteScopedLockImpl<FiberRWMutex> WrLock;
+
+    void rdlock();
+
+    void wrlock();
+
+    /**
+     * @Synopsis  带超时的加读锁，超时返回false
+     */
+    bool rdlockFor(uint64_t timeout_ms);
+
+    /**
+     * @Synopsis  带超时的加写锁，超时返回false
+     */
+    bool wrlockFor(uint64_t timeout_ms);
+
+    void unlock();
+
+private:
+    enum WaitType {
+        READ = 0,
+        WRITE = 1
+    };
+
+private:
+    FiberWaitQueue m_queue;
+    size_t m_readers = 0;   //持有读锁的协程数
+    bool m_writer = false;  //是否有协程持有写锁
+};
+
+}
+
+#endif
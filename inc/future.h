@@ -0,0 +1,322 @@
+/**
+ * @file future.h
+ * @Synopsis  协程版的Future/Promise，get时挂起当前协程而不是阻塞调度线程，
+ *            支持在指定调度器上执行的后续任务以及when_all/when_any组合
+ * @author Fang
+ * @version 1.0
+ * @date 2022-04-10
+ */
+#ifndef __FANG_FUTURE_H__
+#define __FANG_FUTURE_H__
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include "fiber_sync.h"
+#include "fiber_local.h"
+#include "scheduler.h"
+#include "task.h"
+
+namespace fang {
+
+template<class T> class Future;
+template<class T> class Promise;
+template<class R> struct FutureFulfiller;
+
+/**
+* @Synopsis  Future和Promise共享的状态中与结果类型无关的部分:
+*            完成标志、异常、等待的协程、后续任务
+*            结果只能设置一次，先抢到设置权的一方写入结果后再标记完成
+*/
+class FutureStateBase : Noncopyable {
+public:
+    typedef std::shared_ptr<FutureStateBase> ptr;
+    typedef FiberWaitQueue::MutexType MutexType;
+
+    virtual ~FutureStateBase() {}
+
+    bool isReady() const { return m_ready.load(std::memory_order_acquire); }
+
+    /**
+     * @Synopsis  等待结果，协程中挂起当前协程，调度器之外的线程和调度协程上阻塞线程
+     *
+     * @Param[in] timeout_ms 超时时间，~0ull表示不超时，协程中超时需要在IoManager中使用
+     *
+     * @Returns   完成返回true，超时返回false
+     */
+    bool wait(uint64_t timeout_ms = ~0ull);
+
+    /**
+     * @Synopsis  完成后执行cb，已经完成时立即执行
+     *
+     * @Param[in] cb 回调
+     * @Param[in] scheduler 在该调度器上执行，nullptr表示在设置结果的线程上直接执行
+     */
+    void addCallback(Task cb, Scheduler* scheduler = nullptr);
+
+    /**
+     * @Synopsis  以异常结束，已经设置过结果时返回false
+     */
+    bool setException(std::exception_ptr error);
+
+protected:
+    /**
+     * @Synopsis  抢占结果的设置权，只有一方能成功
+     */
+    bool claim() { return !m_claimed.exchange(true, std::memory_order_acq_rel); }
+
+    /**
+     * @Synopsis  写入结果后调用，唤醒等待的协程并派发后续任务
+     */
+    void markReady();
+
+    /**
+     * @Synopsis  以异常结束时重新抛出
+     */
+    void rethrow() const {
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+private:
+    struct Callback {
+        Task cb;
+        Scheduler* scheduler;
+    };
+
+    static void Dispatch(Callback& cb);
+
+private:
+    FiberWaitQueue m_queue;                 //队列锁同时保护m_callbacks
+    std::atomic<bool> m_claimed{false};
+    std::atomic<bool> m_ready{false};
+    std::exception_ptr m_error;
+    std::vector<Callback> m_callbacks;
+};
+
+template<class T>
+class FutureState : public FutureStateBase {
+public:
+    template<class V>
+    bool setValue(V&& v) {
+        if (!claim()) {
+            return false;
+        }
+        m_value.reset(new T(std::forward<V>(v)));
+        markReady();
+        return true;
+    }
+
+    /**
+     * @Synopsis  取走结果，需要已经完成
+     */
+    T take() {
+        rethrow();
+        return std::move(*m_value);
+    }
+
+private:
+    std::unique_ptr<T> m_value;
+};
+
+template<>
+class FutureState<void> : public FutureStateBase {
+public:
+    bool setValue() {
+        if (!claim()) {
+            return false;
+        }
+        markReady();
+        return true;
+    }
+
+    void take() { rethrow(); }
+};
+
+/**
+* @Synopsis  异步结果，可以拷贝，拷贝之间共享同一个结果
+*/
+template<class T>
+class Future {
+public:
+    typedef FutureState<T> State;
+
+    Future() {}
+    explicit Future(std::shared_ptr<State> state)
+        :m_state(std::move(state)) {}
+
+    bool valid() const { return (bool)m_state; }
+    bool isReady() const { return m_state->isReady(); }
+
+    void wait() { m_state->wait(); }
+
+    /**
+     * @Synopsis  带超时的等待，超时返回false，协程中由IoManager的定时器唤醒
+     */
+    bool waitFor(uint64_t timeout_ms) { return m_state->wait(timeout_ms); }
+
+    /**
+     * @Synopsis  等待并取走结果，以异常结束时重新抛出，结果只能取一次
+     */
+    T get() {
+        m_state->wait();
+        return m_state->take();
+    }
+
+    /**
+     * @Synopsis  完成后在scheduler上执行fn(Future<T>&)，返回fn结果的Future
+     *            fn中调用get取得结果或者异常
+     *
+     * @Param[in] scheduler 执行fn的调度器，nullptr表示在设置结果的线程上直接执行
+     * @Param[in] fn 后续任务
+     */
+    template<class F>
+    auto then(Scheduler* scheduler, F fn) -> Future<decltype(fn(std::declval<Future<T>&>()))> {
+        typedef decltype(fn(std::declval<Future<T>&>())) R;
+        Promise<R> promise;
+        Future<R> rt = promise.getFuture();
+        Future<T> self = *this;
+        //后续任务沿用调用then的协程的可继承局部变量，而不是设置结果的一方的
+        m_state->addCallback(FiberLocalContext::Capture().wrap([promise, self, fn]() mutable {
+            FutureFulfiller<R>::Run(promise, fn, self);
+        }), scheduler);
+        return rt;
+    }
+
+    template<class F>
+    auto then(F fn) -> Future<decltype(fn(std::declval<Future<T>&>()))> {
+        return then(nullptr, std::move(fn));
+    }
+
+    FutureStateBase::ptr getState() const { return m_state; }
+
+private:
+    std::shared_ptr<State> m_state;
+};
+
+/**
+* @Synopsis  设置Future的结果，可以拷贝，多个拷贝中先设置的生效
+*            所有拷贝都没有设置结果就销毁时，等待的协程不会被唤醒
+*/
+template<class T>
+class Promise {
+public:
+    Promise()
+        :m_state(std::make_shared<FutureState<T> >()) {}
+
+    Future<T> getFuture() const { return Future<T>(m_state); }
+
+    /**
+     * @Synopsis  设置结果，Promise<void>不带参数，已经设置过时返回false
+     */
+    template<class... V>
+    bool setValue(V&&... v) { return m_state->setValue(std::forward<V>(v)...); }
+
+    bool setException(std::exception_ptr error) { return m_state->setException(error); }
+
+private:
+    std::shared_ptr<FutureState<T> > m_state;
+};
+
+/**
+* @Synopsis  调用fn并把结果或者异常交给promise，void单独处理
+*/
+template<class R>
+struct FutureFulfiller {
+    template<class F, class... Args>
+    static void Run(Promise<R>& promise, F& fn, Args&... args) {
+        try {
+            promise.setValue(fn(args...));
+        } catch (...) {
+            promise.setException(std::current_exception());
+        }
+    }
+};
+
+template<>
+struct FutureFulfiller<void> {
+    template<class F, class... Args>
+    static void Run(Promise<void>& promise, F& fn, Args&... args) {
+        try {
+            fn(args...);
+            promise.setValue();
+        } catch (...) {
+            promise.setException(std::current_exception());
+        }
+    }
+};
+
+/**
+ * @Synopsis  在scheduler上以协程执行fn，返回fn结果的Future，fn中可以使用hook的io
+ *
+ * @Param[in] scheduler 调度器
+ * @Param[in] fn 无参可调用对象
+ */
+template<class F>
+auto async_on(Scheduler* scheduler, F fn) -> Future<decltype(fn())> {
+    typedef decltype(fn()) R;
+    Promise<R> promise;
+    Future<R> rt = promise.getFuture();
+    scheduler->schedul([promise, fn]() mutable {
+        FutureFulfiller<R>::Run(promise, fn);
+    });
+    return rt;
+}
+
+/**
+ * @Synopsis  所有状态都完成后完成，不区分正常结束和异常
+ */
+Future<void> WhenAll(const std::vector<FutureStateBase::ptr>& states);
+
+/**
+ * @Synopsis  第一个完成的状态的下标，states为空时永远不会完成
+ */
+Future<size_t> WhenAny(const std::vector<FutureStateBase::ptr>& states);
+
+/**
+ * @Synopsis  所有future都完成(包括以异常结束)后完成，之后逐个get取结果
+ *            超时等待使用when_all(...).waitFor(timeout_ms)
+ */
+template<class T>
+Future<void> when_all(const std::vector<Future<T> >& futures) {
+    std::vector<FutureStateBase::ptr> states;
+    states.reserve(futures.size());
+    for (auto& i : futures) {
+        states.push_back(i.getState());
+    }
+    return WhenAll(states);
+}
+
+/**
+ * @Synopsis  结果类型不同的多个future
+ */
+template<class... Fs>
+Future<void> when_all(const Fs&... futures) {
+    return WhenAll(std::vector<FutureStateBase::ptr>{futures.getState()...});
+}
+
+/**
+ * @Synopsis  任意一个future完成后完成，结果为它的下标
+ */
+template<class T>
+Future<size_t> when_any(const std::vector<Future<T> >& futures) {
+    std::vector<FutureStateBase::ptr> states;
+    states.reserve(futures.size());
+    for (auto& i : futures) {
+        states.push_back(i.getState());
+    }
+    return WhenAny(states);
+}
+
+template<class... Fs>
+Future<size_t> when_any(const Fs&... futures) {
+    return WhenAny(std::vector<FutureStateBase::ptr>{futures.getState()...});
+}
+
+}
+
+#endif
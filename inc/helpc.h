@@ -14,6 +14,10 @@ namespace fang
 pid_t GetThreadId();
 uint64_t GetFiberId();
 uint64_t GetCurrentMS();
+//单调时钟的毫秒数，不受系统时间调整影响，与定时器使用同一个时钟，用于超时和截止时间
+uint64_t GetMonotonicMS();
+//单调时钟的微秒数，用于排队时间和执行时间的统计
+uint64_t GetMonotonicUS();
 void BackTrace(std::vector<std::string> &bt, int size, int skip = 1);
 std::string BackTraceToString(int size, int skip = 2, const std::string &piexf = "");
 class Helpc
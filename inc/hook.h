@@ -6,6 +6,7 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <time.h>
 #include "fd_manager.h"
 
 
@@ -28,6 +29,9 @@ extern "C" {
     typedef int (*usleep_fun)(useconds_t usec);
     extern usleep_fun usleep_f;
 
+    typedef int (*nanosleep_fun)(const struct timespec *req, struct timespec *rem);
+    extern nanosleep_fun nanosleep_f;
+
     //int usleep(useconds_t usec);
     //unsigned int sleep(unsigned int seconds);
 
@@ -0,0 +1,139 @@
+/**
+ * @file io_uring.h
+ * @Synopsis  io_uring提交/完成队列的封装，直接使用系统调用，不依赖liburing
+ * @author Fang
+ * @version 1.0
+ * @date 2022-03-20
+ */
+#ifndef __FANG_IO_URING_H__
+#define __FANG_IO_URING_H__
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include "mutex.h"
+
+namespace fang {
+
+/**
+* @Synopsis  一个io_uring实例，只能由创建它的线程使用
+*            getSqe取到的sqe在submit时才提交给内核，多个操作可以一次提交
+*/
+class IoUring : Noncopyable {
+public:
+    typedef std::shared_ptr<IoUring> ptr;
+
+    /**
+     * @Synopsis  构造器，需要在使用它的线程中创建
+     *
+     * @Param[in] entries 提交队列长度
+     */
+    IoUring(unsigned entries = 256);
+    ~IoUring();
+
+    /**
+     * @Synopsis  内核是否支持(需要IORING_FEAT_EXT_ARG，即5.11以上)，结果只检测一次
+     */
+    static bool IsSupported();
+
+    bool isValid() const { return m_fd != -1; }
+
+    /**
+     * @Synopsis  完成事件是否推迟到io_uring_enter时才处理，这时取完成事件前需要submit
+     */
+    bool isDeferTaskrun() const {
+#ifdef IORING_SETUP_DEFER_TASKRUN
+        return m_flags & IORING_SETUP_DEFER_TASKRUN;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * @Synopsis  取一个空闲的sqe，内容已清零
+     *
+     * @Returns   提交队列已满返回nullptr，需要先submit
+     */
+    io_uring_sqe* getSqe();
+
+    /**
+     * @Synopsis  提交队列剩余空间
+     */
+    unsigned getSpace() const {
+        return m_sqEntries - (m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE));
+    }
+
+    /**
+     * @Synopsis  提交所有sqe并等待完成事件
+     *
+     * @Param[in] wait_ms 0不等待，~0ull一直等到至少有一个完成事件
+     *
+     * @Returns   成功返回提交的数量，失败返回-errno，等待超时不算失败
+     */
+    int submit(uint64_t wait_ms = 0);
+
+    /**
+     * @Synopsis  取出所有完成事件
+     *
+     * @Param[in] cb void(io_uring_cqe*)
+     *
+     * @Returns   完成事件数量
+     */
+    template<class Callback>
+    unsigned reap(Callback cb) {
+        unsigned head = *m_cqHead;
+        unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        unsigned count = tail - head;
+        for (; head != tail; ++head) {
+            cb(&m_cqes[head & m_cqMask]);
+        }
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    static void PrepRw(io_uring_sqe* sqe, int op, int fd, const void* addr
+            , unsigned len, uint64_t offset) {
+        sqe->opcode = op;
+        sqe->fd = fd;
+        sqe->addr = (uintptr_t)addr;
+        sqe->len = len;
+        sqe->off = offset;
+    }
+
+    /**
+     * @Synopsis  给前一个sqe设置超时，前一个sqe需要带IOSQE_IO_LINK，
+     *            超时后前一个操作以-ECANCELED完成
+     *
+     * @Param[in] ts 提交之前需要一直有效
+     */
+    static void PrepLinkTimeout(io_uring_sqe* sqe, __kernel_timespec* ts, uint64_t ms) {
+        ts->tv_sec = ms / 1000;
+        ts->tv_nsec = (ms % 1000) * 1000000;
+        PrepRw(sqe, IORING_OP_LINK_TIMEOUT, -1, ts, 1, 0);
+    }
+
+private:
+    int m_fd;
+    unsigned m_flags;           //io_uring_setup使用的标志
+    unsigned m_sqEntries;
+    unsigned m_sqMask;
+    unsigned m_sqeTail;         //已经取出的sqe，submit时发布给内核
+    unsigned* m_sqHead;
+    unsigned* m_sqTail;
+    unsigned* m_sqArray;
+    io_uring_sqe* m_sqes;
+    unsigned m_cqMask;
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    io_uring_cqe* m_cqes;
+    void* m_ring;
+    size_t m_ringSize;
+    size_t m_sqesSize;
+};
+
+}
+
+#endif
@@ -1,11 +1,19 @@
 #pragma once 
 #include "scheduler.h"
 #include "timer.h"
+#include "fd_table.h"
+
+struct epoll_event;
+struct io_uring_sqe;
 
 namespace fang {
 
+class IoUring;
+
 /**
 * @Synopsis  基于epoll的io协程调度器
+*            配置iomanager.backend为io_uring且内核支持时，hook的socket操作直接提交到
+*            当前线程的io_uring，不支持时回退到epoll
 */
 class IoManager : public Scheduler, public TimerManager {
 public:
@@ -17,8 +25,8 @@ public:
      */
     enum Event{
         NONE = 0x0,     //无事件
-        READ = 0x1,     //读事件
-        WRITE = 0x2,    //写事件
+        READ = 0x1,     //读事件(与EPOLLIN相同)
+        WRITE = 0x4,    //写事件(与EPOLLOUT相同)
     };
 
 private:
@@ -28,22 +36,39 @@ private:
         struct EventContext {
             Scheduler* scheduler = nullptr;
             Fiber::ptr fiber;
-            std::function<void()> cb;
+            Task cb;
+            int thread = -1;    //事件触发后在该线程执行，-1表示任意线程
+            int flags = TASK_NONE;  //回调使用注册事件时所在任务的优先级，协程沿用自己的优先级
         };
 
         EventContext& getContext(Event event);
 
         void resetContext(EventContext& ctx);
 
-        void triggerEvent(Event event);
+        /**
+         * @Synopsis  触发事件，等待者属于batch的调度器时加入batch，否则直接调度
+         */
+        void triggerEvent(Event event, TaskBatch* batch = nullptr);
 
         EventContext read;
         EventContext write;
         int fd = 0;
-        Event events = NONE;
+        int reactor = -1;   //注册在哪个reactor上，未注册时为-1，注册后直到close才解除
+        Event events = NONE;    //正在等待的事件
+        Event ready = NONE;     //边缘触发收到后还没有被等待者消费的就绪事件
         Mutex mutex;
     };
 
+    /**
+     * @Synopsis  一个epoll实例以及唤醒它的eventfd
+     */
+    struct Reactor {
+        int epfd = -1;
+        int tickleFd = -1;
+        IoUring* ring = nullptr;    //io_uring后端时每个工作线程一个，由该线程创建
+        uint64_t tickleValue = 0;   //io_uring读eventfd的缓冲
+    };
+
 public:
 
     /**
@@ -52,13 +77,18 @@ public:
      * @Param[in] threads 线程数量
      * @Param[in] use_caller 是否将系统线程作为调度
      * @Param[in] name 名称
+     * @Param[in] sharded 每个工作线程使用自己的epoll，fd固定在注册它的线程上，
+     *                    事件只唤醒该线程，等待io的协程也固定回到该线程执行
+     *                    配置iomanager.sharded中有该名称时以配置为准，使用io_uring后端时总是分片
      */
-    IoManager(size_t threads = -1, bool use_caller = false, const std::string& name = "");
+    IoManager(size_t threads = -1, bool use_caller = false, const std::string& name = ""
+            , bool sharded = false);
     ~IoManager();
 
 
     /**
-     * @Synopsis  添加事件
+     * @Synopsis  添加事件，fd第一次添加时以EPOLLIN|EPOLLOUT|EPOLLET注册，之后不再epoll_ctl
+     *            fd已经就绪时立即触发
      *
      * @Param[in] fd socket文件描述符
      * @Param[in] event 事件类型
@@ -66,7 +96,7 @@ public:
      *
      * @Returns 成功返回0， 失败返回-1
      */
-    int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
+    int addEvent(int fd, Event event, Task cb = nullptr);
     
     /**
      * @Synopsis  删除事件，不会触发事件回调
@@ -85,31 +115,132 @@ public:
     bool cancelEvent(int fd, Event event);
     
     /**
-     * @Synopsis  取消所有事件，事件存在就会去触发
+     * @Synopsis  取消所有事件，事件存在就会去触发，并从epoll中删除fd
      *
      * @Param[in] fd socket文件描述符
      */
     bool cancelAll(int fd);
 
+    /**
+     * @Synopsis  fd将要关闭，在所有IoManager上cancelAll
+     *            fd注册后一直保留在epoll中，关闭前需要调用，否则复用该fd时收不到事件
+     *
+     * @Param[in] fd socket文件描述符
+     */
+    static void CloseFd(int fd);
+
     /**
      * @Synopsis  获得当前指针
      */
     static IoManager* GetThis();
 
+    /**
+     * @Synopsis  是否每个工作线程一个epoll
+     */
+    bool isSharded() const { return m_sharded; }
+
+    /**
+     * @Synopsis  是否使用io_uring后端
+     */
+    bool isUring() const { return m_uring; }
+
+    /**
+     * @Synopsis  当前协程能否使用submitIo: io_uring后端、在本调度器的工作线程上、
+     *            不是共享栈协程(共享栈切出后栈上的缓冲区不再有效)
+     */
+    bool canSubmitIo() const;
+
+    /**
+     * @Synopsis  在当前线程的io_uring上提交一个操作，挂起当前协程直到操作完成
+     *            同一线程上的提交在空闲时一次性交给内核
+     *
+     * @Param[in] prep 填写sqe，user_data由submitIo设置
+     * @Param[in] timeout_ms 超时时间，~0ull表示不超时
+     *
+     * @Returns   操作结果(cqe->res)，失败为-errno，超时为-ETIMEDOUT
+     */
+    int submitIo(const std::function<void(io_uring_sqe*)>& prep, uint64_t timeout_ms = ~0ull);
+
+    /**
+     * @Synopsis  写eventfd唤醒空闲线程的次数
+     */
+    uint64_t getTickleCount() const { return m_tickleCount; }
+
+    /**
+     * @Synopsis  空闲线程被eventfd唤醒的次数
+     */
+    uint64_t getWakeupCount() const { return m_wakeupCount; }
+
+    /**
+     * @Synopsis  addEvent的次数
+     */
+    uint64_t getEventWaitCount() const { return m_eventWaitCount; }
+
+    /**
+     * @Synopsis  addEvent时已经就绪而立即触发的次数
+     */
+    uint64_t getReadyHitCount() const { return m_readyHitCount; }
+
 protected:
     void tickle()   override;
+    void tickleWorker(size_t idx) override;
     bool stopping() override;
     void idle()     override;
     void onTimerInsertedAtFront() override;
 
-    void contextResize(size_t size);
     bool stopping(uint64_t& timeout);
 
+    /**
+     * @Synopsis  新注册的fd放在哪个reactor上: 共享模式只有一个，
+     *            分片模式为当前工作线程的reactor，非工作线程按fd分散
+     */
+    int selectReactor(int fd) const;
+
+    /**
+     * @Synopsis  修改fd在其reactor上的注册，删除时解除fd与reactor的绑定
+     */
+    int updateEvents(FdContext* fd_ctx, int op, uint32_t events);
+
+
+    /**
+     * @Synopsis  处理epoll_wait返回的事件
+     *
+     * @Param[in] notified 本线程是否是被tickle认领后唤醒的
+     * @Param[out] batch 恢复的协程和回调加入batch，由调用者一次提交
+     *
+     * @Returns   触发的事件数量，batch提交后由调用者从m_pendingEventCount中减去
+     */
+    size_t handleEvents(Reactor& reactor, epoll_event* events, int n, bool notified
+            , TaskBatch& batch);
+
+    /**
+     * @Synopsis  获取工作线程的ring，第一次使用时在该线程中创建
+     */
+    IoUring* getRing(Reactor& reactor);
+
+    /**
+     * @Synopsis  io_uring后端在ring上等待epoll和eventfd: 对epfd做poll，对eventfd做read
+     */
+    void armUring(Reactor& reactor, uint64_t tag);
+
+    /**
+     * @Synopsis  处理ring上的完成事件，提交操作的协程加入batch
+     *
+     * @Param[out] resumed 累加完成的操作数量
+     *
+     * @Returns   epfd上是否有就绪事件
+     */
+    bool reapUring(Reactor& reactor, TaskBatch& batch, size_t& resumed);
+
 private:
-    int m_epfd; // epoll 句柄
-    int m_tickleFds[2]; // pipe 文件描述符
+    bool m_sharded; // 是否每个工作线程一个epoll
+    bool m_uring;   // 是否使用io_uring后端
+    std::vector<Reactor> m_reactors; // 共享模式只有一个，分片模式每个工作线程一个
+    std::atomic<uint64_t> m_tickleCount = {0}; //写eventfd的次数
+    std::atomic<uint64_t> m_wakeupCount = {0}; //空闲线程被eventfd唤醒的次数
+    std::atomic<uint64_t> m_eventWaitCount = {0};  //addEvent的次数
+    std::atomic<uint64_t> m_readyHitCount = {0};   //addEvent时已经就绪的次数
     std::atomic<size_t> m_pendingEventCount = {0}; //就绪事件数量
-    RWMutexType m_mutex;    //读写锁
-    std::vector<FdContext*> m_fdContexts; // socket事件上下文容器 
+    FdTable<FdContext> m_fdContexts; // socket事件上下文，按fd分段，查找不加锁
 };
 }
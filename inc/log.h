@@ -60,6 +60,17 @@ namespace fang
         static LogLevel::Level FromString(const std::string &);
     };
 
+    /**
+     * @Synopsis  设置当前协程的跟踪id，保存在可继承的协程局部变量中，
+     *            之后创建的协程和提交的回调沿用，日志格式%X输出，空串表示清除
+     */
+    void SetTraceId(const std::string &id);
+
+    /**
+     * @Synopsis  当前协程的跟踪id，没有设置时为空串
+     */
+    const std::string &GetTraceId();
+
     //日志事件
     class LogEvent
     {
@@ -78,6 +89,7 @@ namespace fang
         uint32_t getThreadId(void) const { return m_threadId; }
         uint32_t getFiberId(void) const { return m_fiberId; }
         const std::string &getThreadName(void) { return m_threadName; }
+        const std::string &getTraceId(void) const { return m_traceId; }
         time_t getTime(void) const { return m_time; }
         const char *getFileName(void) { return m_filename; }
         int32_t getLine(void) const { return m_line; }
@@ -95,6 +107,8 @@ namespace fang
         uint32_t m_fiberId;
         //线程名字
         std::string m_threadName;
+        //产生日志的协程的跟踪id
+        std::string m_traceId;
         //当前时间戳
         time_t m_time;
         /// 程序启动开始到现在的毫秒数
@@ -26,7 +26,7 @@ namespace fang {
 #define FANG_ASSERT2(x, c)\
     if (FANG_UNLIKELY(!(x))) {\
         FANG_LOG_ERROR(FANG_LOG_ROOT()) << "ASSERTION: " #x \
-            << "\n" << w\
+            << "\n" << c\
             << "\nbacktrace:\n"\
             << fang::BackTraceToString(100, 2, "    ");\
         assert(x);\
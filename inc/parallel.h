@@ -0,0 +1,94 @@
+/**
+ * @file parallel.h
+ * @Synopsis  在调度器的所有线程上并行执行区间上的计算(parallel_for/parallel_reduce)
+ *            区间按线程数切分，做完自己的部分后从其他任务的剩余区间偷一半，
+ *            每次取的块大小按执行时间自适应
+ * @author Fang
+ * @version 1.0
+ * @date 2022-04-12
+ */
+#ifndef __FANG_PARALLEL_H__
+#define __FANG_PARALLEL_H__
+
+#include <functional>
+#include <vector>
+#include <stddef.h>
+
+namespace fang {
+
+class Scheduler;
+
+/**
+ * @Synopsis  参与计算的任务数，不超过调度器的线程数和区间长度
+ *
+ * @Param[in] scheduler 调度器，nullptr时为1
+ * @Param[in] count 区间长度
+ */
+size_t ParallelSlots(Scheduler* scheduler, size_t count);
+
+/**
+ * @Synopsis  把[begin, end)分给slots个任务在scheduler上执行，当前协程挂起直到全部完成
+ *            不在协程中时阻塞当前线程，第一个异常在这里重新抛出，之后未开始的块不再执行
+ *
+ * @Param[in] scheduler 调度器，nullptr或只有一个任务时在当前协程直接执行
+ * @Param[in] begin 区间起点
+ * @Param[in] end 区间终点，长度不能超过2^32
+ * @Param[in] grain 每块的最小长度，0表示自动选择
+ * @Param[in] slots 任务数，由ParallelSlots得到
+ * @Param[in] body body(slot, b, e)处理[b, e)，同一个slot的调用不会并发
+ */
+void ParallelRun(Scheduler* scheduler, size_t begin, size_t end, size_t grain, size_t slots
+        , const std::function<void(size_t, size_t, size_t)>& body);
+
+/**
+ * @Synopsis  对[begin, end)中的每个下标并行执行fn(i)
+ *            在同一个调度器的协程中调用时，当前协程挂起期间它的线程也参与计算
+ *            调度协程上(TASK_INLINE回调)调用会阻塞线程，同一个调度器只有一个线程时会死锁
+ *
+ * @Param[in] scheduler 执行计算的调度器
+ * @Param[in] grain 每块的最小长度，0表示自动选择
+ * @Param[in] fn fn(size_t i)
+ */
+template<class F>
+void parallel_for(Scheduler* scheduler, size_t begin, size_t end, size_t grain, F fn) {
+    if (begin >= end) {
+        return;
+    }
+    ParallelRun(scheduler, begin, end, grain, ParallelSlots(scheduler, end - begin)
+            , [&fn](size_t, size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+            fn(i);
+        }
+    });
+}
+
+/**
+ * @Synopsis  并行归约: 每个任务从identity开始用fn(b, e, acc)累积自己处理的块，
+ *            最后按任务顺序用combine(acc1, acc2)合并
+ *            块在任务之间的分配不确定，combine需要满足结合律和交换律
+ *
+ * @Param[in] identity 初始值，combine的单位元
+ * @Param[in] fn T fn(size_t b, size_t e, T acc)，处理[b, e)后返回新的累积值
+ * @Param[in] combine T combine(T a, T b)
+ */
+template<class T, class F, class C>
+T parallel_reduce(Scheduler* scheduler, size_t begin, size_t end, size_t grain
+        , const T& identity, F fn, C combine) {
+    if (begin >= end) {
+        return identity;
+    }
+    size_t slots = ParallelSlots(scheduler, end - begin);
+    std::vector<T> acc(slots, identity);
+    ParallelRun(scheduler, begin, end, grain, slots, [&fn, &acc](size_t slot, size_t b, size_t e) {
+        acc[slot] = fn(b, e, std::move(acc[slot]));
+    });
+    T rt = std::move(acc[0]);
+    for (size_t i = 1; i < slots; ++i) {
+        rt = combine(std::move(rt), std::move(acc[i]));
+    }
+    return rt;
+}
+
+}
+
+#endif
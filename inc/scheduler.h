@@ -8,14 +8,56 @@
 #include "mutex.h"
 #include "thread.h"
 #include "fiber.h"
+#include "task.h"
+#include "work_queue.h"
 
 namespace fang {
 
 class Scheduler {
+    private:
+        struct FiberAndThread;
 
     public:
         typedef std::shared_ptr<Scheduler> ptr;
         typedef Mutex MutexType;
+
+        /**
+         * 任务选项，可以按位组合
+         * 优先级占两位，不指定时协程沿用上次调度时的优先级，回调沿用提交它的任务的优先级
+         */
+        enum TaskFlag {
+            TASK_NONE = 0x0,
+            TASK_SHARED_STACK = 0x1,    //回调在共享栈协程上执行，适合大量空闲连接
+            TASK_INLINE = 0x2,          //回调不会让出，直接在调度协程上执行，不切换协程
+            TASK_HIGH = 0x4,            //高优先级，健康检查、心跳等对延迟敏感的任务
+            TASK_NORMAL = 0x8,          //普通优先级
+            TASK_BACKGROUND = 0xc,      //后台任务，报表等批量工作
+            TASK_PRIORITY_MASK = 0xc,
+        };
+
+        /**
+         * 任务优先级，每个优先级一条队列，按scheduler.priority_weights加权轮流取任务，
+         * 有任务的队列超过scheduler.starvation_ms没有被取过时优先取它
+         */
+        enum Priority {
+            PRIORITY_HIGH = 0,
+            PRIORITY_NORMAL = 1,
+            PRIORITY_BACKGROUND = 2,
+            PRIORITY_COUNT = 3
+        };
+
+        /**
+         * @Synopsis  一个优先级队列的统计
+         */
+        struct LaneStats {
+            size_t depth = 0;           //排队中的任务数
+            uint64_t dequeued = 0;      //已经取出的任务数
+            uint64_t sampled = 0;       //统计了排队时间的任务数，普通任务抽样统计，其他全部统计
+            uint64_t totalWaitUs = 0;   //统计的任务排队时间之和
+            uint64_t maxWaitUs = 0;     //统计的任务中最长的排队时间
+
+            double avgWaitUs() const { return sampled ? (double)totalWaitUs / sampled : 0; }
+        };
     
     public:
         Scheduler(size_t threads = 1, bool use_caller = true, 
@@ -30,78 +72,248 @@ class Scheduler {
         void switchTo(int thread);
         std::ostream& dump(std::ostream& os);
 
+        /**
+         * @Synopsis  工作线程id(包括use_caller的主线程)，start之后有效
+         *            弹性扩容出来的线程随时可能退出，不在其中
+         */
+        const std::vector<int>& getThreadIds() const { return m_threadIds; }
+
+        /**
+         * @Synopsis  是否会按负载增减线程，由配置scheduler.max_threads决定
+         */
+        bool isElastic() const { return m_elastic; }
+
+        /**
+         * @Synopsis  当前调度器创建的、还在运行的线程数(不包括use_caller的主线程)
+         */
+        size_t getLiveThreadCount() const { return m_liveThreads; }
+
+        /**
+         * @Synopsis  获取优先级队列的统计
+         */
+        LaneStats getLaneStats(Priority priority) const;
+
+        /**
+         * @Synopsis  优先级对应的任务选项
+         */
+        static int PriorityFlag(int priority) { return (priority + 1) << 2; }
+
+        /**
+         * @Synopsis  当前线程正在执行的任务的优先级，不在任务中时为PRIORITY_NORMAL
+         */
+        static int GetTaskPriority();
+
+        /**
+         * @Synopsis  本调度器的协程挂起等待调度器之外的线程时调用，计数不为0时调度器不会停止
+         *            外部线程先重新调度协程，再调用resumeExternal
+         */
+        void suspendExternal() { ++m_externalCount; }
+        void resumeExternal() { --m_externalCount; }
 
         static Scheduler* GetThis();
         static Fiber* GetMainFiber();
 
+        /**
+         * @Synopsis  添加任务
+         *
+         * @Param[in] fc 协程或者回调函数，传入Fiber::ptr*或Task*时取走其内容
+         * @Param[in] thread 指定执行的线程id，-1表示任意线程
+         * @Param[in] flags TaskFlag组合，可以包含一个优先级
+         */
         template<typename FiberOrCb>
-        void schedul(FiberOrCb fc, int thread = -1) {
-            bool need_tickle = false;
-            {
-                MutexType::Lock lock(m_mutex);
-                need_tickle = schedulNoLock(fc, thread);
-            }
-            if (need_tickle) {
+        void schedul(FiberOrCb fc, int thread = -1, int flags = TASK_NONE) {
+            if (schedulImpl(std::move(fc), thread, flags)) {
                 tickle();
             }
         }
 
+        /**
+         * @Synopsis  添加不会让出的回调，直接在调度协程上执行完，省去协程的切入切出
+         *            回调中不能挂起当前协程(hook的io和sleep、协程锁、Channel等)，否则断言失败
+         *
+         * @Param[in] cb 回调函数
+         * @Param[in] thread 指定执行的线程id，-1表示任意线程
+         */
+        template<typename Cb>
+        void schedulInline(Cb cb, int thread = -1) {
+            schedul(std::move(cb), thread, TASK_INLINE);
+        }
+
         template<typename InputIterator>
         void schedul(InputIterator begin, InputIterator end) {
             bool need_tickle = false;
-            {
-                MutexType::Lock lock(m_mutex);
-                while(begin != end) {
-                    need_tickle = schedulNoLock(&*begin, -1) || need_tickle;
-                    ++begin;
-                }
+            while(begin != end) {
+                need_tickle = schedulImpl(&*begin, -1, TASK_NONE) || need_tickle;
+                ++begin;
             }
             if (need_tickle) {
                 tickle();
             }
         }
 
+        /**
+         * @Synopsis  攒在一起提交的一批任务，只能提交给创建时指定的调度器
+         */
+        class TaskBatch : Noncopyable {
+        friend class Scheduler;
+        public:
+            TaskBatch(Scheduler* scheduler)
+                :m_scheduler(scheduler) {}
+            ~TaskBatch();
+
+            Scheduler* getScheduler() const { return m_scheduler; }
+            bool empty() const { return m_tasks.empty(); }
+            size_t size() const { return m_tasks.size(); }
+
+            /**
+             * @Synopsis  加入一个任务，参数与schedul相同
+             */
+            template<typename FiberOrCb>
+            void add(FiberOrCb fc, int thread = -1, int flags = TASK_NONE);
+
+        private:
+            Scheduler* m_scheduler;
+            std::vector<FiberAndThread*> m_tasks;
+        };
+
+        /**
+         * @Synopsis  一次提交一批任务: 每个目标队列只加一次锁，整批最多唤醒一个空闲线程，
+         *            另外对每个有指定线程任务的其他工作线程唤醒一次
+         *            提交后batch为空，可以继续使用
+         */
+        void schedul(TaskBatch& batch);
+
 
 
     protected:
+        /**
+         * @Synopsis  唤醒一个在idle中睡眠的线程，默认实现用futex唤醒
+         */
         virtual void tickle();
+
+        /**
+         * @Synopsis  唤醒指定的工作线程，给该线程投递了指定线程的任务时调用
+         *
+         * @Param[in] idx 工作线程序号
+         */
+        virtual void tickleWorker(size_t idx);
         virtual bool stopping();
+
+        /**
+         * @Synopsis  没有任务时执行，默认实现先短暂自旋，再在futex上睡眠直到被tickle
+         *            shouldRetire返回true时需要返回，让线程退出
+         */
         virtual void idle();
 
+        /**
+         * @Synopsis  在idle中调用，当前线程是弹性扩容的线程且空闲超过scheduler.retire_ms时
+         *            把它从调度器中摘除，之后不会再收到任务
+         *
+         * @Returns   是否已经摘除，idle需要尽快返回
+         */
+        bool shouldRetire();
+
+        /**
+         * @Synopsis  关闭弹性扩缩容，只能在start之前调用，工作线程数量会固定为构造时的数量
+         *            分片的IoManager每个工作线程有自己的reactor，需要固定线程
+         */
+        void disableElastic();
+
         void run();
         void setThis();
         bool hasIdleThreads() {  return m_idleThreadCount > 0; }
 
+        /**
+         * @Synopsis  当前线程在本调度器中的工作线程序号，不是本调度器的工作线程返回-1
+         */
+        int getWorkerIndex() const;
+
+        /**
+         * @Synopsis  工作线程数量(包括use_caller的主线程)
+         */
+        size_t getWorkerCount() const { return m_workers.size(); }
+
+        /**
+         * 空闲线程的睡眠/唤醒协议，每个工作线程一个状态:
+         * RUNNING -> SLEEPING: 空闲线程阻塞之前调用markSleeping，之后必须再检查一次任务
+         * SLEEPING -> NOTIFIED: tickle通过claimSleeper认领一个睡眠线程，认领成功才需要真正唤醒，
+         *                       一批任务只会唤醒一个睡眠线程，已经有唤醒在途时不再重复唤醒
+         * -> RUNNING: 线程醒来后调用markAwake
+         */
+        enum SleepState {
+            RUNNING = 0,
+            SLEEPING = 1,
+            NOTIFIED = 2
+        };
+
+        /**
+         * @Synopsis  当前线程准备睡眠
+         *
+         * @Returns   当前已经有待执行的任务，不应该睡眠
+         */
+        bool markSleeping();
+
+        /**
+         * @Synopsis  当前线程醒来
+         *
+         * @Returns   是否是被claimSleeper认领后唤醒的
+         */
+        bool markAwake();
+
+        /**
+         * @Synopsis  认领一个还没有被通知的睡眠线程
+         *
+         * @Returns   认领到的工作线程序号，调用者需要执行一次唤醒，没有可认领的返回-1
+         */
+        int claimSleeper();
+
+        /**
+         * @Synopsis  认领指定的工作线程
+         *
+         * @Returns   该线程正在睡眠且还没有被通知时返回true
+         */
+        bool claimWorker(size_t idx);
+
+        /**
+         * @Synopsis  唤醒被其他线程消费时，把一个已通知的线程恢复为睡眠，使它可以再次被认领
+         */
+        void releaseNotified();
+
     private:
         template<typename FiberOrCb>
-        bool schedulNoLock(FiberOrCb fc, int thread) {
-            bool need_tickle = m_fiberList.empty();
-            FiberAndThread task(fc, thread);
-            if (task.cb || task.fiber) {
-                m_fiberList.push_back(task);
+        bool schedulImpl(FiberOrCb fc, int thread, int flags) {
+            FiberAndThread* task = new FiberAndThread(std::move(fc), thread);
+            if (!task->cb && !task->fiber) {
+                delete task;
+                return false;
             }
-            return need_tickle;
+            task->flags = flags;
+            return push(task);
         }
 
     private:
         struct FiberAndThread {
             Fiber::ptr fiber;
-            std::function<void()> cb;
+            Task cb;
             int threadId;
+            int flags = TASK_NONE;
+            int lane = PRIORITY_NORMAL;     //所在的优先级队列
+            uint64_t enqueueUs = 0;         //入队时间，不统计排队时间的任务为0
 
             FiberAndThread(Fiber::ptr f, int thr)
-                :fiber(f)
+                :fiber(std::move(f))
                 ,threadId(thr) {}
 
             FiberAndThread(Fiber::ptr* f, int thr)
                 :threadId(thr) { fiber.swap(*f); }
 
-            FiberAndThread(std::function<void()> _cb, int thr)
-                :cb(_cb)
+            FiberAndThread(Task _cb, int thr)
+                :cb(std::move(_cb))
                 ,threadId(thr) {}
 
-            FiberAndThread(std::function<void()> *_cb, int thr)
-                :threadId(thr) { cb.swap(*_cb); }
+            FiberAndThread(Task* _cb, int thr)
+                :cb(std::move(*_cb))
+                ,threadId(thr) {}
 
             FiberAndThread()
                 :threadId(-1) {}
@@ -110,16 +322,96 @@ class Scheduler {
                 fiber = nullptr;
                 cb = nullptr;
                 threadId = -1;
+                flags = TASK_NONE;
+                lane = PRIORITY_NORMAL;
+            }
+        };
+
+        /**
+         * 工作线程的任务队列
+         */
+        struct Worker {
+            Worker(size_t i)
+                :index(i)
+                ,threadId(-1)
+                ,pinnedSize(0)
+                ,sleepState(RUNNING)
+                ,spinLimit(0)
+                ,used(false)
+                ,retired(false)
+                ,busySince(0)
+                ,idleSince(0)
+                ,sharedStack(false) {
+                for (int i = 0; i < PRIORITY_COUNT; ++i) {
+                    credit[i] = 0;
+                    dequeued[i] = 0;
+                    sampled[i] = 0;
+                    waitUs[i] = 0;
+                    maxWaitUs[i] = 0;
+                }
             }
+
+            size_t index;                           //在m_workers中的序号
+            std::atomic<int> threadId;              //所属线程id
+            WorkStealingQueue<FiberAndThread> local;//本线程产生的普通优先级任务，空闲线程可窃取
+            MutexType mutex;
+            std::list<FiberAndThread*> pinned[PRIORITY_COUNT];  //指定在本线程执行的任务，按优先级分开
+            std::atomic<size_t> pinnedSize;         //所有优先级的指定任务总数
+            std::atomic<int> sleepState;            //SleepState，默认idle在它上面futex睡眠
+            uint32_t spinLimit;                     //默认idle睡眠前的自旋次数，按上次自旋的结果调整
+            std::atomic<bool> used;                 //是否有线程在使用，弹性线程退出后可以复用
+            bool retired;                           //所属线程已经退出，由mutex保护
+            std::atomic<uint64_t> busySince;        //开始执行当前任务的时间，空闲时为0，只在弹性调度器中记录
+            uint64_t idleSince;                     //进入空闲的时间，只由所属线程访问
+            bool sharedStack;                       //执行过共享栈任务，有协程绑定在这个线程上，不能退出
+            int credit[PRIORITY_COUNT];             //加权轮转的当前权值，只由所属线程访问
+            //取出任务的统计，只由所属线程修改
+            std::atomic<uint64_t> dequeued[PRIORITY_COUNT];
+            std::atomic<uint64_t> sampled[PRIORITY_COUNT];
+            std::atomic<uint64_t> waitUs[PRIORITY_COUNT];
+            std::atomic<uint64_t> maxWaitUs[PRIORITY_COUNT];
         };
 
+        bool push(FiberAndThread* task);            //任务入队，返回是否需要唤醒线程
+        bool pushPinned(Worker* w, FiberAndThread* task);   //投递到指定线程，该线程已退出返回false
+        void bindThread(FiberAndThread* task);      //共享栈协程只能回到绑定的线程
+        void assignLane(FiberAndThread* task);      //确定任务的优先级队列，记录入队时间
+        FiberAndThread* take(Worker* self);         //选出优先级，再取该优先级的任务
+        int pickLane(Worker* self, int lanes);      //在有任务的优先级中选一个，lanes为位图
+        FiberAndThread* takeLane(Worker* self, int lane);   //按 本线程指定->本地->全局->窃取 的顺序取任务
+        void onDequeue(Worker* self, FiberAndThread* task); //记录取出任务的排队时间
+        Worker* getWorker(int thread);
+        Worker* registerWorker();
+        void pinWorker(Worker* w);                  //按scheduler.affinity把当前线程绑定到CPU
+        void monitor();                             //弹性调度器的监控线程，任务积压时扩容
+        void grow(const char* reason);              //增加一个工作线程
+        void joinRetired();                         //回收已经退出的弹性线程
+        void retireWorker(Worker* w);               //run退出前释放退出线程占用的工作队列
+
     private:
         MutexType m_mutex;
         std::vector<Thread::ptr> m_threadPool;
-        std::list<FiberAndThread> m_fiberList;
+        std::list<FiberAndThread*> m_lanes[PRIORITY_COUNT]; //全局注入队列，每个优先级一条
+        std::atomic<size_t> m_fiberListSize = {0};  //全局队列的任务总数
+        std::atomic<size_t> m_laneDepth[PRIORITY_COUNT];    //高优先级和后台排队的任务数，普通任务由m_taskCount推算
+        std::atomic<uint64_t> m_laneServed[PRIORITY_COUNT]; //每个优先级最近一次取出任务的时间(毫秒)
+        std::vector<Worker*> m_workers;
+        std::atomic<size_t> m_sleeperCursor = {0};  //claimSleeper的起始位置，分散唤醒
+        std::atomic<size_t> m_taskCount = {0};      //所有队列中的任务总数
+        std::atomic<size_t> m_externalCount = {0};  //挂起等待外部线程的协程数
         Fiber::ptr m_rootFiber;
         std::string m_name;
 
+        bool m_elastic = false;                     //是否弹性扩缩容
+        size_t m_maxThreads = 0;                    //最多创建的线程数
+        std::atomic<size_t> m_liveThreads = {0};    //创建的、还没有退出的线程数
+        std::atomic<bool> m_monitorStop = {false};
+        Thread::ptr m_monitor;
+        std::vector<Thread::ptr> m_retired;         //已经退出等待join的线程，由m_mutex保护
+        std::atomic<uint64_t> m_growCount = {0};
+        std::atomic<uint64_t> m_retireCount = {0};
+        std::string m_lastResize;                   //最近一次扩缩容的原因，由m_mutex保护
+
     protected:
         std::vector<int> m_threadIds;
         size_t m_threadCount = 0;
@@ -131,4 +423,15 @@ class Scheduler {
 };
 
 
+template<typename FiberOrCb>
+void Scheduler::TaskBatch::add(FiberOrCb fc, int thread, int flags) {
+    FiberAndThread* task = new FiberAndThread(std::move(fc), thread);
+    if (!task->cb && !task->fiber) {
+        delete task;
+        return;
+    }
+    task->flags = flags;
+    m_tasks.push_back(task);
+}
+
 }
@@ -84,6 +84,12 @@ public:
         return setOption(level, option, &result, sizeof(T));
     }
 
+    /**
+     * @Synopsis  开启SO_REUSEPORT，需要在bind之前调用
+     *            多个socket可以监听同一个地址，由内核把新连接分散到各个socket
+     */
+    bool setReusePort();
+
 
     /**
      * @Synopsis  接收connect 连接
@@ -0,0 +1,186 @@
+/**
+ * @file task.h
+ * @Synopsis  只能移动的无参回调，小的可调用对象直接存放在对象内部，不分配内存
+ * @author Fang
+ * @version 1.0
+ * @date 2022-04-02
+ */
+#ifndef __FANG_TASK_H__
+#define __FANG_TASK_H__
+
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <stddef.h>
+
+namespace fang {
+
+/**
+* @Synopsis  代替std::function<void()>在调度器、定时器、io事件之间传递任务
+*            不超过INLINE_SIZE且移动不抛异常的可调用对象放在内部缓冲区，
+*            更大的放在堆上，移动时只移动指针
+*            不能拷贝，队列之间只移动，调用后仍然保留可调用对象
+*/
+class Task {
+private:
+    template<class F, class = void>
+    struct IsCallable : std::false_type {};
+
+    template<class F>
+    struct IsCallable<F, decltype((void)std::declval<F&>()())> : std::true_type {};
+
+public:
+    static const size_t INLINE_SIZE = 64;
+
+    Task()
+        :m_ops(nullptr) {}
+
+    Task(std::nullptr_t)
+        :m_ops(nullptr) {}
+
+    /**
+     * @Synopsis  从任意无参可调用对象构造，空的std::function和空函数指针得到空任务
+     */
+    template<class F, class = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value
+        && IsCallable<typename std::decay<F>::type>::value>::type>
+    Task(F&& f)
+        :m_ops(nullptr) {
+        if (!IsNull(f)) {
+            init(std::forward<F>(f), IsInline<typename std::decay<F>::type>());
+        }
+    }
+
+    Task(Task&& other) noexcept
+        :m_ops(other.m_ops) {
+        if (m_ops) {
+            m_ops->move(&m_storage, &other.m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            if (other.m_ops) {
+                other.m_ops->move(&m_storage, &other.m_storage);
+                m_ops = other.m_ops;
+                other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task& operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    explicit operator bool() const { return m_ops != nullptr; }
+
+    void operator()() {
+        if (!m_ops) {
+            throw std::bad_function_call();
+        }
+        m_ops->invoke(&m_storage);
+    }
+
+    void reset() {
+        if (m_ops) {
+            m_ops->destroy(&m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+    void swap(Task& other) {
+        Task tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+    /**
+     * @Synopsis  可调用对象是否放在内部缓冲区
+     */
+    bool isInline() const { return m_ops && m_ops->isInline; }
+
+private:
+    typedef typename std::aligned_storage<INLINE_SIZE>::type Storage;
+
+    struct Ops {
+        void (*invoke)(void* p);
+        void (*move)(void* dst, void* src);     //移动到dst并析构src
+        void (*destroy)(void* p);
+        bool isInline;
+    };
+
+    template<class F>
+    struct IsInline : std::integral_constant<bool, sizeof(F) <= INLINE_SIZE
+        && alignof(Storage) % alignof(F) == 0
+        && std::is_nothrow_move_constructible<F>::value> {};
+
+    template<class F>
+    static bool IsNull(const F&) { return false; }
+
+    template<class R, class... Args>
+    static bool IsNull(const std::function<R(Args...)>& f) { return !f; }
+
+    template<class R, class... Args>
+    static bool IsNull(R (*f)(Args...)) { return f == nullptr; }
+
+    template<class F>
+    void init(F&& f, std::true_type) {
+        typedef typename std::decay<F>::type Fn;
+        new (&m_storage) Fn(std::forward<F>(f));
+        m_ops = &InlineOps<Fn>::s_ops;
+    }
+
+    template<class F>
+    void init(F&& f, std::false_type) {
+        typedef typename std::decay<F>::type Fn;
+        *(Fn**)&m_storage = new Fn(std::forward<F>(f));
+        m_ops = &HeapOps<Fn>::s_ops;
+    }
+
+    template<class F>
+    struct InlineOps {
+        static void Invoke(void* p) { (*(F*)p)(); }
+        static void Move(void* dst, void* src) {
+            new (dst) F(std::move(*(F*)src));
+            ((F*)src)->~F();
+        }
+        static void Destroy(void* p) { ((F*)p)->~F(); }
+        static const Ops s_ops;
+    };
+
+    template<class F>
+    struct HeapOps {
+        static void Invoke(void* p) { (**(F**)p)(); }
+        static void Move(void* dst, void* src) { *(F**)dst = *(F**)src; }
+        static void Destroy(void* p) { delete *(F**)p; }
+        static const Ops s_ops;
+    };
+
+private:
+    Storage m_storage;
+    const Ops* m_ops;
+};
+
+template<class F>
+const Task::Ops Task::InlineOps<F>::s_ops = {
+    &Task::InlineOps<F>::Invoke, &Task::InlineOps<F>::Move, &Task::InlineOps<F>::Destroy, true
+};
+
+template<class F>
+const Task::Ops Task::HeapOps<F>::s_ops = {
+    &Task::HeapOps<F>::Invoke, &Task::HeapOps<F>::Move, &Task::HeapOps<F>::Destroy, false
+};
+
+}
+
+#endif
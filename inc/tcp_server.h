@@ -24,6 +24,7 @@ struct TcpServerConf {
     int keepalive = 0;
     int timeout = 1000 * 2 * 60;
     int ssl = 0;
+    int reuseport = 0;  //每个io线程一个SO_REUSEPORT监听socket，io_worker分片时连接在接受它的线程上处理
 
     std::string id;
     std::string type = "http";
@@ -45,14 +46,15 @@ struct TcpServerConf {
             && timeout == oth.timeout
             && name == oth.name
             && ssl == oth.ssl
+            && reuseport == oth.reuseport
             && cerf_file == oth.cerf_file
             && key_file == oth.key_file
-            && accept_worker = oth.accept_worker
+            && accept_worker == oth.accept_worker
             && io_worker == oth.io_worker
             && process_worker == oth.process_worker
-            && args = oth.args
-            && id = oth.id
-            && type = oth.type;
+            && args == oth.args
+            && id == oth.id
+            && type == oth.type;
     }
 
     };
@@ -69,10 +71,11 @@ struct TcpServerConf {
             conf.timeout = node["timeout"].as<int>(conf.timeout);
             conf.name = node["name"].as<std::string>(conf.name);
             conf.ssl = node["ssl"].as<int>(conf.ssl);
+            conf.reuseport = node["reuseport"].as<int>(conf.reuseport);
             conf.cerf_file = node["cerf_file"].as<std::string>(conf.cerf_file);
             conf.key_file = node["key_file"].as<std::string>(conf.key_file);
             conf.accept_worker = node["accept_worker"].as<std::string>(conf.accept_worker);
-            conf.process_worker = node["process_worker"].as<std::string>(conf.accept_worker);
+            conf.process_worker = node["process_worker"].as<std::string>(conf.process_worker);
             conf.io_worker = node["io_worker"].as<std::string>(conf.io_worker);
             conf.args = LexicalCast<std::string
                 , std::map<std::string, std::string> >()(node["args"].as<std::string>(""));
@@ -97,7 +100,8 @@ struct TcpServerConf {
             node["keepalive"] = conf.keepalive;
             node["timeout"] = conf.timeout;
             node["ssl"] = conf.ssl;
-            node["cert_file"] = conf.cert_file;
+            node["reuseport"] = conf.reuseport;
+            node["cerf_file"] = conf.cerf_file;
             node["key_file"] = conf.key_file;
             node["accept_worker"] = conf.accept_worker;
             node["io_worker"] = conf.io_worker;
@@ -113,15 +117,15 @@ struct TcpServerConf {
         }
 };
 
-class TcpServer : std::enable_shared_from_this<TcpServer>
+class TcpServer : public std::enable_shared_from_this<TcpServer>
                 , Noncopyable {
 
 public:
-    std::shared_ptr<TcpServer> ptr;
+    typedef std::shared_ptr<TcpServer> ptr;
 
-    TcpServer(fang::IOManager* worker = fang::IoManager::GetThis()
-            , fang::IOManager* io_worker = fang::IoManager::GetThis()
-            , fang::IOManager* accept_worker = fang::IOManager::GetThis());
+    TcpServer(fang::IoManager* worker = fang::IoManager::GetThis()
+            , fang::IoManager* io_worker = fang::IoManager::GetThis()
+            , fang::IoManager* accept_worker = fang::IoManager::GetThis());
 
     ~TcpServer();
 
@@ -189,6 +193,20 @@ public:
      */
     virtual void setName(const std::string& v) { m_name = v; }
 
+    /**
+     * @Synopsis  是否每个io线程一个SO_REUSEPORT监听socket，需要在bind之前设置
+     *            io_worker为分片模式(IoManager sharded，配置文件创建的io_worker由iomanager.sharded开启)时，
+     *            每个监听socket固定在一个io线程上accept，连接在接受它的线程上处理，fd也只注册在该线程的epoll上；
+     *            非分片时各监听socket共享一个epoll，不固定线程，只在内核层面分散连接
+     */
+    bool isReusePort() const { return m_reusePort; }
+    void setReusePort(bool v) { m_reusePort = v; }
+
+    /**
+     * @Synopsis  使用配置项设置服务
+     */
+    void setConf(const TcpServerConf& v);
+
     /**
      * @Synopsis  获取是否停止
      */
@@ -202,7 +220,7 @@ public:
     /**
      * @Synopsis  获取所有服务socket
      */
-    std::vector<Socket::ptr> getSocks const { return m_socks; }
+    std::vector<Socket::ptr> getSocks() const { return m_socks; }
 
 protected:
 
@@ -214,21 +232,23 @@ protected:
     /**
      * @Synopsis  开始接受socket连接
      */
-    virtual void [<0;70;26M]startAccept(Socket::ptr sock);
+    virtual void startAccept(Socket::ptr sock);
 
 protected:
     std::vector<Socket::ptr> m_socks;   // 监听socket数组
-    IOManager* m_worker;                // socket工作调度器
-    IOManager* m_ioWorker;
-    IOManager* m_acceptWorker;          // 新socket接受连接的调度器
+    std::vector<int> m_sockThreads;     // 监听socket固定accept的线程，-1表示任意线程
+    IoManager* m_worker;                // socket工作调度器
+    IoManager* m_ioWorker;
+    IoManager* m_acceptWorker;          // 新socket接受连接的调度器
     uint64_t m_recvTimeout;             // 接收超时时间
     std::string m_name;                 // 服务器名称
     std::string m_type = "tcp";         // 服务器类型
     bool m_isStop;                      // 服务是否停止
     bool m_ssl = false;
+    bool m_reusePort = false;           // 每个io线程一个监听socket
 
     TcpServerConf::ptr m_conf;
-}
+};
 }
 
 
@@ -3,10 +3,12 @@
 
 #include <memory>
 #include <vector>
-#include <set>
+#include <atomic>
 #include <functional>
 #include <stdlib.h>
+#include <stdint.h>
 #include "mutex.h"
+#include "task.h"
 
 namespace fang {
     
@@ -32,6 +34,12 @@ public:
      */
     bool reset(uint64_t ms, bool from_now); 
 
+    /**
+     * @Synopsis  到期后回调使用的调度优先级(Scheduler::Priority)，默认为创建定时器时所在任务的优先级
+     */
+    int getPriority() const { return m_priority; }
+    void setPriority(int priority) { m_priority = priority; }
+
 private:
 
     /**
@@ -42,51 +50,58 @@ private:
      * @Param[in] recurring 是否循环
      * @Param[in] tmgr 定时器容器
      */
-    Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager * tmgr);
-    
-    /**
-     * @Param[in] next 执行的时间
-     */
-    Timer(uint64_t next);
+    Timer(uint64_t ms, Task cb, bool recurring, TimerManager * tmgr);
+
 private:
     bool m_recurring = false;   //是否循环定时器
     uint64_t m_ms = 0;          //执行周期
-    uint64_t m_next = 0;        //精确地执行时间
-    std::function<void()> m_cb; //回调函数
+    uint64_t m_next = 0;        //精确地执行时间(单调时钟，毫秒)
+    Task m_cb;                  //回调函数，单次定时器到期时移出
+    std::shared_ptr<Task> m_shared; //循环定时器的回调，每次到期共享调用，不拷贝
     TimerManager *m_TMgr = nullptr;
-
-private:
-    struct Comparator {
-
-        /**
-         * @Synopsis  定时器比较坊函数
-         */
-        bool operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const;
-    };
+    int m_priority = 1;         //到期回调的调度优先级
+
+    //时间轮中的侵入式链表节点，由所在时间轮的锁保护
+    size_t m_wheel = 0;             //所在时间轮下标
+    int m_level = -1;               //所在层，-1表示不在时间轮中
+    int m_slot = 0;                 //所在槽位
+    Timer* m_prevNode = nullptr;
+    Timer* m_nextNode = nullptr;
+    Timer::ptr m_self;              //在时间轮中时持有自身，保证回调前不被释放
 };
 
 
-//定时器管理类
+/**
+* @Synopsis  定时器管理类
+*            定时器保存在分层时间轮中(每层64个槽，共6层，精度1毫秒)，
+*            添加、取消都是O(1)，到期时高层槽位的定时器逐层降到低层
+*            每个线程使用自己的时间轮(按线程分片)，不同线程添加定时器互不竞争
+*/
 class TimerManager {
 public:
     friend class Timer;
 
 public:
-    TimerManager();
-    virtual ~TimerManager(){}
+    /**
+     * @Synopsis  构造器
+     *
+     * @Param[in] wheels 时间轮分片数量，一般等于使用定时器的线程数
+     */
+    TimerManager(size_t wheels = 1);
+    virtual ~TimerManager();
 
     //添加一个定时器
-    Timer::ptr addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
+    Timer::ptr addTimer(uint64_t ms, Task cb, bool recurring = false);
     
     //添加条件定时器
-    Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb,
+    Timer::ptr addConditionTimer(uint64_t ms, Task cb,
             std::weak_ptr<void> weak_cond, bool recurring = false);
 
     //获取最近的定时器的时间差
     uint64_t getNextTimer();
 
-    //获取需要执行处理函数的定时器的处理函数列表
-    void listExpiredCb(std::vector<std::function<void()> > &cbs);
+    //获取需要执行处理函数的定时器的处理函数列表，priorities不为空时同时输出各回调的优先级
+    void listExpiredCb(std::vector<Task> &cbs, std::vector<int>* priorities = nullptr);
 
     //是否有定时器
     bool hasTimer();
@@ -94,18 +109,47 @@ public:
 
 protected:
     virtual void onTimerInsertedAtFront() = 0;
-    void addTimer(Timer::ptr val, RWMutex::WrLock& lock);
-    
+
 private:
-    //检测服务器时间是否被调后
-    bool detectClockRollover(uint64_t now_ms);
+    static const int WHEEL_BITS = 6;
+    static const int WHEEL_SIZE = 1 << WHEEL_BITS;
+    static const int WHEEL_MASK = WHEEL_SIZE - 1;
+    static const int WHEEL_LEVELS = 6;
+
+    //一个时间轮分片
+    struct Wheel {
+        Mutex mutex;
+        uint64_t current = 0;                           //已经处理到的时间
+        size_t count = 0;                               //定时器数量
+        uint64_t bitmap[WHEEL_LEVELS] = {0};            //每层非空槽位的位图
+        Timer* slots[WHEEL_LEVELS][WHEEL_SIZE] = {{nullptr}};
+    };
+
+    //当前线程使用的时间轮
+    Wheel* getWheel(size_t& idx);
+
+    //把定时器放入时间轮对应的槽位
+    static void Link(Wheel* wheel, Timer* timer);
+
+    //把定时器从时间轮中摘除
+    static void Unlink(Wheel* wheel, Timer* timer);
+
+    //把第level层中tick对应槽位的定时器降到低层
+    static void Cascade(Wheel* wheel, int level, uint64_t tick);
+
+    //推进时间轮到now，取出到期的定时器
+    static void Advance(Wheel* wheel, uint64_t now, std::vector<Timer::ptr>& expired);
+
+    //时间轮中最早需要处理的时间，没有定时器返回~0ull
+    static uint64_t NextExpire(Wheel* wheel);
 
+    //定时器可能早于当前最早的定时器，需要唤醒正在等待的线程
+    void checkFront(uint64_t next);
 
 private:
-   RWMutex m_mutex;//一个全局读写锁
-   std::set<Timer::ptr, Timer::Comparator> m_timers;//一个所有定时器的容器
-   bool m_tickled = false; //是否触发
-   uint64_t m_previouseTime = 0; //上次执行时间
+    std::vector<Wheel*> m_wheels;
+    std::atomic<bool> m_tickled; //是否已经触发唤醒
+    std::atomic<uint64_t> m_nextExpire; //等待线程所知道的最早到期时间
 };
 
 
@@ -0,0 +1,116 @@
+/**
+ * @file work_queue.h
+ * @Synopsis  调度器工作线程使用的有界无锁任务队列
+ * @author Fang
+ * @version 1.0
+ * @date 2022-03-02
+ */
+#ifndef __FANG_WORK_QUEUE_H__
+#define __FANG_WORK_QUEUE_H__
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "singleton.h"
+
+namespace fang {
+
+/**
+* @Synopsis  单生产者、多消费者的有界环形队列
+*            只有队列所属线程可以push，所属线程与其他线程都通过CAS取出队头，
+*            所以所属线程按FIFO顺序执行任务，空闲线程可以从队头窃取任务
+*
+* @tparam T 任务类型，队列只保存指针，不负责释放
+*/
+template<typename T>
+class WorkStealingQueue : Noncopyable {
+public:
+
+    /**
+     * @Synopsis  构造器
+     *
+     * @Param[in] capacity 队列容量，向上取整为2的幂
+     */
+    WorkStealingQueue(size_t capacity = 256)
+        : m_head(0)
+        , m_tail(0)
+        , m_mask(RoundUp(capacity) - 1)
+        , m_slots(m_mask + 1) {
+    }
+
+    /**
+     * @Synopsis  放入任务，只能由所属线程调用
+     *
+     * @Returns   队列已满返回false
+     */
+    bool push(T* v) {
+        uint64_t t = m_tail.load(std::memory_order_relaxed);
+        uint64_t h = m_head.load(std::memory_order_acquire);
+        if (t - h > m_mask) {
+            return false;
+        }
+        m_slots[t & m_mask].store(v, std::memory_order_relaxed);
+        m_tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @Synopsis  从队头取出任务，任意线程都可以调用
+     *
+     * @Returns   队列为空返回nullptr
+     */
+    T* pop() {
+        while (true) {
+            uint64_t h = m_head.load(std::memory_order_acquire);
+            uint64_t t = m_tail.load(std::memory_order_acquire);
+            if (h == t) {
+                return nullptr;
+            }
+            T* v = m_slots[h & m_mask].load(std::memory_order_relaxed);
+            if (m_head.compare_exchange_weak(h, h + 1
+                        , std::memory_order_acq_rel
+                        , std::memory_order_relaxed)) {
+                return v;
+            }
+        }
+    }
+
+    /**
+     * @Synopsis  其他线程窃取任务
+     */
+    T* steal() { return pop(); }
+
+    /**
+     * @Synopsis  当前任务数量(近似值)
+     */
+    size_t size() const {
+        uint64_t h = m_head.load(std::memory_order_acquire);
+        uint64_t t = m_tail.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    static size_t RoundUp(size_t v) {
+        size_t cap = 1;
+        while (cap < v) {
+            cap <<= 1;
+        }
+        return cap;
+    }
+
+private:
+    std::atomic<uint64_t> m_head;       // 队头，消费者通过CAS推进
+    char m_pad[64 - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> m_tail;       // 队尾，只有所属线程修改
+    uint64_t m_mask;                    // 容量掩码
+    std::vector<std::atomic<T*> > m_slots;  // 任务槽
+};
+
+}
+
+#endif
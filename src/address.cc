@@ -1,5 +1,6 @@
 #include "../inc/address.h"
 #include "../inc/endian_.h"
+#include "../inc/blocking.h"
 #include <iterator>
 #include <memory>
 #include <sstream>
@@ -84,7 +85,10 @@ namespace fang {
             node = host;
         }
         
-        int error = getaddrinfo(node.c_str(), service, &hints, &results);
+        //getaddrinfo会读文件、同步等待DNS应答，在阻塞线程池中执行
+        int error = await_blocking([&]() {
+            return getaddrinfo(node.c_str(), service, &hints, &results);
+        });
         if (error != 0) {
             throw std::logic_error("getaddrinfo fail!");
         }
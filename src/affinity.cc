@@ -0,0 +1,108 @@
+#include "../inc/affinity.h"
+#include "../inc/log.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+namespace fang {
+
+static fang::Logger::ptr g_logger = FANG_LOG_NAME("system");
+
+static const int MAX_NUMA_NODES = 1024;
+
+static thread_local int t_numa_node = -1;   //当前线程绑定的CPU所在的节点
+
+bool SetThreadAffinity(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    int node = -2;
+    for (auto cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            FANG_LOG_ERROR(g_logger) << "SetThreadAffinity invalid cpu=" << cpu;
+            return false;
+        }
+        CPU_SET(cpu, &set);
+        int n = GetCpuNumaNode(cpu);
+        node = (node == -2 || node == n) ? n : -1;
+    }
+    if (sched_setaffinity(0, sizeof(set), &set)) {
+        FANG_LOG_ERROR(g_logger) << "sched_setaffinity errno=" << errno
+            << " errstr=" << strerror(errno);
+        return false;
+    }
+    t_numa_node = node;
+    return true;
+}
+
+int GetNumaNodeCount() {
+    static int s_count = -1;
+    if (s_count == -1) {
+        int count = 0;
+        DIR* dir = opendir("/sys/devices/system/node");
+        if (dir) {
+            struct dirent* dp = nullptr;
+            while ((dp = readdir(dir)) != nullptr) {
+                if (strncmp(dp->d_name, "node", 4) == 0 && isdigit(dp->d_name[4])) {
+                    ++count;
+                }
+            }
+            closedir(dir);
+        }
+        s_count = count ? count : 1;
+    }
+    return s_count;
+}
+
+int GetCpuNumaNode(int cpu) {
+    //cpuN目录下有一个指向所在节点的nodeM链接
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return -1;
+    }
+    int node = -1;
+    struct dirent* dp = nullptr;
+    while ((dp = readdir(dir)) != nullptr) {
+        if (strncmp(dp->d_name, "node", 4) == 0 && isdigit(dp->d_name[4])) {
+            node = atoi(dp->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+int GetThreadNumaNode() {
+    return t_numa_node;
+}
+
+bool BindToNumaNode(void* addr, size_t len, int node) {
+    if (GetNumaNodeCount() <= 1) {
+        return true;
+    }
+    if (node < 0 || node >= MAX_NUMA_NODES) {
+        return false;
+    }
+    const int bits = 8 * sizeof(unsigned long);
+    unsigned long mask[MAX_NUMA_NODES / bits];
+    memset(mask, 0, sizeof(mask));
+    mask[node / bits] = 1ul << (node % bits);
+    if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask, MAX_NUMA_NODES, 0)) {
+        FANG_LOG_ERROR(g_logger) << "mbind node=" << node << " len=" << len
+            << " errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,152 @@
+#include "../inc/blocking.h"
+#include "../inc/config.h"
+#include "../inc/helpc.h"
+#include "../inc/log.h"
+#include "../inc/scheduler.h"
+
+namespace fang {
+
+static fang::Logger::ptr g_logger = FANG_LOG_NAME("system");
+
+static fang::ConfigVar<uint32_t>::ptr g_blocking_threads
+    = fang::Config::Lookup<uint32_t>("blocking.threads", 4
+            , "threads of the default blocking task pool used by await_blocking");
+
+BlockingPool::BlockingPool(size_t threads, const std::string& name)
+    :m_name(name) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        m_threads.push_back(Thread::ptr(new Thread(std::bind(&BlockingPool::run, this)
+                        , m_name + "_" + std::to_string(i))));
+    }
+}
+
+BlockingPool::~BlockingPool() {
+    {
+        MutexType::Lock lock(m_mutex);
+        m_stopping = true;
+    }
+    for (size_t i = 0; i < m_threads.size(); ++i) {
+        m_sem.post();
+    }
+    for (auto& i : m_threads) {
+        i->join();
+    }
+}
+
+void BlockingPool::submit(Task task) {
+    if (!task) {
+        return;
+    }
+    {
+        MutexType::Lock lock(m_mutex);
+        ++m_stats.submitted;
+        if (m_stats.busy + m_queue.size() >= m_threads.size()) {
+            ++m_stats.saturated;
+        }
+        m_queue.push_back(Item());
+        m_queue.back().task = std::move(task);
+        m_queue.back().enqueueUs = GetMonotonicUS();
+        if (m_queue.size() > m_stats.maxQueued) {
+            m_stats.maxQueued = m_queue.size();
+        }
+    }
+    m_sem.post();
+}
+
+void BlockingPool::await(Task task) {
+    Scheduler* scheduler = Scheduler::GetThis();
+    Fiber::ptr fiber = Fiber::GetThis();
+    //调度协程不能挂起，共享栈协程切出后栈上的变量会被其他协程覆盖
+    if (!scheduler || fiber.get() == Scheduler::GetMainFiber() || fiber->isSharedStack()) {
+        task();
+        return;
+    }
+
+    //协程挂起期间调度器不能停止，重新调度之后才减少计数
+    scheduler->suspendExternal();
+    submit([scheduler, fiber, &task]() mutable {
+        try {
+            task();
+        } catch (std::exception& ex) {
+            FANG_LOG_ERROR(g_logger) << "blocking task except: " << ex.what();
+        } catch (...) {
+            FANG_LOG_ERROR(g_logger) << "blocking task except: unknown exception";
+        }
+        //无论任务如何结束都要重新调度，否则协程永远挂起，调度器也无法停止
+        scheduler->schedul(&fiber);
+        scheduler->resumeExternal();
+    });
+    fiber.reset();
+    //池中的线程可能在挂起之前就重新调度了该协程，调度器会等到协程切出后再执行
+    Fiber::YieldToHold();
+}
+
+BlockingPool::Stats BlockingPool::getStats() {
+    MutexType::Lock lock(m_mutex);
+    Stats stats = m_stats;
+    stats.threads = m_threads.size();
+    stats.queued = m_queue.size();
+    return stats;
+}
+
+std::ostream& BlockingPool::dump(std::ostream& os) {
+    Stats stats = getStats();
+    os << "[BlockingPool name=" << m_name
+       << ", threads=" << stats.threads
+       << ", busy=" << stats.busy
+       << ", queued=" << stats.queued
+       << ", max_queued=" << stats.maxQueued
+       << ", submitted=" << stats.submitted
+       << ", completed=" << stats.completed
+       << ", saturated=" << stats.saturated
+       << ", avg_wait_us=" << (uint64_t)stats.avgWaitUs()
+       << ", max_wait_us=" << stats.maxWaitUs
+       << "]";
+    return os;
+}
+
+BlockingPool* BlockingPool::GetDefault() {
+    static BlockingPool s_pool(g_blocking_threads->getValue());
+    return &s_pool;
+}
+
+void BlockingPool::run() {
+    while (true) {
+        m_sem.wait();
+        Item item;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_queue.empty()) {
+                if (m_stopping) {
+                    break;
+                }
+                continue;
+            }
+            item = std::move(m_queue.front());
+            m_queue.pop_front();
+            ++m_stats.busy;
+            uint64_t now = GetMonotonicUS();
+            uint64_t wait = now > item.enqueueUs ? now - item.enqueueUs : 0;
+            m_stats.totalWaitUs += wait;
+            if (wait > m_stats.maxWaitUs) {
+                m_stats.maxWaitUs = wait;
+            }
+        }
+        try {
+            item.task();
+        } catch (std::exception& ex) {
+            FANG_LOG_ERROR(g_logger) << "blocking pool " << m_name << " task except: " << ex.what();
+        } catch (...) {
+            FANG_LOG_ERROR(g_logger) << "blocking pool " << m_name << " task except: unknown exception";
+        }
+        item.task.reset();
+        MutexType::Lock lock(m_mutex);
+        --m_stats.busy;
+        ++m_stats.completed;
+    }
+}
+
+}
@@ -0,0 +1,130 @@
+#include "../inc/cancel.h"
+#include "../inc/fiber_local.h"
+#include "../inc/helpc.h"
+#include "../inc/iomanager.h"
+#include <errno.h>
+
+namespace fang {
+
+//函数内的静态变量，保证其他全局对象构造时使用已经分配了槽
+static FiberLocal<CancelToken::ptr>& CurrentToken() {
+    static FiberLocal<CancelToken::ptr> s_token(true);
+    return s_token;
+}
+
+CancelToken::CancelToken() {
+}
+
+CancelToken::~CancelToken() {
+    if (m_timer) {
+        m_timer->cancel();
+    }
+}
+
+CancelToken::ptr CancelToken::WithTimeout(uint64_t timeout_ms, TimerManager* timers) {
+    CancelToken::ptr token(new CancelToken);
+    token->m_deadline = fang::GetMonotonicMS() + timeout_ms;
+    if (!timers) {
+        timers = IoManager::GetThis();
+    }
+    if (timers) {
+        std::weak_ptr<CancelToken> weak(token);
+        token->m_timer = timers->addTimer(timeout_ms, [weak]() {
+            CancelToken::ptr t = weak.lock();
+            if (t) {
+                t->cancel(ETIMEDOUT);
+            }
+        });
+    }
+    return token;
+}
+
+bool CancelToken::cancel(int error) {
+    int expected = 0;
+    if (!m_error.compare_exchange_strong(expected, error, std::memory_order_acq_rel)) {
+        return false;
+    }
+    MutexType::Lock lock(m_mutex);
+    for (auto& i : m_callbacks) {
+        i.second();
+    }
+    m_callbacks.clear();
+    return true;
+}
+
+bool CancelToken::isCancelled() {
+    if (getError()) {
+        return true;
+    }
+    if (m_deadline != ~0ull && fang::GetMonotonicMS() >= m_deadline) {
+        cancel(ETIMEDOUT);
+        return true;
+    }
+    return false;
+}
+
+uint64_t CancelToken::getRemainingMs() {
+    if (isCancelled()) {
+        return 0;
+    }
+    if (m_deadline == ~0ull) {
+        return ~0ull;
+    }
+    uint64_t now = fang::GetMonotonicMS();
+    return m_deadline > now ? m_deadline - now : 0;
+}
+
+uint64_t CancelToken::addCallback(Task cb) {
+    MutexType::Lock lock(m_mutex);
+    //cancel先设置错误码再加锁执行回调，这里看到错误码时回调已经不会被执行
+    if (getError()) {
+        return 0;
+    }
+    uint64_t id = ++m_nextId;
+    m_callbacks[id] = std::move(cb);
+    return id;
+}
+
+void CancelToken::removeCallback(uint64_t id) {
+    if (!id) {
+        return;
+    }
+    MutexType::Lock lock(m_mutex);
+    m_callbacks.erase(id);
+}
+
+CancelToken* CancelToken::GetCurrent() {
+    CancelToken::ptr* token = CurrentToken().get();
+    return token ? token->get() : nullptr;
+}
+
+bool CancelToken::CheckCurrent() {
+    CancelToken* token = GetCurrent();
+    if (token && token->isCancelled()) {
+        errno = token->getError();
+        return true;
+    }
+    return false;
+}
+
+CancelScope::CancelScope(CancelToken::ptr token) {
+    CancelToken::ptr* prev = CurrentToken().get();
+    if (prev) {
+        m_prev = *prev;
+    }
+    if (token) {
+        CurrentToken().set(std::move(token));
+    } else {
+        CurrentToken().reset();
+    }
+}
+
+CancelScope::~CancelScope() {
+    if (m_prev) {
+        CurrentToken().set(std::move(m_prev));
+    } else {
+        CurrentToken().reset();
+    }
+}
+
+}
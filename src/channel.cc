@@ -0,0 +1,170 @@
+#include "../inc/channel.h"
+#include "../inc/scheduler.h"
+#include "../inc/iomanager.h"
+#include "../inc/helpc.h"
+#include "../inc/mydef.h"
+
+namespace fang {
+
+static thread_local size_t t_select_seed = 0;   //select轮询起点，避免总是偏向第一个分支
+
+ChannelBase::ChannelBase()
+    :m_closed(false) {
+    m_waiting[RECV].store(0, std::memory_order_relaxed);
+    m_waiting[SEND].store(0, std::memory_order_relaxed);
+}
+
+void ChannelBase::close() {
+    std::list<Waiter::ptr> waiters;
+    {
+        Spinlock::Lock lock(m_mutex);
+        if (m_closed.exchange(true)) {
+            return;
+        }
+        for (int i = RECV; i <= SEND; ++i) {
+            waiters.splice(waiters.end(), m_waiters[i]);
+            m_waiting[i].store(0, std::memory_order_relaxed);
+        }
+    }
+    for (auto& i : waiters) {
+        if (!i->fired.exchange(true)) {
+            i->scheduler->schedul(i->fiber);
+        }
+    }
+}
+
+void ChannelBase::notifySlow(Direction dir) {
+    Waiter::ptr waiter;
+    {
+        Spinlock::Lock lock(m_mutex);
+        auto& waiters = m_waiters[dir];
+        while (!waiters.empty()) {
+            Waiter::ptr w = waiters.front();
+            waiters.pop_front();
+            m_waiting[dir].fetch_sub(1, std::memory_order_relaxed);
+            //已经被其他通道唤醒的select等待者直接丢弃
+            if (!w->fired.exchange(true)) {
+                waiter = w;
+                break;
+            }
+        }
+    }
+    if (waiter) {
+        waiter->scheduler->schedul(waiter->fiber);
+    }
+}
+
+void ChannelBase::addWaiter(Direction dir, Waiter::ptr waiter) {
+    Spinlock::Lock lock(m_mutex);
+    m_waiters[dir].push_back(waiter);
+    m_waiting[dir].fetch_add(1, std::memory_order_relaxed);
+}
+
+void ChannelBase::removeWaiter(Direction dir, Waiter::ptr waiter) {
+    Spinlock::Lock lock(m_mutex);
+    auto& waiters = m_waiters[dir];
+    for (auto it = waiters.begin(); it != waiters.end(); ++it) {
+        if (*it == waiter) {
+            waiters.erase(it);
+            m_waiting[dir].fetch_sub(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+}
+
+int Selector::poll(size_t start) {
+    size_t n = m_cases.size();
+    for (size_t i = 0; i < n; ++i) {
+        size_t idx = (start + i) % n;
+        Case& c = m_cases[idx];
+        int rt = c.op();
+        if (rt != 0) {
+            if (c.ok) {
+                *c.ok = rt > 0;
+            }
+            return idx;
+        }
+    }
+    return -1;
+}
+
+int Selector::select(uint64_t timeout_ms) {
+    if (m_cases.empty()) {
+        return -1;
+    }
+    size_t start = t_select_seed++;
+    int idx = poll(start);
+    if (idx >= 0 || timeout_ms == 0) {
+        return idx;
+    }
+
+    Scheduler* scheduler = Scheduler::GetThis();
+    FANG_ASSERT2(scheduler, "blocking channel operation outside scheduler");
+    uint64_t deadline = timeout_ms == ~0ull ? ~0ull : GetMonotonicMS() + timeout_ms;
+    bool woken = false;
+    while (true) {
+        ChannelBase::Waiter::ptr waiter(new ChannelBase::Waiter);
+        waiter->scheduler = scheduler;
+        waiter->fiber = Fiber::GetThis();
+        for (auto& i : m_cases) {
+            i.chan->addWaiter(i.dir, waiter);
+        }
+        //与通道收发后的屏障配对: 要么这里看到新状态，要么对方看到等待者
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        idx = poll(start);
+
+        Timer::ptr timer;
+        if (idx >= 0) {
+            //已经被唤醒的话调度器里有一次待执行的调度，需要切出去消化掉
+            //唤醒者已经把自己从它的等待队列中取出，完成的可能不是它，需要把唤醒传下去
+            if (waiter->fired.exchange(true)) {
+                Fiber::YieldToHold();
+                woken = true;
+            }
+        } else {
+            if (deadline != ~0ull) {
+                uint64_t now = GetMonotonicMS();
+                IoManager* iom = IoManager::GetThis();
+                FANG_ASSERT2(iom, "channel select timeout requires IoManager");
+                timer = iom->addTimer(deadline > now ? deadline - now : 0, [waiter]() {
+                    if (!waiter->fired.exchange(true)) {
+                        waiter->timeout = true;
+                        waiter->scheduler->schedul(waiter->fiber);
+                    }
+                });
+            }
+            Fiber::YieldToHold();
+            woken = true;
+        }
+
+        if (timer && !waiter->timeout) {
+            timer->cancel();
+        }
+        for (auto& i : m_cases) {
+            i.chan->removeWaiter(i.dir, waiter);
+        }
+        if (idx < 0 && !waiter->timeout) {
+            idx = poll(start);
+        }
+        if (idx >= 0 || waiter->timeout) {
+            break;
+        }
+    }
+
+    //被唤醒后完成的可能不是唤醒自己的那个通道，把唤醒传给其他就绪通道上的等待者
+    if (woken) {
+        for (size_t i = 0; i < m_cases.size(); ++i) {
+            Case& c = m_cases[i];
+            if ((int)i == idx) {
+                continue;
+            }
+            if (c.dir == ChannelBase::RECV ? c.chan->readable() : c.chan->writable()) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                c.chan->notify(c.dir);
+            }
+        }
+    }
+    return idx;
+}
+
+}
@@ -0,0 +1,117 @@
+#include "../inc/fcontext.h"
+#include <stdint.h>
+#include <string.h>
+
+#if FANG_USE_FCONTEXT
+
+#if defined(__x86_64__)
+
+/**
+ * System V AMD64: 保存 rbp rbx r12-r15 以及 mxcsr/x87控制字
+ * 栈布局(由低到高): [mxcsr|fpucw] r12 r13 r14 r15 rbx rbp ret
+ */
+asm(R"(
+.text
+.globl fang_jump_fcontext
+.hidden fang_jump_fcontext
+.type fang_jump_fcontext,@function
+.align 16
+fang_jump_fcontext:
+    pushq %rbp
+    pushq %rbx
+    pushq %r15
+    pushq %r14
+    pushq %r13
+    pushq %r12
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r12
+    popq %r13
+    popq %r14
+    popq %r15
+    popq %rbx
+    popq %rbp
+    ret
+.size fang_jump_fcontext,.-fang_jump_fcontext
+)");
+
+namespace fang {
+
+void* MakeFContext(void* stack, size_t size, void (*fn)()) {
+    //ret后rsp需满足函数入口约定: (rsp + 8) % 16 == 0
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    uint64_t* sp = (uint64_t*)(top - 16);
+    sp[1] = 0;                  //入口函数的返回地址，入口函数不会返回
+    sp[0] = (uint64_t)fn;       //ret跳转地址
+    sp -= 7;
+    memset(sp, 0, 7 * sizeof(uint64_t));
+    uint32_t* fpu = (uint32_t*)sp;
+    fpu[0] = 0x1F80;            //mxcsr默认值
+    fpu[1] = 0x037F;            //x87控制字默认值
+    return sp;
+}
+
+}
+
+#elif defined(__aarch64__)
+
+/**
+ * AAPCS64: 保存 d8-d15 x19-x28 x29(fp) x30(lr)，共160字节
+ */
+asm(R"(
+.text
+.globl fang_jump_fcontext
+.hidden fang_jump_fcontext
+.type fang_jump_fcontext,%function
+.align 4
+fang_jump_fcontext:
+    sub sp, sp, #160
+    stp d8,  d9,  [sp, #0]
+    stp d10, d11, [sp, #16]
+    stp d12, d13, [sp, #32]
+    stp d14, d15, [sp, #48]
+    stp x19, x20, [sp, #64]
+    stp x21, x22, [sp, #80]
+    stp x23, x24, [sp, #96]
+    stp x25, x26, [sp, #112]
+    stp x27, x28, [sp, #128]
+    stp x29, x30, [sp, #144]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp d8,  d9,  [sp, #0]
+    ldp d10, d11, [sp, #16]
+    ldp d12, d13, [sp, #32]
+    ldp d14, d15, [sp, #48]
+    ldp x19, x20, [sp, #64]
+    ldp x21, x22, [sp, #80]
+    ldp x23, x24, [sp, #96]
+    ldp x25, x26, [sp, #112]
+    ldp x27, x28, [sp, #128]
+    ldp x29, x30, [sp, #144]
+    add sp, sp, #160
+    ret
+.size fang_jump_fcontext,.-fang_jump_fcontext
+)");
+
+namespace fang {
+
+void* MakeFContext(void* stack, size_t size, void (*fn)()) {
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    uint64_t* sp = (uint64_t*)(top - 160);
+    memset(sp, 0, 160);
+    sp[19] = (uint64_t)fn;      //x30(lr)，ret跳转地址
+    return sp;
+}
+
+}
+
+#endif
+
+#endif
@@ -13,9 +13,11 @@ FdCtx::FdCtx(int fd)
     , m_sysNonblock(false)
     , m_userNonblock(false)
     , m_isClose(false)
+    , m_generation(0)
     , m_fd(fd)
     , m_recvTimeout(-1)
-    , m_sendTimeout(-1) {
+    , m_sendTimeout(-1)
+    , m_pendingIo(0) {
         init();
 }
 
@@ -52,52 +54,62 @@ bool FdCtx::init() {
 
 void FdCtx::setTimeout(int type, uint64_t v) {
     if (type == SO_RCVTIMEO) {
-        m_recvTimeout = v;
+        m_recvTimeout.store(v, std::memory_order_relaxed);
     } else {
-        m_sendTimeout = v;
+        m_sendTimeout.store(v, std::memory_order_relaxed);
     }
 }
 
 uint64_t FdCtx::getTimeout(int type) {
     if (type == SO_RCVTIMEO) {
-        return m_recvTimeout;
+        return m_recvTimeout.load(std::memory_order_relaxed);
     } else {
-        return m_sendTimeout;
+        return m_sendTimeout.load(std::memory_order_relaxed);
     }
 }
 
 FdManager::FdManager() {
-    m_datas.resize(64);
 }
 
-FdCtx::ptr FdManager::get(int fd, bool auto_create) {
-    //读锁开启
-    RWMutex::RdLock lock(m_mutex);
-    if ((int)m_datas.size() <= fd) {
-        if (auto_create == false) {
-            return nullptr;
-        }
-    } else {
-        if (m_datas[fd] || !auto_create) {
-            return m_datas[fd];
-        }
+FdCtx* FdManager::get(int fd, bool auto_create) {
+    Slot* slot = m_slots.get(fd, auto_create);
+    if (!slot) {
+        return nullptr;
+    }
+    FdCtx* ctx = slot->ctx.load(std::memory_order_acquire);
+    if (ctx || !auto_create) {
+        return ctx;
     }
 
-    //读锁被关闭
-    lock.unlock();
-    //写锁被开启
-    RWMutex::WrLock _lock(m_mutex);
-    FdCtx::ptr fdctx(new FdCtx(fd));
-    m_datas[fd] = fdctx;
-    return  fdctx;
+    Mutex::Lock lock(m_mutex);
+    ctx = slot->ctx.load(std::memory_order_relaxed);
+    if (ctx) {
+        return ctx;
+    }
+    if (slot->storage) {
+        //关闭前取到它的协程可能还在读，原地重新初始化而不是释放，代数不变，旧协程比较代数发现已经关闭
+        ctx = slot->storage;
+        ctx->m_isInit = false;
+        ctx->init();
+    } else {
+        ctx = new FdCtx(fd);
+        slot->storage = ctx;
+    }
+    slot->ctx.store(ctx, std::memory_order_release);
+    return ctx;
 }
 
 void FdManager::del(int fd) {
-    //写锁开启
-    RWMutex::WrLock lock(m_mutex);
-    if ((int)m_datas.size() <= fd) {
+    Slot* slot = m_slots.get(fd);
+    if (!slot) {
         return ;
     }
-    m_datas[fd].reset();
+    Mutex::Lock lock(m_mutex);
+    FdCtx* ctx = slot->ctx.exchange(nullptr, std::memory_order_acq_rel);
+    if (ctx) {
+        //先标记关闭再加代数，看到新代数的协程一定也看到关闭
+        ctx->m_isClose.store(true, std::memory_order_release);
+        ctx->m_generation.fetch_add(1, std::memory_order_acq_rel);
+    }
 }
 }
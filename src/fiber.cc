@@ -1,10 +1,14 @@
 #include "../inc/fiber.h"
+#include "../inc/affinity.h"
 #include "../inc/log.h"
 #include "../inc/mydef.h"
 #include "../inc/scheduler.h"
 #include "../inc/config.h"
 #include <atomic>
+#include <vector>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <exception>
 
 #define DEFAULT_STACK_SIZE 1024 * 128
@@ -22,16 +26,257 @@ static std::atomic<uint64_t> s_fiber_count {0};
 static thread_local Fiber* t_fiber = nullptr;
 static thread_local Fiber::ptr t_threadfiber = nullptr;
 
+static fang::ConfigVar<uint32_t>::ptr g_fiber_stack_pool_size
+    = fang::Config::Lookup<uint32_t>("fiber.stack.pool_size", 64, "fiber stack free list size per thread");
+
+static fang::ConfigVar<uint32_t>::ptr g_fiber_stack_pool_hot
+    = fang::Config::Lookup<uint32_t>("fiber.stack.pool_hot", 16
+            , "free stacks per thread kept resident, the rest are madvise(DONTNEED)");
+
+static fang::ConfigVar<uint32_t>::ptr g_fiber_shared_stack_size
+    = fang::Config::Lookup<uint32_t>("fiber.shared_stack.size", 1024 * 1024, "fiber shared stack size");
+
+static fang::ConfigVar<uint32_t>::ptr g_fiber_shared_stack_count
+    = fang::Config::Lookup<uint32_t>("fiber.shared_stack.count", 4, "fiber shared stacks per thread");
+
+static fang::ConfigVar<uint32_t>::ptr g_fiber_stack_huge_page
+    = fang::Config::Lookup<uint32_t>("fiber.stack.huge_page", 0
+            , "fiber stack huge page mode, 0:none 1:THP(madvise) 2:MAP_HUGETLB");
+
+static uint32_t s_stack_size = 128 * 1024;
+static uint32_t s_stack_pool_size = 64;
+static uint32_t s_stack_pool_hot = 16;
+
+struct _FiberStackIniter {
+    _FiberStackIniter() {
+        s_stack_size = g_fiber_stack_size->getValue();
+        s_stack_pool_size = g_fiber_stack_pool_size->getValue();
+        s_stack_pool_hot = g_fiber_stack_pool_hot->getValue();
+        g_fiber_stack_size->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+                s_stack_size = new_value;
+        });
+        g_fiber_stack_pool_size->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+                s_stack_pool_size = new_value;
+        });
+        g_fiber_stack_pool_hot->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+                s_stack_pool_hot = new_value;
+        });
+    }
+};
+
+static _FiberStackIniter s_fiber_stack_initer;
+
+static std::atomic<uint64_t> s_stack_alloc_count {0};   //分配次数
+static std::atomic<uint64_t> s_stack_pool_hit {0};      //命中空闲栈的次数
+static std::atomic<uint64_t> s_stack_mapped {0};        //已映射的栈内存(字节)
+static std::atomic<uint64_t> s_stack_trimmed {0};       //空闲且已归还物理内存的栈(字节)
+static std::atomic<uint64_t> s_stack_pooled {0};        //空闲栈数量
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/**
+ * 线程的空闲栈链表，只缓存默认大小的栈
+ * hot中的栈保留物理内存，cold中的栈已经madvise(DONTNEED)
+ */
+struct StackPool {
+    std::vector<void*> hot;
+    std::vector<void*> cold;
+    size_t size = 0;
+
+    void clear();
+    ~StackPool();
+};
+
+static thread_local StackPool t_stack_pool;
+static thread_local bool t_stack_pool_alive = true;
+
+/**
+ * mmap分配协程栈，栈底(低地址)放一个PROT_NONE保护页，栈溢出时直接SIGSEGV而不是破坏堆
+ * MAP_HUGETLB模式按2M对齐分配，无法设置保护页
+ */
 struct StackAllocator {
+    static size_t PageSize() {
+        static size_t s_page_size = sysconf(_SC_PAGESIZE);
+        return s_page_size;
+    }
+
+    //大页模式在第一次分配时确定，保证释放时使用同样的方式
+    static uint32_t HugePageMode() {
+        static uint32_t s_mode = g_fiber_stack_huge_page->getValue();
+        return s_mode;
+    }
+
+    static size_t MapSize(size_t size) {
+        if (HugePageMode() == 2) {
+            return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        }
+        size_t page = PageSize();
+        return ((size + page - 1) & ~(page - 1)) + page;
+    }
+
+    static void* Map(size_t size) {
+        size_t len = MapSize(size);
+        if (HugePageMode() == 2) {
+            void* vp = mmap(nullptr, len, PROT_READ | PROT_WRITE
+                    , MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_HUGETLB, -1, 0);
+            if (vp == MAP_FAILED) {
+                FANG_LOG_ERROR(g_logger) << "mmap fiber stack size=" << len
+                    << " with MAP_HUGETLB error=" << strerror(errno);
+                return nullptr;
+            }
+            s_stack_mapped += len;
+            return vp;
+        }
+
+        void* base = mmap(nullptr, len, PROT_READ | PROT_WRITE
+                , MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (base == MAP_FAILED) {
+            FANG_LOG_ERROR(g_logger) << "mmap fiber stack size=" << len
+                << " error=" << strerror(errno);
+            return nullptr;
+        }
+        if (mprotect(base, PageSize(), PROT_NONE) != 0) {
+            FANG_LOG_ERROR(g_logger) << "mprotect fiber stack guard page error="
+                << strerror(errno);
+        }
+#ifdef MADV_HUGEPAGE
+        if (HugePageMode() == 1) {
+            madvise((char*)base + PageSize(), len - PageSize(), MADV_HUGEPAGE);
+        }
+#endif
+        //绑定了CPU的线程分配的栈放在本节点上，不受第一次访问它的线程影响
+        int node = GetThreadNumaNode();
+        if (node >= 0) {
+            BindToNumaNode((char*)base + PageSize(), len - PageSize(), node);
+        }
+        s_stack_mapped += len;
+        return (char*)base + PageSize();
+    }
+
+    static void Unmap(void* vp, size_t size) {
+        size_t len = MapSize(size);
+        void* base = HugePageMode() == 2 ? vp : (char*)vp - PageSize();
+        munmap(base, len);
+        s_stack_mapped -= len;
+    }
+
     static void* Alloc(size_t size) {
-        return malloc(size);
+        ++s_stack_alloc_count;
+        StackPool& pool = t_stack_pool;
+        if (t_stack_pool_alive && pool.size == size) {
+            void* vp = nullptr;
+            if (!pool.hot.empty()) {
+                vp = pool.hot.back();
+                pool.hot.pop_back();
+            } else if (!pool.cold.empty()) {
+                vp = pool.cold.back();
+                pool.cold.pop_back();
+                s_stack_trimmed -= MapSize(size);
+            }
+            if (vp) {
+                --s_stack_pooled;
+                ++s_stack_pool_hit;
+                return vp;
+            }
+        }
+        void* vp = Map(size);
+        FANG_ASSERT(vp);
+        return vp;
     }
 
     static void Dealloc(void* vp, size_t size) {
-        return free(vp);
+        StackPool& pool = t_stack_pool;
+        if (!t_stack_pool_alive || size != s_stack_size) {
+            Unmap(vp, size);
+            return;
+        }
+        if (pool.size != size) {
+            //默认栈大小被修改，释放旧的空闲栈
+            pool.clear();
+            pool.size = size;
+        }
+        if (pool.hot.size() + pool.cold.size() >= s_stack_pool_size) {
+            Unmap(vp, size);
+            return;
+        }
+        if (pool.hot.size() < s_stack_pool_hot) {
+            pool.hot.push_back(vp);
+        } else {
+            madvise(vp, size, MADV_DONTNEED);
+            pool.cold.push_back(vp);
+            s_stack_trimmed += MapSize(size);
+        }
+        ++s_stack_pooled;
+    }
+};
+
+void StackPool::clear() {
+    for (auto vp : hot) {
+        StackAllocator::Unmap(vp, size);
+    }
+    for (auto vp : cold) {
+        StackAllocator::Unmap(vp, size);
+    }
+    s_stack_pooled -= hot.size() + cold.size();
+    s_stack_trimmed -= cold.size() * StackAllocator::MapSize(size);
+    hot.clear();
+    cold.clear();
+}
+
+StackPool::~StackPool() {
+    clear();
+    t_stack_pool_alive = false;
+}
+
+/**
+ * 共享栈，同一时刻只有occupant的内容在栈上，其他绑定的协程切入前需要先把occupant的内容拷出
+ */
+struct SharedStack {
+    typedef std::shared_ptr<SharedStack> ptr;
+
+    SharedStack(size_t s)
+        :size(s) {
+        stack = StackAllocator::Map(size);
+        FANG_ASSERT(stack);
+        top = (char*)(((uintptr_t)stack + size) & ~(uintptr_t)15);
+    }
+
+    ~SharedStack() {
+        StackAllocator::Unmap(stack, size);
     }
+
+    void* stack = nullptr;
+    size_t size = 0;
+    char* top = nullptr;        //与MakeFContext相同的16字节对齐栈顶
+    Fiber* occupant = nullptr;  //当前栈上保存着内容的协程
 };
 
+static thread_local std::vector<SharedStack::ptr> t_shared_stacks;
+static thread_local size_t t_shared_stack_idx = 0;
+static thread_local int t_shared_stack_tid = -1;
+
+static SharedStack::ptr NextSharedStack() {
+    if (t_shared_stacks.empty()) {
+        size_t count = g_fiber_shared_stack_count->getValue();
+        size_t size = g_fiber_shared_stack_size->getValue();
+        for (size_t i = 0; i < (count ? count : 1); ++i) {
+            t_shared_stacks.push_back(SharedStack::ptr(new SharedStack(size)));
+        }
+        t_shared_stack_tid = fang::GetThreadId();
+    }
+    return t_shared_stacks[t_shared_stack_idx++ % t_shared_stacks.size()];
+}
+
+FiberStackStats Fiber::GetStackStats() {
+    FiberStackStats stats;
+    stats.allocs = s_stack_alloc_count;
+    stats.hits = s_stack_pool_hit;
+    stats.pooled = s_stack_pooled;
+    stats.mappedBytes = s_stack_mapped;
+    stats.residentBytes = stats.mappedBytes - s_stack_trimmed;
+    return stats;
+}
+
 void Fiber::SetThis(Fiber* f) {
     t_fiber = f;
 }
@@ -53,6 +298,82 @@ uint64_t Fiber::GetFiberId() {
     return 0;
 }
 
+/**
+* @Synopsis  协程局部变量槽的描述，只在程序启动时注册
+*/
+struct FiberLocalSlot {
+    void (*destroy)(void*) = nullptr;
+    void* (*clone)(const void*) = nullptr;
+    bool inherit = false;
+};
+
+static FiberLocalSlot s_local_slots[Fiber::MAX_LOCALS];
+static std::atomic<size_t> s_local_count {0};
+
+size_t Fiber::AllocLocalSlot(void (*destroy)(void*), void* (*clone)(const void*), bool inherit) {
+    size_t slot = s_local_count++;
+    FANG_ASSERT2(slot < MAX_LOCALS, "too many fiber local slots");
+    s_local_slots[slot].destroy = destroy;
+    s_local_slots[slot].clone = clone;
+    s_local_slots[slot].inherit = inherit;
+    return slot;
+}
+
+void* Fiber::GetLocal(size_t slot) {
+    Fiber* cur = t_fiber;
+    if (!cur || slot >= cur->m_locals.size()) {
+        return nullptr;
+    }
+    return cur->m_locals[slot];
+}
+
+void Fiber::SwapLocal(size_t slot, void*& value) {
+    Fiber* cur = t_fiber ? t_fiber : GetThis().get();
+    if (slot >= cur->m_locals.size()) {
+        if (!value) {
+            return;
+        }
+        cur->m_locals.resize(s_local_count, nullptr);
+    }
+    std::swap(cur->m_locals[slot], value);
+    if (s_local_slots[slot].inherit) {
+        if (cur->m_locals[slot]) {
+            cur->m_inheritMask |= 1ull << slot;
+        } else {
+            cur->m_inheritMask &= ~(1ull << slot);
+        }
+    }
+}
+
+bool Fiber::HasInheritableLocals() {
+    return t_fiber && t_fiber->m_inheritMask;
+}
+
+void Fiber::CloneInheritableLocals(std::vector<std::pair<size_t, void*> >& values) {
+    Fiber* cur = t_fiber;
+    if (!cur) {
+        return;
+    }
+    for (uint64_t mask = cur->m_inheritMask; mask; mask &= mask - 1) {
+        size_t slot = __builtin_ctzll(mask);
+        values.push_back(std::make_pair(slot, s_local_slots[slot].clone(cur->m_locals[slot])));
+    }
+}
+
+void Fiber::DestroyLocal(size_t slot, void* value) {
+    if (value) {
+        s_local_slots[slot].destroy(value);
+    }
+}
+
+void Fiber::clearLocals() {
+    for (size_t i = 0; i < m_locals.size(); ++i) {
+        DestroyLocal(i, m_locals[i]);
+    }
+    m_locals.clear();
+    m_inheritMask = 0;
+}
+
 uint64_t Fiber::GetTotalFibers() {
     return s_fiber_count;
 }
@@ -60,6 +381,8 @@ uint64_t Fiber::GetTotalFibers() {
 void Fiber::YieldToReady() {
     Fiber::ptr cur = GetThis();         //获取线程上的当前协程
     FANG_ASSERT(cur->m_state == EXEC);  //判断协程是否时执行状态
+    FANG_ASSERT2(cur.get() != Scheduler::GetMainFiber()
+            , "scheduler fiber cannot yield, TASK_INLINE task must not block");
     cur->m_state = READY;               //协程状态设置为ready
     cur->swapOut();                     //让出cpu
 }
@@ -68,52 +391,100 @@ void Fiber::YieldToHold() {
     //FANG_LOG_DEBUG(g_logger) << "DEBUG3 ---->";
     Fiber::ptr cur = GetThis();
     FANG_ASSERT(cur->m_state == EXEC);
+    FANG_ASSERT2(cur.get() != Scheduler::GetMainFiber()
+            , "scheduler fiber cannot yield, TASK_INLINE task must not block");
 
     //cur->m_state = HOLD;
     cur->swapOut();
 }
 
+void Fiber::initContext(void (*fn)()) {
+#if FANG_USE_FCONTEXT
+    m_ctx = MakeFContext(m_stack, m_stacksize, fn);
+#else
+    int ret = getcontext(&m_ctx);
+    if (ret != 0) {
+        FANG_LOG_ERROR(g_logger) << "getcontext error,"
+                            << "and error=" << strerror(errno);
+    }
+
+    m_ctx.uc_link = nullptr;
+    m_ctx.uc_stack.ss_sp = m_stack;
+    m_ctx.uc_stack.ss_size = m_stacksize;
+
+    makecontext(&m_ctx, fn, 0);
+#endif
+}
+
+void Fiber::SwapContext(Fiber* from, Fiber* to) {
+#if FANG_USE_FCONTEXT
+    fang_jump_fcontext(&from->m_ctx, to->m_ctx);
+#else
+    int ret = swapcontext(&from->m_ctx, &to->m_ctx);
+    if (ret != 0) {
+        FANG_LOG_ERROR(g_logger) << "swapcontext error, and error="
+                                << strerror(errno);
+    }
+#endif
+}
+
 //私有构造函数，用来构造线程的第一个协程
 Fiber::Fiber() {
     m_state = EXEC;
     SetThis(this);
+#if !FANG_USE_FCONTEXT
     int ret = getcontext(&m_ctx);
     if (ret != 0) {
         FANG_LOG_ERROR(g_logger) << "getContent error, and error=" 
                                 << strerror(errno);
     }
+#endif
     ++s_fiber_count;
     //FANG_LOG_DEBUG(g_logger) << "Fiber::Fiber() called";
 }
 
-Fiber::Fiber(std::function<void()> cb, 
-        size_t stacksize, bool use_caller)
+Fiber::Fiber(Task cb, 
+        size_t stacksize, bool use_caller, bool shared_stack)
     :m_id(++s_fiber_id)
-    ,m_cb(cb){
+    ,m_cb(std::move(cb)){
     ++s_fiber_count;
-    m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
+    //子协程复制创建者的可继承局部变量
+    Fiber* parent = t_fiber;
+    if (parent && parent->m_inheritMask) {
+        m_locals.resize(parent->m_locals.size(), nullptr);
+        for (uint64_t mask = parent->m_inheritMask; mask; mask &= mask - 1) {
+            size_t slot = __builtin_ctzll(mask);
+            m_locals[slot] = s_local_slots[slot].clone(parent->m_locals[slot]);
+        }
+        m_inheritMask = parent->m_inheritMask;
+    }
+#if FANG_USE_FCONTEXT
+    if (shared_stack && !use_caller) {
+        //共享栈在第一次切入时绑定
+        m_sharedMode = true;
+        return;
+    }
+#endif
+    m_stacksize = stacksize ? stacksize : s_stack_size;
     m_stack = StackAllocator::Alloc(m_stacksize);
     //m_stack = malloc(128);
-    int ret = getcontext(&m_ctx);
-    if (ret != 0) {
-        FANG_LOG_ERROR(g_logger) << "getcontext error,"
-                            << "and error=" << strerror(errno);
-    }
-
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
 
     if (!use_caller) {
-        makecontext(&m_ctx, &Fiber::RootMainFunc, 0);
+        initContext(&Fiber::RootMainFunc);
     } else {
-        makecontext(&m_ctx, &Fiber::CallerMainFunc, 0);
+        initContext(&Fiber::CallerMainFunc);
     }
 }
 
 Fiber::~Fiber() {
     --s_fiber_count;
-    if (m_stack) {
+    clearLocals();
+    if (m_sharedMode) {
+        if (m_sharedStack && m_sharedStack->occupant == this) {
+            m_sharedStack->occupant = nullptr;
+        }
+        free(m_saveBuf);
+    } else if (m_stack) {
         StackAllocator::Dealloc(m_stack, m_stacksize);
     } else {
         Fiber* cur = t_fiber;
@@ -123,70 +494,100 @@ Fiber::~Fiber() {
     }
 }
 
-void Fiber::reset(std::function<void()> cb) {
-    FANG_ASSERT(m_stack); //判断当前协程是否有函数执行栈，主协程没有函数栈
+void Fiber::reset(Task cb) {
+    FANG_ASSERT(m_stack || m_sharedMode); //判断当前协程是否有函数执行栈，主协程没有函数栈
     FANG_ASSERT(m_state == TREM
                 || m_state == INIT
                 || m_state == EXCEPT);  //判断当前协程的状态，如果时ready or exec 就不能进行reset
 
-    m_cb.swap(cb);
-    int ret = getcontext(&m_ctx);
-    if (ret != 0) {
-        FANG_LOG_ERROR(g_logger) << "getContent error, and error="
-                                << strerror(errno);
+    m_cb = std::move(cb);
+    //复用的协程不带上一个任务的局部变量
+    if (!m_locals.empty()) {
+        clearLocals();
+    }
+    if (m_sharedMode) {
+#if FANG_USE_FCONTEXT
+        //下次切入时在绑定的共享栈上重新构造上下文
+        if (m_sharedStack && m_sharedStack->occupant == this) {
+            m_sharedStack->occupant = nullptr;
+        }
+        m_ctx = nullptr;
+        m_saveSize = 0;
+#endif
+    } else {
+        initContext(&Fiber::RootMainFunc);
     }
+    m_state = INIT;
+}
 
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
+void Fiber::restoreSharedStack() {
+#if FANG_USE_FCONTEXT
+    if (!m_sharedStack) {
+        m_sharedStack = NextSharedStack();
+        m_boundThread = t_shared_stack_tid;
+    }
+    FANG_ASSERT(m_boundThread == t_shared_stack_tid);
 
-    makecontext(&m_ctx, &Fiber::RootMainFunc, 0);
-    m_state = INIT;
+    SharedStack* ss = m_sharedStack.get();
+    if (ss->occupant == this) {
+        return;
+    }
+    if (ss->occupant) {
+        ss->occupant->saveSharedStack();
+    }
+    ss->occupant = this;
+    if (!m_ctx) {
+        m_ctx = MakeFContext(ss->stack, ss->size, &Fiber::RootMainFunc);
+    } else {
+        memcpy(ss->top - m_saveSize, m_saveBuf, m_saveSize);
+    }
+#endif
+}
+
+void Fiber::saveSharedStack() {
+#if FANG_USE_FCONTEXT
+    if (m_state == TREM || m_state == EXCEPT || !m_ctx) {
+        return;
+    }
+    char* top = m_sharedStack->top;
+    m_saveSize = top - (char*)m_ctx;
+    if (m_saveSize > m_saveCap) {
+        m_saveCap = m_saveSize;
+        m_saveBuf = (char*)realloc(m_saveBuf, m_saveCap);
+    }
+    memcpy(m_saveBuf, m_ctx, m_saveSize);
+#endif
 }
 
 void Fiber::swapIn() {
     FANG_ASSERT(m_state != EXEC) //判断抢占cpu的协程是否是正在执行的协程
+    if (m_sharedMode) {
+        restoreSharedStack();
+    }
     m_state = EXEC; 
     SetThis(this);
     //将当前协程占有cpu执行任务，执行完后返回线程的主协程
     //FANG_LOG_DEBUG(g_logger) << "DEBUG_2" << "------>" << m_id;
-    int ret = swapcontext(&Scheduler::GetMainFiber()->m_ctx, &m_ctx);
+    SwapContext(Scheduler::GetMainFiber(), this);
     //FANG_LOG_DEBUG(g_logger) << "DEBUG_4" << "------>" << m_id;
-
-    if (ret != 0) {
-        FANG_LOG_ERROR(g_logger) << "swapcontext error, and error="
-                                << strerror(errno);
-    }
 }
 
 void Fiber::swapOut() {
     //FANG_ASSERT(m_state == EXEC) //判断让出cpu的协程是否正在执行的协程
     SetThis(Scheduler::GetMainFiber()); //让出cpu给线程的主协程
-    int ret = swapcontext(&m_ctx, &Scheduler::GetMainFiber()->m_ctx);
-    if (ret != 0) {
-        FANG_LOG_ERROR(g_logger) << "swapcontext error, and error="
-                                << strerror(errno);
-    }
+    SwapContext(this, Scheduler::GetMainFiber());
 }
 
 void Fiber::call() {
     SetThis(this);
     m_state = EXEC;
     // 从当前执行的协程中直接进入非主协程执行
-    int ret = swapcontext(&t_threadfiber->m_ctx, &m_ctx);
-    if (ret != 0) {
-        FANG_LOG_ERROR(g_logger) << "swapcontext error, and error="
-                                << strerror(errno);
-    }
+    SwapContext(t_threadfiber.get(), this);
 }
 
 void Fiber::back() {
     SetThis(t_fiber);
-    int ret = swapcontext(&m_ctx, &t_threadfiber->m_ctx);
-    if (ret != 0) {
-        FANG_LOG_ERROR(g_logger) << "swapcontext error, and error="
-                                << strerror(errno);
-    }
+    SwapContext(this, t_threadfiber.get());
 }
 
 void Fiber::RootMainFunc() {
@@ -203,6 +604,10 @@ void Fiber::RootMainFunc() {
             << ", Fiber_id=" << cur->getId();
             //<< std::endl
             //<< fang::BackTraceToString();
+    } catch (...) {
+        cur->m_state = EXCEPT;
+        FANG_LOG_ERROR(g_logger) << "Fiber Except: unknown exception"
+            << ", Fiber_id=" << cur->getId();
     }
 
     auto raw_ptr = cur.get();
@@ -224,6 +629,10 @@ void Fiber::CallerMainFunc(){
             << ", Fiber_id=" << cur->getId();
             //<< std::endl
             //<< fang::BackTraceToString(10);
+    } catch (...) {
+        cur->m_state = EXCEPT;
+        FANG_LOG_ERROR(g_logger) << "Fiber Except: unknown exception"
+            << ", Fiber_id=" << cur->getId();
     }
     auto raw_ptr = cur.get();
     cur.reset();
@@ -0,0 +1,44 @@
+#include "../inc/fiber_local.h"
+
+namespace fang {
+
+FiberLocalContext FiberLocalContext::Capture() {
+    FiberLocalContext ctx;
+    if (Fiber::HasInheritableLocals()) {
+        ctx.m_values.reset(new Values, ValuesDeleter());
+        Fiber::CloneInheritableLocals(*ctx.m_values);
+    }
+    return ctx;
+}
+
+void FiberLocalContext::ValuesDeleter::operator()(Values* values) const {
+    for (auto& i : *values) {
+        Fiber::DestroyLocal(i.first, i.second);
+    }
+    delete values;
+}
+
+Task FiberLocalContext::wrap(Task cb) const {
+    if (!m_values || !cb) {
+        return cb;
+    }
+    std::shared_ptr<Values> values = m_values;
+    std::shared_ptr<Task> task(new Task(std::move(cb)));
+    return [values, task]() {
+        //快照中的值换入当前协程，原来的值换到快照中，执行完再换回来
+        for (auto& i : *values) {
+            Fiber::SwapLocal(i.first, i.second);
+        }
+        struct Restore {
+            Values& values;
+            ~Restore() {
+                for (auto& i : values) {
+                    Fiber::SwapLocal(i.first, i.second);
+                }
+            }
+        } restore{*values};
+        (*task)();
+    };
+}
+
+}
@@ -0,0 +1,257 @@
+#include "../inc/fiber_sync.h"
+#include "../inc/cancel.h"
+#include "../inc/scheduler.h"
+#include "../inc/iomanager.h"
+#include "../inc/mydef.h"
+
+namespace fang {
+
+FiberWaitQueue::FiberWaitQueue()
+    :m_state(std::make_shared<State>()) {
+}
+
+bool FiberWaitQueue::wait(MutexType::Lock& lock, uint64_t timeout_ms, int type) {
+    Scheduler* scheduler = Scheduler::GetThis();
+    FANG_ASSERT2(scheduler, "fiber sync primitive used outside scheduler");
+
+    Waiter::ptr waiter(new Waiter);
+    waiter->scheduler = scheduler;
+    waiter->fiber = Fiber::GetThis();
+    waiter->type = type;
+    m_state->waiters.push_back(waiter);
+
+    //定时器回调已经被取出执行时cancel不会等它结束，回调不能访问this
+    std::weak_ptr<State> weak_state(m_state);
+    Timer::ptr timer;
+    if (timeout_ms != ~0ull) {
+        IoManager* iom = IoManager::GetThis();
+        FANG_ASSERT2(iom, "fiber sync timeout requires IoManager");
+        timer = iom->addTimer(timeout_ms, [weak_state, waiter]() {
+            Expire(weak_state, waiter);
+        });
+    }
+    lock.unlock();
+
+    //带超时的等待同时响应当前协程的取消令牌，取消时与超时一样返回false
+    CancelToken* token = timeout_ms != ~0ull ? CancelToken::GetCurrent() : nullptr;
+    uint64_t cancel_id = 0;
+    if (token) {
+        cancel_id = token->addCallback([weak_state, waiter]() {
+            Expire(weak_state, waiter);
+        });
+        if (!cancel_id) {
+            Expire(weak_state, waiter);
+        }
+    }
+
+    //唤醒者可能在挂起之前就重新调度了该协程，调度器会等到协程切出后再执行
+    Fiber::YieldToHold();
+
+    //被唤醒或取消时定时器还没有触发，删除它以免等到超时才释放
+    if (timer) {
+        timer->cancel();
+    }
+    if (token) {
+        token->removeCallback(cancel_id);
+    }
+    return !waiter->timeout;
+}
+
+void FiberWaitQueue::Expire(const std::weak_ptr<State>& weak_state, const Waiter::ptr& waiter) {
+    std::shared_ptr<State> state = weak_state.lock();
+    if (!state) {
+        return;
+    }
+    {
+        MutexType::Lock lock(state->mutex);
+        if (waiter->notified) {
+            return;
+        }
+        waiter->notified = true;
+        waiter->timeout = true;
+        state->waiters.remove(waiter);
+    }
+    Wake(waiter);
+}
+
+FiberWaitQueue::Waiter::ptr FiberWaitQueue::pop() {
+    if (m_state->waiters.empty()) {
+        return nullptr;
+    }
+    Waiter::ptr waiter = m_state->waiters.front();
+    m_state->waiters.pop_front();
+    waiter->notified = true;
+    return waiter;
+}
+
+void FiberWaitQueue::Wake(Waiter::ptr waiter) {
+    waiter->scheduler->schedul(waiter->fiber);
+}
+
+void FiberMutex::lock() {
+    lockFor(~0ull);
+}
+
+bool FiberMutex::lockFor(uint64_t timeout_ms) {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    if (!m_locked) {
+        m_locked = true;
+        return true;
+    }
+    //unlock时锁直接交给被唤醒的协程，醒来即持有锁
+    return m_queue.wait(lock, timeout_ms);
+}
+
+bool FiberMutex::tryLock() {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    if (m_locked) {
+        return false;
+    }
+    m_locked = true;
+    return true;
+}
+
+void FiberMutex::unlock() {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    FiberWaitQueue::Waiter::ptr waiter = m_queue.pop();
+    if (!waiter) {
+        m_locked = false;
+        return;
+    }
+    lock.unlock();
+    FiberWaitQueue::Wake(waiter);
+}
+
+void FiberCondition::wait(FiberMutex& mutex) {
+    waitFor(mutex, ~0ull);
+}
+
+bool FiberCondition::waitFor(FiberMutex& mutex, uint64_t timeout_ms) {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    //持有队列锁时释放mutex，notify不会在入队之前发生
+    mutex.unlock();
+    bool rt = m_queue.wait(lock, timeout_ms);
+    mutex.lock();
+    return rt;
+}
+
+void FiberCondition::notify() {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    FiberWaitQueue::Waiter::ptr waiter = m_queue.pop();
+    lock.unlock();
+    if (waiter) {
+        FiberWaitQueue::Wake(waiter);
+    }
+}
+
+void FiberCondition::notifyAll() {
+    std::list<FiberWaitQueue::Waiter::ptr> waiters;
+    {
+        FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+        while (FiberWaitQueue::Waiter::ptr waiter = m_queue.pop()) {
+            waiters.push_back(waiter);
+        }
+    }
+    for (auto& i : waiters) {
+        FiberWaitQueue::Wake(i);
+    }
+}
+
+FiberSemaphore::FiberSemaphore(size_t count)
+    :m_count(count) {
+}
+
+void FiberSemaphore::wait() {
+    waitFor(~0ull);
+}
+
+bool FiberSemaphore::waitFor(uint64_t timeout_ms) {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    if (m_count > 0) {
+        --m_count;
+        return true;
+    }
+    //post时计数直接交给被唤醒的协程
+    return m_queue.wait(lock, timeout_ms);
+}
+
+bool FiberSemaphore::tryWait() {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    if (m_count == 0) {
+        return false;
+    }
+    --m_count;
+    return true;
+}
+
+void FiberSemaphore::post() {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    FiberWaitQueue::Waiter::ptr waiter = m_queue.pop();
+    if (!waiter) {
+        ++m_count;
+        return;
+    }
+    lock.unlock();
+    FiberWaitQueue::Wake(waiter);
+}
+
+size_t FiberSemaphore::getCount() {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    return m_count;
+}
+
+void FiberRWMutex::rdlock() {
+    rdlockFor(~0ull);
+}
+
+void FiberRWMutex::wrlock() {
+    wrlockFor(~0ull);
+}
+
+bool FiberRWMutex::rdlockFor(uint64_t timeout_ms) {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    if (!m_writer && m_queue.empty()) {
+        ++m_readers;
+        return true;
+    }
+    return m_queue.wait(lock, timeout_ms, READ);
+}
+
+bool FiberRWMutex::wrlockFor(uint64_t timeout_ms) {
+    FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+    if (!m_writer && m_readers == 0) {
+        m_writer = true;
+        return true;
+    }
+    return m_queue.wait(lock, timeout_ms, WRITE);
+}
+
+void FiberRWMutex::unlock() {
+    std::list<FiberWaitQueue::Waiter::ptr> waiters;
+    {
+        FiberWaitQueue::MutexType::Lock lock(m_queue.mutex());
+        if (m_writer) {
+            m_writer = false;
+        } else if (m_readers > 0) {
+            --m_readers;
+        }
+        if (m_readers > 0) {
+            return;
+        }
+        //锁按队列顺序交接: 队首是写者则只唤醒它，否则唤醒连续的读者
+        if (m_queue.frontType() == WRITE) {
+            m_writer = true;
+            waiters.push_back(m_queue.pop());
+        } else {
+            while (m_queue.frontType() == READ) {
+                ++m_readers;
+                waiters.push_back(m_queue.pop());
+            }
+        }
+    }
+    for (auto& i : waiters) {
+        FiberWaitQueue::Wake(i);
+    }
+}
+
+}
@@ -0,0 +1,119 @@
+#include "../inc/future.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace fang {
+
+bool FutureStateBase::wait(uint64_t timeout_ms) {
+    if (isReady()) {
+        return true;
+    }
+    //不能挂起时用条件变量阻塞线程，由完成时的回调唤醒
+    if (!Scheduler::GetThis() || Fiber::GetThis().get() == Scheduler::GetMainFiber()) {
+        struct Waiter {
+            std::mutex mutex;
+            std::condition_variable cond;
+            bool done = false;
+        };
+        std::shared_ptr<Waiter> waiter(new Waiter);
+        addCallback([waiter]() {
+            std::lock_guard<std::mutex> lock(waiter->mutex);
+            waiter->done = true;
+            waiter->cond.notify_all();
+        });
+        std::unique_lock<std::mutex> lock(waiter->mutex);
+        if (timeout_ms == ~0ull) {
+            waiter->cond.wait(lock, [&waiter]() { return waiter->done; });
+            return true;
+        }
+        return waiter->cond.wait_for(lock, std::chrono::milliseconds(timeout_ms)
+                , [&waiter]() { return waiter->done; });
+    }
+
+    MutexType::Lock lock(m_queue.mutex());
+    if (isReady()) {
+        return true;
+    }
+    return m_queue.wait(lock, timeout_ms);
+}
+
+void FutureStateBase::addCallback(Task cb, Scheduler* scheduler) {
+    Callback callback{std::move(cb), scheduler};
+    {
+        MutexType::Lock lock(m_queue.mutex());
+        if (!isReady()) {
+            m_callbacks.push_back(std::move(callback));
+            return;
+        }
+    }
+    Dispatch(callback);
+}
+
+bool FutureStateBase::setException(std::exception_ptr error) {
+    if (!claim()) {
+        return false;
+    }
+    m_error = error;
+    markReady();
+    return true;
+}
+
+void FutureStateBase::markReady() {
+    std::vector<FiberWaitQueue::Waiter::ptr> waiters;
+    std::vector<Callback> callbacks;
+    {
+        MutexType::Lock lock(m_queue.mutex());
+        m_ready.store(true, std::memory_order_release);
+        while (FiberWaitQueue::Waiter::ptr waiter = m_queue.pop()) {
+            waiters.push_back(waiter);
+        }
+        callbacks.swap(m_callbacks);
+    }
+    for (auto& i : waiters) {
+        FiberWaitQueue::Wake(i);
+    }
+    for (auto& i : callbacks) {
+        Dispatch(i);
+    }
+}
+
+void FutureStateBase::Dispatch(Callback& cb) {
+    if (cb.scheduler) {
+        cb.scheduler->schedul(std::move(cb.cb));
+    } else {
+        cb.cb();
+    }
+}
+
+Future<void> WhenAll(const std::vector<FutureStateBase::ptr>& states) {
+    Promise<void> promise;
+    Future<void> rt = promise.getFuture();
+    if (states.empty()) {
+        promise.setValue();
+        return rt;
+    }
+    std::shared_ptr<std::atomic<size_t> > left(new std::atomic<size_t>(states.size()));
+    for (auto& i : states) {
+        i->addCallback([promise, left]() mutable {
+            if (left->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                promise.setValue();
+            }
+        });
+    }
+    return rt;
+}
+
+Future<size_t> WhenAny(const std::vector<FutureStateBase::ptr>& states) {
+    Promise<size_t> promise;
+    Future<size_t> rt = promise.getFuture();
+    for (size_t i = 0; i < states.size(); ++i) {
+        //只有第一个完成的能设置结果，其余的setValue返回false
+        states[i]->addCallback([promise, i]() mutable {
+            promise.setValue(i);
+        });
+    }
+    return rt;
+}
+
+}
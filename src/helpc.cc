@@ -19,6 +19,7 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <signal.h>
+#include <time.h>
 namespace fang
 {
 fang::Logger::ptr g_logger = FANG_LOG_NAME("system");
@@ -30,7 +31,19 @@ uint64_t GetFiberId() { return Fiber::GetFiberId(); }
 uint64_t GetCurrentMS() {
     struct timeval tv;
     gettimeofday(&tv, nullptr);
-    return tv.tv_sec * 1000 * 1000ul + tv.tv_usec;
+    return tv.tv_sec * 1000ul + tv.tv_usec / 1000;
+}
+
+uint64_t GetMonotonicMS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+}
+
+uint64_t GetMonotonicUS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
 }
 
 void BackTrace(std::vector<std::string> &bt, int size, int skip)
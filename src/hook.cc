@@ -1,15 +1,29 @@
 #include "../inc/hook.h"
+#include "../inc/cancel.h"
+#include "../inc/iomanager.h"
+#include "../inc/io_uring.h"
+#include "../inc/config.h"
+#include "../inc/log.h"
+#include <algorithm>
+#include <atomic>
 #include <dlfcn.h>
 #include <iostream>
+#include <poll.h>
 #include <stdarg.h>
 
+static fang::Logger::ptr g_logger = FANG_LOG_NAME("system");
+
 namespace fang{
 
+static fang::ConfigVar<int>::ptr g_tcp_connect_timeout
+    = fang::Config::Lookup("tcp.connect.timeout", 5000, "tcp connect timeout");
+
 static thread_local bool t_hook_enable = false;
 
 #define HOOK_FUN()\
     DEF_XX(sleep)\
     DEF_XX(usleep)\
+    DEF_XX(nanosleep)\
     DEF_XX(socket)\
     DEF_XX(connect)\
     DEF_XX(accept)\
@@ -37,8 +51,11 @@ void hook_init() {
 #define DEF_XX(name) name##_f = (name##_fun)dlsym(RTLD_NEXT, #name);
     HOOK_FUN();
 #undef DEF_XX
+    is_inited = true;
 }
 
+static uint64_t s_connect_timeout = -1;
+
 bool is_hook_enable(){
     return t_hook_enable;
 }
@@ -50,6 +67,12 @@ void set_hook_enable(bool flag) {
 struct _HookIniter {
     _HookIniter() {
         hook_init();
+        s_connect_timeout = g_tcp_connect_timeout->getValue();
+        g_tcp_connect_timeout->addListener([](const int& old_value, const int& new_value){
+                FANG_LOG_INFO(g_logger) << "tcp connect timeout changed from "
+                                        << old_value << " to " << new_value;
+                s_connect_timeout = new_value;
+        });
     }
 };
 
@@ -59,46 +82,222 @@ static _HookIniter s_hook_initer;
 }
 
 
+/**
+ * @Synopsis  当前线程的errno
+ *            __errno_location声明为const，编译器可以把它的结果跨过协程切换复用，
+ *            而协程可能在其他线程恢复，挂起之后的errno通过volatile函数指针访问
+ */
+static int* (* volatile s_errno_location)() = &__errno_location;
+static inline int& hook_errno() {
+    return *s_errno_location();
+}
+
 struct timer_info {
-    int cancelled =0;
+    //被超时或令牌取消时记录错误码，定时器和令牌回调可能在不同线程同时触发，先设置的一方取消事件
+    std::atomic<int> cancelled{0};
+
+    bool claim(int err) {
+        int expected = 0;
+        return cancelled.compare_exchange_strong(expected, err);
+    }
 };
 
+/**
+ * @Synopsis  等待fd上的事件，超时时间由条件定时器取消事件
+ *
+ * @Returns   事件就绪返回0，超时返回-1并设置errno为ETIMEDOUT，
+ *            当前协程的令牌取消时返回-1并设置errno为令牌的错误码，
+ *            fd在等待期间被关闭(ctx的代数不再是gen)返回-1并设置errno为EBADF，添加事件失败返回-1
+ */
+static int wait_event(fang::IoManager* iom, fang::FdCtx* ctx, uint32_t gen, int fd,
+        fang::IoManager::Event event, uint64_t timeout_ms, const char* hook_fun_name) {
+    //协程的令牌已经取消(请求超过截止时间)时不再等待
+    fang::CancelToken* token = fang::CancelToken::GetCurrent();
+    if (token && token->isCancelled()) {
+        hook_errno() = token->getError();
+        return -1;
+    }
+    if (iom->canSubmitIo()) {
+        //ring上的操作不能由令牌唤醒，等待时间不超过截止时间
+        if (token) {
+            timeout_ms = std::min(timeout_ms, token->getRemainingMs());
+        }
+        //io_uring后端用一次性的poll等待，不需要epoll_ctl和定时器
+        ctx->addPendingIo(1);
+        int res = iom->submitIo([fd, event](io_uring_sqe* sqe) {
+            fang::IoUring::PrepRw(sqe, IORING_OP_POLL_ADD, fd, nullptr, 0, 0);
+            sqe->poll32_events = event == fang::IoManager::READ ? POLLIN : POLLOUT;
+        }, timeout_ms);
+        ctx->addPendingIo(-1);
+        if (res < 0) {
+            hook_errno() = -res;
+            return -1;
+        }
+        return 0;
+    }
+
+    std::shared_ptr<timer_info> tinfo(new timer_info);
+    std::weak_ptr<timer_info> winfo(tinfo);
+    fang::Timer::ptr timer;
+    if (timeout_ms != (uint64_t)-1) {
+        timer = iom->addConditionTimer(timeout_ms, [winfo, fd, iom, event]() {
+            auto t = winfo.lock();
+            if (!t || !t->claim(ETIMEDOUT)) {
+                return;
+            }
+            iom->cancelEvent(fd, event);
+        }, winfo);
+    }
+
+    int rt = iom->addEvent(fd, event);
+    if (rt) {
+        FANG_LOG_ERROR(g_logger) << hook_fun_name << " addEvent("
+            << fd << ", " << event << ") error";
+        if (timer) {
+            timer->cancel();
+        }
+        return -1;
+    }
+    //close在addEvent之前唤醒过等待者时不会再唤醒本协程，这里自己取消并解除注册
+    //fd关闭后可能已经被其他线程复用，isClose()又为false，只能比较代数
+    if (ctx->getGeneration() != gen) {
+        iom->cancelAll(fd);
+    }
+
+    //令牌取消时像超时一样取消事件，所有等待共用令牌的一个定时器
+    uint64_t cancel_id = 0;
+    if (token) {
+        timer_info* t = tinfo.get();
+        cancel_id = token->addCallback([t, fd, iom, event, token]() {
+            if (t->claim(token->getError())) {
+                iom->cancelEvent(fd, event);
+            }
+        });
+        if (!cancel_id && tinfo->claim(token->getError())) {
+            iom->cancelEvent(fd, event);
+        }
+    }
+
+    fang::Fiber::YieldToHold();
+    if (timer) {
+        timer->cancel();
+    }
+    //删除后回调不会再执行，tinfo可以安全释放
+    if (token) {
+        token->removeCallback(cancel_id);
+    }
+    int err = tinfo->cancelled.load();
+    if (err) {
+        hook_errno() = err;
+        return -1;
+    }
+    //被close唤醒，fd可能已经属于另一个文件，不能再重试
+    if (ctx->getGeneration() != gen) {
+        hook_errno() = EBADF;
+        return -1;
+    }
+    return 0;
+}
+
 
-template <typename OriginFun, typename... Args>
+/**
+ * @Synopsis  io_uring后端直接把操作提交到ring，协程在操作完成后恢复
+ *
+ * @Returns   不能提交时返回false，由调用者等待事件后重试
+ */
+template <typename Prep>
+static bool submit_io(fang::IoManager* iom, fang::FdCtx* ctx, Prep& prep,
+        uint64_t timeout_ms, ssize_t& n) {
+    if (!iom->canSubmitIo()) {
+        return false;
+    }
+    fang::CancelToken* token = fang::CancelToken::GetCurrent();
+    if (token) {
+        if (token->isCancelled()) {
+            hook_errno() = token->getError();
+            n = -1;
+            return true;
+        }
+        timeout_ms = std::min(timeout_ms, token->getRemainingMs());
+    }
+    ctx->addPendingIo(1);
+    int res = iom->submitIo(prep, timeout_ms);
+    ctx->addPendingIo(-1);
+    if (res < 0) {
+        hook_errno() = -res;
+        n = -1;
+    } else {
+        n = res;
+    }
+    return true;
+}
+
+//没有对应io_uring操作的函数(recvfrom/sendto)只用ring等待就绪
+static bool submit_io(fang::IoManager*, fang::FdCtx*, std::nullptr_t,
+        uint64_t, ssize_t&) {
+    return false;
+}
+
+template <typename OriginFun, typename Prep, typename... Args>
 static ssize_t do_io(int fd, OriginFun fun, const char * hook_fun_name,
-        uint32_t event, int timeout_so, Args&&... args) {
+        uint32_t event, int timeout_so, Prep prep, Args&&... args) {
     
     if (!fang::t_hook_enable) {//线程没有开启hook，就执行本来的函数
         return fun(fd, std::forward<Args>(args)...);
     }
 
-    fang::FdCtx::ptr ctx = fang::FdMgr::GetInstance()->get(fd);//从io列表中获取fd的数据
+    fang::FdCtx* ctx = fang::FdMgr::GetInstance()->get(fd);//从io列表中获取fd的数据
 
     if (!ctx) {
         return fun(fd, std::forward<Args>(args)...);
     }
 
-    if (ctx->isClose()) {
-        errno = EBADF;
-        return -1;
-    }
-
     if (!ctx->isSocket() || ctx->getUserNonblock()) {
         return fun(fd, std::forward<Args>(args)...);
     }
 
     uint64_t to = ctx->getTimeout(timeout_so);
-    std::shared_ptr<timer_info> tinfo(new timer_info);
-
-    ssize_t n = fun(fd, std::forward<Args>(args)...);
-    while(n == -1 && errno == EINTR) {
-        n = fun(fd, std::forward<Args>(args)...);
+    fang::IoManager* iom = fang::IoManager::GetThis();
+    uint32_t gen = ctx->getGeneration();
+
+    while (true) {
+        //被close唤醒后不再重试，ctx被复用时isClose()为false，需要比较代数
+        if (ctx->isClose() || ctx->getGeneration() != gen) {
+            hook_errno() = EBADF;
+            return -1;
+        }
+        ssize_t n = fun(fd, args...);
+        while(n == -1 && hook_errno() == EINTR) {
+            n = fun(fd, args...);
+        }
+        if (n != -1 || hook_errno() != EAGAIN || !iom) {
+            return n;
+        }
+        if (submit_io(iom, ctx, prep, to, n)) {
+            return n;
+        }
+        //返回错误设置为重试，说明io还没有数据可操作，故进行异步处理，把该io任务添加到任务列表，然后让出cpu去执行其他任务
+        //事件就绪或者被cancelEvent/cancelAll唤醒后重新尝试
+        if (wait_event(iom, ctx, gen, fd, (fang::IoManager::Event)event, to, hook_fun_name)) {
+            return -1;
+        }
     }
-    if (n == -1 && errno == EAGAIN) {//返回错误设置为重试，说明io还没有数据可操作，故进行异步处理，把该io任务添加到任务列表，然后让出cpu去执行其他任务
-        //do somethings;
-        return to;
+}
+
+/**
+ * @Synopsis  挂起当前协程，由定时器重新调度
+ */
+static bool sleep_fiber(uint64_t ms) {
+    fang::IoManager* iom = fang::IoManager::GetThis();
+    if (!iom) {
+        return false;
     }
-    return 0;
+    fang::Fiber::ptr fiber = fang::Fiber::GetThis();
+    iom->addTimer(ms, [iom, fiber]() {
+        iom->schedul(fiber);
+    });
+    fang::Fiber::YieldToHold();
+    return true;
 }
 
 extern "C" {
@@ -112,7 +311,9 @@ unsigned int sleep(unsigned int seconds) {
         return sleep_f(seconds);
     }
 
-    std::cout <<"sleep running!" <<std::endl;
+    if (!sleep_fiber(seconds * 1000ull)) {
+        return sleep_f(seconds);
+    }
     return 0;
 
 }
@@ -122,7 +323,21 @@ int usleep(useconds_t usec) {
         return usleep_f(usec);
     }
 
-    std::cout << "usleep running!" <<std::endl;
+    if (!sleep_fiber(usec / 1000)) {
+        return usleep_f(usec);
+    }
+    return 0;
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+    if (!fang::t_hook_enable) {
+        return nanosleep_f(req, rem);
+    }
+
+    uint64_t ms = req->tv_sec * 1000ull + req->tv_nsec / 1000000;
+    if (!sleep_fiber(ms)) {
+        return nanosleep_f(req, rem);
+    }
     return 0;
 }
         
@@ -145,9 +360,9 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         return connect_f(fd, addr, addrlen);
     }
 
-    fang::FdCtx::ptr ctx = fang::FdMgr::GetInstance()->get(fd);
+    fang::FdCtx* ctx = fang::FdMgr::GetInstance()->get(fd);
     if (!ctx || ctx->isClose()) {
-        errno = EBADF;
+        hook_errno() = EBADF;
         return -1;
     }
     if (!ctx->isSocket()) {
@@ -157,78 +372,138 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     if (ctx->getUserNonblock()) {
         return connect_f(fd, addr, addrlen);
     }
+    uint32_t gen = ctx->getGeneration();
     int n = connect_f(fd, addr, addrlen);
     if (n == 0) {
         return 0;
-    } else if (n != -1 || errno != EINPROGRESS) {
+    } else if (n != -1 || hook_errno() != EINPROGRESS) {
         return n;
     }
 
-    //dosthing
-    return n;
+    fang::IoManager* iom = fang::IoManager::GetThis();
+    if (!iom) {
+        return n;
+    }
+    //连接完成时fd可写，超时由定时器取消写事件
+    //超时或者令牌取消时连接可能还没有完成，不能再用SO_ERROR判断
+    if (wait_event(iom, ctx, gen, fd, fang::IoManager::WRITE, timeout_ms, "connect")
+            && (hook_errno() == ETIMEDOUT || hook_errno() == ECANCELED
+                || hook_errno() == EBADF)) {
+        return -1;
+    }
 
+    int error = 0;
+    socklen_t len = sizeof(int);
+    if (-1 == getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len)) {
+        return -1;
+    }
+    if (!error) {
+        return 0;
+    }
+    hook_errno() = error;
+    return -1;
 }
+
 int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
-    return connect_f(sockfd, addr, addrlen);
+    return connect_with_timeout(sockfd, addr, addrlen, fang::s_connect_timeout);
 }
 
 int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
-    int fd = do_io(sockfd, accept_f, "accept", 0, SO_RCVTIMEO, addr, addrlen);
-    if (fd > 0) {
-        fang::FdMgr::GetInstance()->get(fd);
+    int fd = do_io(sockfd, accept_f, "accept", fang::IoManager::READ, SO_RCVTIMEO,
+            [=](io_uring_sqe* sqe) {
+                fang::IoUring::PrepRw(sqe, IORING_OP_ACCEPT, sockfd, addr, 0, (uintptr_t)addrlen);
+            }, addr, addrlen);
+    if (fd >= 0) {
+        fang::FdMgr::GetInstance()->get(fd, true);
     }
     return fd;
 }
 
 ssize_t read(int fd, void *buf, size_t count) {
-    return do_io(fd, read_f, "read", 0, SO_RCVTIMEO, buf, count);
+    return do_io(fd, read_f, "read", fang::IoManager::READ, SO_RCVTIMEO,
+            [=](io_uring_sqe* sqe) {
+                fang::IoUring::PrepRw(sqe, IORING_OP_READ, fd, buf, count, -1);
+            }, buf, count);
 }
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
-    return do_io(fd, readv_f, "readv", 0, SO_RCVTIMEO, iov, iovcnt);
+    return do_io(fd, readv_f, "readv", fang::IoManager::READ, SO_RCVTIMEO,
+            [=](io_uring_sqe* sqe) {
+                fang::IoUring::PrepRw(sqe, IORING_OP_READV, fd, iov, iovcnt, -1);
+            }, iov, iovcnt);
 }
 
 ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
-    return do_io(sockfd, recv_f, "recv", 0, SO_RCVTIMEO, buf, len, flags);
+    return do_io(sockfd, recv_f, "recv", fang::IoManager::READ, SO_RCVTIMEO,
+            [=](io_uring_sqe* sqe) {
+                fang::IoUring::PrepRw(sqe, IORING_OP_RECV, sockfd, buf, len, 0);
+                sqe->msg_flags = flags;
+            }, buf, len, flags);
 }
 
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen) {
-    return do_io(sockfd, recvfrom_f, "recvfrom", 0, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);
+    return do_io(sockfd, recvfrom_f, "recvfrom", fang::IoManager::READ, SO_RCVTIMEO,
+            nullptr, buf, len, flags, src_addr, addrlen);
 }
 
-ssize_t recvms(int sockfd, struct msghdr *msg, int flags) {
-    return do_io(sockfd, recvmsg_f, "recvmsg", 0, SO_RCVTIMEO, msg, flags);
+ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
+    return do_io(sockfd, recvmsg_f, "recvmsg", fang::IoManager::READ, SO_RCVTIMEO,
+            [=](io_uring_sqe* sqe) {
+                fang::IoUring::PrepRw(sqe, IORING_OP_RECVMSG, sockfd, msg, 1, 0);
+                sqe->msg_flags = flags;
+            }, msg, flags);
 }
 
 ssize_t write(int fd, const void *buf, size_t count) {
-    return do_io(fd, write_f, "write", 1, SO_SNDTIMEO, buf, count);
+    return do_io(fd, write_f, "write", fang::IoManager::WRITE, SO_SNDTIMEO,
+            [=](io_uring_sqe* sqe) {
+                fang::IoUring::PrepRw(sqe, IORING_OP_WRITE, fd, buf, count, -1);
+            }, buf, count);
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
-    return do_io(fd, writev_f, "writev", 1, SO_SNDTIMEO, iov, iovcnt);
+    return do_io(fd, writev_f, "writev", fang::IoManager::WRITE, SO_SNDTIMEO,
+            [=](io_uring_sqe* sqe) {
+                fang::IoUring::PrepRw(sqe, IORING_OP_WRITEV, fd, iov, iovcnt, -1);
+            }, iov, iovcnt);
 }
 
 ssize_t send(int sockfd, const void *buf, size_t len, int flags) {
-    return do_io(sockfd, send_f, "send", 1, SO_SNDTIMEO,  buf, len, flags);
+    return do_io(sockfd, send_f, "send", fang::IoManager::WRITE, SO_SNDTIMEO,
+            [=](io_uring_sqe* sqe) {
+                fang::IoUring::PrepRw(sqe, IORING_OP_SEND, sockfd, buf, len, 0);
+                sqe->msg_flags = flags;
+            }, buf, len, flags);
 }
 
 ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen) {
-    return do_io(sockfd, sendto_f, "sendto", 1, SO_SNDTIMEO, buf, len, flags, dest_addr, addrlen);
+    return do_io(sockfd, sendto_f, "sendto", fang::IoManager::WRITE, SO_SNDTIMEO,
+            nullptr, buf, len, flags, dest_addr, addrlen);
 }
 
 ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags) {
-    return do_io(sockfd, sendmsg_f, "sendmsg", 1, SO_SNDTIMEO, msg, flags);
+    return do_io(sockfd, sendmsg_f, "sendmsg", fang::IoManager::WRITE, SO_SNDTIMEO,
+            [=](io_uring_sqe* sqe) {
+                fang::IoUring::PrepRw(sqe, IORING_OP_SENDMSG, sockfd, msg, 1, 0);
+                sqe->msg_flags = flags;
+            }, msg, flags);
 }
 
 int close(int fd) {
+    //fd一直注册在epoll中，没有开启hook的线程关闭时也要解除，否则复用该fd时收不到事件
     if (!fang::t_hook_enable) {
+        fang::IoManager::CloseFd(fd);
         return close_f(fd);
     }
-    fang::FdCtx::ptr ctx = fang::FdMgr::GetInstance()->get(fd);
+    fang::FdCtx* ctx = fang::FdMgr::GetInstance()->get(fd);
     if (ctx) {
-        //do somethings
-
+        //先标记关闭，再唤醒还在等待该fd的协程，它们醒来后得到EBADF
         fang::FdMgr::GetInstance()->del(fd);
+        fang::IoManager::CloseFd(fd);
+        //io_uring上的操作持有文件引用，close不会让它们结束，先shutdown
+        if (ctx->getPendingIo() > 0 && ctx->isSocket()) {
+            shutdown(fd, SHUT_RDWR);
+        }
     }
     return close_f(fd);
 }
@@ -242,7 +517,7 @@ int fcntl(int fd, int cmd, ...) {
             {
                 int arg =  va_arg(va, int);
                 va_end(va);
-                fang::FdCtx::ptr ctx = fang::FdMgr::GetInstance()->get(fd);//查找io任务
+                fang::FdCtx* ctx = fang::FdMgr::GetInstance()->get(fd);//查找io任务
                 if (!ctx || ctx->isClose() || !ctx->isSocket()) {
                     return fcntl_f(fd, cmd, arg);
                 }
@@ -260,7 +535,7 @@ int fcntl(int fd, int cmd, ...) {
             {
                 va_end(va);
                 int arg = fcntl_f(fd, cmd);
-                fang::FdCtx::ptr ctx = fang::FdMgr::GetInstance()->get(fd);
+                fang::FdCtx* ctx = fang::FdMgr::GetInstance()->get(fd);
                 if (!ctx || ctx->isClose() ||!ctx->isSocket()) {
                     return arg;
                 }
@@ -327,7 +602,7 @@ int ioctl(int fd, unsigned long request, ...) {
 
     if (FIONBIO == request) {
         bool user_nonblock = !!*(int *)arg;
-        fang::FdCtx::ptr ctx = fang::FdMgr::GetInstance()->get(fd);
+        fang::FdCtx* ctx = fang::FdMgr::GetInstance()->get(fd);
         if (!ctx || ctx->isClose() ||!ctx->isSocket()) {
             return ioctl_f(fd, request, arg);
         }
@@ -344,11 +619,11 @@ int getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *optl
 
 int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen) {
     if (!fang::t_hook_enable) {
-        setsockopt_f(sockfd, level, optname, optval, optlen);
+        return setsockopt_f(sockfd, level, optname, optval, optlen);
     }
     if (level == SOL_SOCKET) {
         if (optname == SO_RCVTIMEO || optname == SO_SNDTIMEO) {
-            fang::FdCtx::ptr ctx = fang::FdMgr::GetInstance()->get(sockfd);
+            fang::FdCtx* ctx = fang::FdMgr::GetInstance()->get(sockfd);
             if (ctx) {
                 const struct timeval *v = (const timeval*)optval;
                 ctx->setTimeout(optname, v->tv_usec / 1000 +v->tv_sec * 1000);
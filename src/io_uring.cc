@@ -0,0 +1,160 @@
+#include "../inc/io_uring.h"
+#include "../inc/log.h"
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fang {
+
+static fang::Logger::ptr g_logger = FANG_LOG_NAME("system");
+
+static int io_uring_setup(unsigned entries, io_uring_params* p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete
+        , unsigned flags, void* arg, size_t argsz) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+bool IoUring::IsSupported() {
+    static int s_supported = -1;
+    if (s_supported == -1) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        int fd = io_uring_setup(2, &p);
+        s_supported = fd != -1 && (p.features & IORING_FEAT_EXT_ARG)
+            && (p.features & IORING_FEAT_SINGLE_MMAP);
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    return s_supported;
+}
+
+IoUring::IoUring(unsigned entries)
+    :m_fd(-1)
+    ,m_flags(0)
+    ,m_sqeTail(0)
+    ,m_sqes((io_uring_sqe*)MAP_FAILED)
+    ,m_ring(MAP_FAILED) {
+    //只由创建它的线程使用，完成事件推迟到io_uring_enter时处理，避免打断正在运行的线程
+    //老内核不支持时依次降级
+    static const unsigned s_flags[] = {
+#if defined(IORING_SETUP_SINGLE_ISSUER) && defined(IORING_SETUP_DEFER_TASKRUN)
+        IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+#endif
+#ifdef IORING_SETUP_COOP_TASKRUN
+        IORING_SETUP_COOP_TASKRUN,
+#endif
+        0
+    };
+    io_uring_params p;
+    for (auto flags : s_flags) {
+        memset(&p, 0, sizeof(p));
+        p.flags = flags;
+        m_fd = io_uring_setup(entries, &p);
+        if (m_fd != -1 || errno != EINVAL) {
+            m_flags = flags;
+            break;
+        }
+    }
+    if (m_fd == -1) {
+        FANG_LOG_ERROR(g_logger) << "io_uring_setup(" << entries << ") errno="
+            << errno << " errstr=" << strerror(errno);
+        return;
+    }
+
+    //IORING_FEAT_SINGLE_MMAP: 提交队列和完成队列共用一次映射
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    m_ringSize = sq_size > cq_size ? sq_size : cq_size;
+    m_ring = mmap(nullptr, m_ringSize, PROT_READ | PROT_WRITE
+            , MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe*)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE
+            , MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (m_ring == MAP_FAILED || m_sqes == MAP_FAILED) {
+        FANG_LOG_ERROR(g_logger) << "io_uring mmap errno=" << errno
+            << " errstr=" << strerror(errno);
+        close(m_fd);
+        m_fd = -1;
+        return;
+    }
+
+    char* ring = (char*)m_ring;
+    m_sqEntries = p.sq_entries;
+    m_sqMask = *(unsigned*)(ring + p.sq_off.ring_mask);
+    m_sqHead = (unsigned*)(ring + p.sq_off.head);
+    m_sqTail = (unsigned*)(ring + p.sq_off.tail);
+    m_sqArray = (unsigned*)(ring + p.sq_off.array);
+    m_cqMask = *(unsigned*)(ring + p.cq_off.ring_mask);
+    m_cqHead = (unsigned*)(ring + p.cq_off.head);
+    m_cqTail = (unsigned*)(ring + p.cq_off.tail);
+    m_cqes = (io_uring_cqe*)(ring + p.cq_off.cqes);
+    m_sqeTail = *m_sqTail;
+}
+
+IoUring::~IoUring() {
+    if (m_sqes != MAP_FAILED) {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if (m_ring != MAP_FAILED) {
+        munmap(m_ring, m_ringSize);
+    }
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+io_uring_sqe* IoUring::getSqe() {
+    if (getSpace() == 0) {
+        return nullptr;
+    }
+    unsigned idx = m_sqeTail & m_sqMask;
+    io_uring_sqe* sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[idx] = idx;
+    ++m_sqeTail;
+    return sqe;
+}
+
+int IoUring::submit(uint64_t wait_ms) {
+    //上次被打断没有消费的sqe也一起提交
+    unsigned to_submit = m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+
+    //GETEVENTS同时处理推迟的完成事件
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    unsigned min_complete = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if (wait_ms) {
+        flags |= IORING_ENTER_EXT_ARG;
+        min_complete = 1;
+        if (wait_ms != ~0ull) {
+            ts.tv_sec = wait_ms / 1000;
+            ts.tv_nsec = (wait_ms % 1000) * 1000000;
+            arg.ts = (uintptr_t)&ts;
+        }
+    } else if (to_submit == 0 && !isDeferTaskrun()) {
+        return 0;
+    }
+
+    int rt = io_uring_enter(m_fd, to_submit, min_complete, flags
+            , wait_ms ? &arg : nullptr, wait_ms ? sizeof(arg) : 0);
+    if (rt < 0) {
+        //等待超时、被信号打断、完成队列暂时满都不是错误
+        if (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN) {
+            return 0;
+        }
+        FANG_LOG_ERROR(g_logger) << "io_uring_enter errno=" << errno
+            << " errstr=" << strerror(errno);
+        return -errno;
+    }
+    return rt;
+}
+
+}
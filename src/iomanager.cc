@@ -1,17 +1,58 @@
 #include "../inc/iomanager.h"
+#include "../inc/io_uring.h"
+#include "../inc/config.h"
 #include "../inc/log.h"
 #include "../inc/mydef.h"
+#include <poll.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <set>
 
 
-#define MAX_EVENTS 256 
+//epoll_wait一次取出的事件数量在这个范围内自适应
+static const int MIN_EVENTS = 64;
+static const int MAX_EVENTS = 4096;
 
 namespace fang {
 
 static fang::Logger::ptr g_logger = FANG_LOG_NAME("system");
 
+static fang::ConfigVar<std::string>::ptr g_iomanager_backend
+    = fang::Config::Lookup("iomanager.backend", std::string("epoll")
+            , "iomanager backend, epoll or io_uring");
+
+static fang::ConfigVar<std::map<std::string, int> >::ptr g_iomanager_sharded
+    = fang::Config::Lookup("iomanager.sharded", std::map<std::string, int>()
+            , "sharded mode of each iomanager by name, nonzero gives every worker its own epoll");
+
+//io_uring完成事件的user_data，其余的值是UringRequest指针
+static const uint64_t URING_IGNORE = 0; //链接的超时
+static const uint64_t URING_TICKLE = 1; //eventfd可读
+static const uint64_t URING_EPOLL = 2;  //epfd可读
+
+/**
+ * @Synopsis  提交到io_uring的操作，在提交它的协程栈上
+ */
+struct UringRequest {
+    Fiber::ptr fiber;
+    int res = 0;
+};
+
+/**
+ * @Synopsis  所有IoManager，close时逐个解除fd的注册
+ */
+struct IoManagerRegistry {
+    RWMutex mutex;
+    std::set<IoManager*> iomanagers;
+};
+
+static IoManagerRegistry& GetRegistry() {
+    static IoManagerRegistry s_registry;
+    return s_registry;
+}
+
 IoManager* IoManager::GetThis() {
     return dynamic_cast<IoManager*>(Scheduler::GetThis());
 }
@@ -20,8 +61,28 @@ void IoManager::tickle() {
     if(!hasIdleThreads()) {
         return ;
     }
-    int ret = write(m_tickleFds[1], "T", 1);
-    FANG_ASSERT(ret == 1);
+    //只有认领到一个还没有被通知的睡眠线程才写eventfd，连续的schedul只产生一次唤醒
+    int idx = claimSleeper();
+    if (idx < 0) {
+        return ;
+    }
+    ++m_tickleCount;
+    //共享模式所有线程等待同一个eventfd，分片模式写给认领到的线程
+    int ret = eventfd_write(m_reactors[m_sharded ? idx : 0].tickleFd, 1);
+    FANG_ASSERT(ret == 0);
+}
+
+void IoManager::tickleWorker(size_t idx) {
+    if (!m_sharded) {
+        tickle();
+        return ;
+    }
+    if (!claimWorker(idx)) {
+        return ;
+    }
+    ++m_tickleCount;
+    int ret = eventfd_write(m_reactors[idx].tickleFd, 1);
+    FANG_ASSERT(ret == 0);
 }
 
 bool IoManager::stopping(uint64_t& timeout) {
@@ -38,212 +99,409 @@ bool IoManager::stopping() {
 
 void IoManager::idle() {
     FANG_LOG_DEBUG(g_logger) << "idle";
-    epoll_event* events = new epoll_event[MAX_EVENTS]();
-    std::shared_ptr<epoll_event> share_events(events, [](epoll_event* ptr){
-            delete[] ptr;
-    });
+    //上一次取满就加倍，连续很多次用不到四分之一就减半
+    std::vector<epoll_event> events(MIN_EVENTS);
+    int underused = 0;
+    TaskBatch batch(this);
+    int idx = m_sharded ? getWorkerIndex() : 0;
+    Reactor& reactor = m_reactors[idx < 0 ? 0 : idx];
 
     while (true) {
+        if (shouldRetire()) {
+            FANG_LOG_INFO(g_logger) << "name=" << getName() << " idle retire";
+            break;
+        }
         uint64_t next_timeout = 0;
         if (stopping(next_timeout)) {
             FANG_LOG_INFO(g_logger) << "name=" << getName()
                                     << " idle stopping exit";
+            //还在睡眠的线程不会再收到任务，唤醒它们检查退出条件
+            for (size_t i = 0; i < getWorkerCount(); ++i) {
+                tickle();
+            }
             break;
         }
 
         int ret = 0;
-        do {
-            static const int MAX_TIMOUT = 3000;
-            if(next_timeout != ~0ull) {
-                next_timeout = (int) next_timeout > MAX_TIMOUT 
-                    ? MAX_TIMOUT : next_timeout;
-            } else {
-                next_timeout = MAX_TIMOUT;
+        if (markSleeping() || stopping()) {
+            next_timeout = 0;   //睡眠前已经有新任务或者开始停止，不阻塞
+        }
+        static const int MAX_TIMOUT = 3000;
+        if(next_timeout != ~0ull) {
+            next_timeout = (int) next_timeout > MAX_TIMOUT 
+                ? MAX_TIMOUT : next_timeout;
+        } else {
+            next_timeout = MAX_TIMOUT;
+        }
+        bool epoll_ready = true;
+        if (m_uring) {
+            //本线程积累的提交在这里一次交给内核，同时等待完成事件
+            getRing(reactor)->submit(next_timeout);
+        } else {
+            do {
+                ret = epoll_wait(reactor.epfd, &events[0], events.size(), (int)next_timeout);
+                if (ret < 0 &&errno == EINTR) {
+                    continue;
+                } else {
+                    break;
+                }
+            } while(true);
+        }
+        bool notified = markAwake();
+        std::vector<Task> cbs;
+        std::vector<int> priorities;
+        listExpiredCb(cbs, &priorities);
+        for (size_t i = 0; i < cbs.size(); ++i) {
+            batch.add(&cbs[i], -1, PriorityFlag(priorities[i]));
+        }
+
+        size_t resumed = 0;
+        if (m_uring) {
+            epoll_ready = reapUring(reactor, batch, resumed);
+            if (epoll_ready) {
+                ret = epoll_wait(reactor.epfd, &events[0], events.size(), 0);
+                armUring(reactor, URING_EPOLL);
             }
-            ret = epoll_wait(m_epfd, events, MAX_EVENTS, (int)next_timeout);
-            if (ret < 0 &&errno == EINTR) {
-                continue;
-            } else {
-                break;
+        }
+        if (epoll_ready) {
+            resumed += handleEvents(reactor, &events[0], ret, notified, batch);
+        }
+        //到期的定时器和本轮就绪的协程一次入队，入队之后才减少等待数量，
+        //否则其他线程可能在中间看到既没有任务也没有等待的事件而退出
+        schedul(batch);
+        m_pendingEventCount -= resumed;
+
+        if (ret == (int)events.size() && ret < MAX_EVENTS) {
+            events.resize(ret * 2);
+            underused = 0;
+        } else if (ret < (int)events.size() / 4 && events.size() > MIN_EVENTS) {
+            if (++underused >= 64) {
+                events.resize(events.size() / 2);
+                events.shrink_to_fit();
+                underused = 0;
             }
-        } while(true);
-        std::vector<std::function<void()> > cbs;
-        listExpiredCb(cbs);
-        if (!cbs.empty()) {
-            schedul(cbs.begin(), cbs.end());
-            cbs.clear();
+        } else {
+            underused = 0;
         }
 
-        for (int i = 0; i < ret; ++i) {
-            epoll_event& event = events[i];
-            if (event.data.fd == m_tickleFds[0]) {
-                uint8_t dummy[256];
-                while(read(m_tickleFds[0], dummy, sizeof(dummy)) > 0);
-                continue;
-            }
+        Fiber::ptr cur = Fiber::GetThis();
+        auto raw_ptr = cur.get();
+        cur.reset();
+        raw_ptr->swapOut();
+    }
+}
 
-            FdContext* fd_ctx = (FdContext*)event.data.ptr;
-            FdContext::MutexType::Lock lock(fd_ctx->mutex);
-            if(event.events & (EPOLLERR | EPOLLHUP)) {
-                event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
-            }
-            int real_events = NONE;
-            if (event.events & EPOLLIN) {
-                real_events |= READ;
-            }
-            if (event.events & EPOLLOUT) {
-                real_events |= WRITE;
-            }
-            if ((fd_ctx->events & real_events) == NONE) {
+size_t IoManager::handleEvents(Reactor& reactor, epoll_event* events, int n, bool notified
+        , TaskBatch& batch) {
+    size_t triggered = 0;
+    for (int i = 0; i < n; ++i) {
+        epoll_event& event = events[i];
+        if (event.data.fd == reactor.tickleFd) {
+            eventfd_t count = 0;
+            ++m_wakeupCount;
+            if (m_sharded) {
+                //分片模式的eventfd只有本线程等待
+                eventfd_read(reactor.tickleFd, &count);
                 continue;
             }
-            int left_events = (fd_ctx->events & ~real_events);
-            int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-            event.events = EPOLLET | left_events;
-
-            int ret_ = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
-            if (ret_) {
-                FANG_LOG_ERROR(g_logger) << "epoll_ctl error, "
-                                        << strerror(errno);
-                continue;
-            }
-
-            if (real_events & READ) {
-                fd_ctx->triggerEvent(READ);
-                --m_pendingEventCount;
+            //边缘触发下多次写入只产生一次就绪，取出全部计数后把剩下的传给下一个线程
+            if (eventfd_read(reactor.tickleFd, &count) == 0 && count > 1) {
+                eventfd_write(reactor.tickleFd, count - 1);
             }
-            if (real_events & WRITE) {
-                fd_ctx->triggerEvent(READ);
-                --m_pendingEventCount;
+            //唤醒的是其他被认领的线程，把它恢复为可认领状态
+            if (!notified) {
+                releaseNotified();
             }
+            continue;
+        }
 
-        }        
-        Fiber::ptr cur = Fiber::GetThis();
-        auto raw_ptr = cur.get();
-        cur.reset();
-        raw_ptr->swapOut();
+        FdContext* fd_ctx = (FdContext*)event.data.ptr;
+        FdContext::MutexType::Lock lock(fd_ctx->mutex);
+        int real_events = NONE;
+        if (event.events & (EPOLLERR | EPOLLHUP)) {
+            real_events = READ | WRITE;
+        }
+        if (event.events & EPOLLIN) {
+            real_events |= READ;
+        }
+        if (event.events & EPOLLOUT) {
+            real_events |= WRITE;
+        }
+        //fd一直注册着，有等待者的方向直接触发，没有等待者的方向记下留给下一次addEvent
+        //被触发的等待者会重新执行io，不能再留下就绪，否则下一次EAGAIN后会被立即空唤醒
+        int trigger_events = fd_ctx->events & (fd_ctx->ready | real_events);
+        fd_ctx->ready = (Event)((fd_ctx->ready | real_events) & ~trigger_events);
+        if (trigger_events & READ) {
+            fd_ctx->triggerEvent(READ, &batch);
+            ++triggered;
+        }
+        if (trigger_events & WRITE) {
+            fd_ctx->triggerEvent(WRITE, &batch);
+            ++triggered;
+        }
+    }
+    return triggered;
+}
+
+IoUring* IoManager::getRing(Reactor& reactor) {
+    if (!reactor.ring) {
+        reactor.ring = new IoUring;
+        FANG_ASSERT(reactor.ring->isValid());
+        armUring(reactor, URING_TICKLE);
+        armUring(reactor, URING_EPOLL);
+    }
+    return reactor.ring;
+}
+
+void IoManager::armUring(Reactor& reactor, uint64_t tag) {
+    io_uring_sqe* sqe = reactor.ring->getSqe();
+    if (!sqe) {
+        reactor.ring->submit();
+        sqe = reactor.ring->getSqe();
+    }
+    if (tag == URING_TICKLE) {
+        IoUring::PrepRw(sqe, IORING_OP_READ, reactor.tickleFd
+                , &reactor.tickleValue, sizeof(reactor.tickleValue), 0);
+    } else {
+        IoUring::PrepRw(sqe, IORING_OP_POLL_ADD, reactor.epfd, nullptr, 0, 0);
+        sqe->poll32_events = POLLIN;
+    }
+    sqe->user_data = tag;
+}
+
+bool IoManager::reapUring(Reactor& reactor, TaskBatch& batch, size_t& resumed) {
+    bool epoll_ready = false;
+    bool tickled = false;
+    int thread = fang::GetThreadId();
+    reactor.ring->reap([&](io_uring_cqe* cqe) {
+        switch (cqe->user_data) {
+            case URING_IGNORE:
+                break;
+            case URING_TICKLE:
+                tickled = true;
+                break;
+            case URING_EPOLL:
+                epoll_ready = true;
+                break;
+            default:
+                {
+                    //恢复提交操作的协程，ring只属于本线程，协程也回到本线程
+                    UringRequest* req = (UringRequest*)cqe->user_data;
+                    req->res = cqe->res;
+                    batch.add(&req->fiber, thread);
+                    ++resumed;
+                }
+                break;
+        }
+    });
+    if (tickled) {
+        ++m_wakeupCount;
+        armUring(reactor, URING_TICKLE);
     }
+    return epoll_ready;
+}
+
+bool IoManager::canSubmitIo() const {
+    return m_uring && getWorkerIndex() >= 0
+        && !Fiber::GetThis()->isSharedStack();
 }
 
+int IoManager::submitIo(const std::function<void(io_uring_sqe*)>& prep, uint64_t timeout_ms) {
+    IoUring* ring = getRing(m_reactors[getWorkerIndex()]);
+    if (ring->getSpace() < 2) {
+        ring->submit(); //提交队列满了先交给内核
+    }
+
+    UringRequest req;
+    req.fiber = Fiber::GetThis();
+    io_uring_sqe* sqe = ring->getSqe();
+    prep(sqe);
+    sqe->user_data = (uintptr_t)&req;
+
+    __kernel_timespec ts;   //提交之前协程挂起，栈上的变量一直有效
+    if (timeout_ms != ~0ull) {
+        sqe->flags |= IOSQE_IO_LINK;
+        io_uring_sqe* timeout = ring->getSqe();
+        IoUring::PrepLinkTimeout(timeout, &ts, timeout_ms);
+        timeout->user_data = URING_IGNORE;
+    }
+    ++m_pendingEventCount;
+    Fiber::YieldToHold();
+
+    if (req.res == -ECANCELED && timeout_ms != ~0ull) {
+        return -ETIMEDOUT;
+    }
+    return req.res;
+}
 
 void IoManager::onTimerInsertedAtFront() {
     tickle();
 }
 
 
-IoManager::IoManager(size_t threads, bool use_caller, const std::string& name)
-    :Scheduler(threads, use_caller, name) {
-        m_epfd = epoll_create(5000);
-        FANG_ASSERT(m_epfd != -1);
+IoManager::IoManager(size_t threads, bool use_caller, const std::string& name
+        , bool sharded)
+    :Scheduler(threads, use_caller, name)
+    ,TimerManager(threads)
+    ,m_sharded(sharded)
+    ,m_uring(false)
+    ,m_fdContexts([](FdContext& fd_ctx, int fd) { fd_ctx.fd = fd; }) {
+        //按名字配置的分片模式，配置文件创建的io_worker没有构造参数可以传
+        auto sharded_conf = g_iomanager_sharded->getValue();
+        auto it = sharded_conf.find(name);
+        if (it != sharded_conf.end()) {
+            m_sharded = it->second != 0;
+        }
+        if (g_iomanager_backend->getValue() == "io_uring") {
+            if (IoUring::IsSupported()) {
+                m_uring = true;
+                m_sharded = true;
+            } else {
+                FANG_LOG_INFO(g_logger) << "name=" << name
+                    << " io_uring not supported, fallback to epoll";
+            }
+        }
+        if (m_sharded) {
+            //每个工作线程一个reactor，等待io的协程固定回到注册时的线程
+            disableElastic();
+        }
+        m_reactors.resize(m_sharded ? getWorkerCount() : 1);
+        for (auto& reactor : m_reactors) {
+            reactor.epfd = epoll_create(5000);
+            FANG_ASSERT(reactor.epfd != -1);
+
+            reactor.tickleFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            FANG_ASSERT(reactor.tickleFd != -1);
 
-        int ret = pipe(m_tickleFds);
-        FANG_ASSERT(ret == 0);
-        
-        epoll_event event;
-        memset(&event, 0, sizeof(event));
-        event.events = EPOLLIN | EPOLLET;
-        event.data.fd = m_tickleFds[0];
+            if (m_uring) {
+                //epoll只用于addEvent，eventfd和epfd都在ring上等待，ring由工作线程创建
+                continue;
+            }
 
-        ret = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
-        FANG_ASSERT(ret == 0);
+            epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN | EPOLLET;
+            event.data.fd = reactor.tickleFd;
 
-        ret = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
-        FANG_ASSERT(ret == 0);
-        contextResize(32);
+            int ret = epoll_ctl(reactor.epfd, EPOLL_CTL_ADD, reactor.tickleFd, &event);
+            FANG_ASSERT(ret == 0);
+        }
+        {
+            IoManagerRegistry& registry = GetRegistry();
+            RWMutex::WrLock lock(registry.mutex);
+            registry.iomanagers.insert(this);
+        }
         start();
 }
 
 IoManager::~IoManager() {
     stop();
-    close(m_epfd);
-    close(m_tickleFds[0]);
-    close(m_tickleFds[1]);
-
-    for (size_t i = 0; i < m_fdContexts.size(); ++i) {
-        if (m_fdContexts[i] != nullptr) {
-            delete m_fdContexts[i];
-        }
+    {
+        IoManagerRegistry& registry = GetRegistry();
+        RWMutex::WrLock lock(registry.mutex);
+        registry.iomanagers.erase(this);
+    }
+    for (auto& reactor : m_reactors) {
+        close(reactor.epfd);
+        close(reactor.tickleFd);
+        delete reactor.ring;
     }
 }
 
-void IoManager::contextResize(size_t size) {
-    m_fdContexts.resize(size);
-    for (size_t i = 0; i < m_fdContexts.size(); i++) {
-        if (m_fdContexts[i] == nullptr) {
-            m_fdContexts[i] = new FdContext;
-            m_fdContexts[i]->fd = i;
-        }
+int IoManager::selectReactor(int fd) const {
+    if (!m_sharded) {
+        return 0;
     }
+    int idx = getWorkerIndex();
+    return idx >= 0 ? idx : fd % m_reactors.size();
 }
 
-int IoManager::addEvent(int fd, Event event, std::function<void()> cb) {
-    FdContext* fd_ctx = nullptr;
-    RWMutexType::RdLock lock(m_mutex);
-    if((int)m_fdContexts.size() > fd) {
-        fd_ctx = m_fdContexts[fd];
-        lock.unlock();
-    } else {
-        lock.unlock();
-        RWMutexType::WrLock lock(m_mutex);
-        contextResize(fd * 1.5);
-        fd_ctx = m_fdContexts[fd];
-    }
-    
-    FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-    
-    
-    int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+int IoManager::updateEvents(FdContext* fd_ctx, int op, uint32_t events) {
+    if (op == EPOLL_CTL_ADD) {
+        fd_ctx->reactor = selectReactor(fd_ctx->fd);
+    } else if (fd_ctx->reactor < 0) {
+        errno = ENOENT;
+        return -1;
+    }
     epoll_event epevent;
-    epevent.events = EPOLLET | fd_ctx->events | event;
+    epevent.events = events;
     epevent.data.ptr = fd_ctx;
-    int ret = epoll_ctl(m_epfd, op, fd, &epevent);
-
+    int ret = epoll_ctl(m_reactors[fd_ctx->reactor].epfd, op, fd_ctx->fd, &epevent);
+    if (ret && op == EPOLL_CTL_ADD && errno == EEXIST) {
+        //没有经过close解除的旧注册
+        ret = epoll_ctl(m_reactors[fd_ctx->reactor].epfd, EPOLL_CTL_MOD, fd_ctx->fd, &epevent);
+    }
     if (ret) {
-        FANG_LOG_ERROR(g_logger) <<  "epoll_ctl error," 
-            << strerror(errno);
+        FANG_LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->reactor << ", "
+            << op << ", " << fd_ctx->fd << ") error, " << strerror(errno);
+        if (op == EPOLL_CTL_ADD) {
+            fd_ctx->reactor = -1;
+        }
+        return ret;
+    }
+    if (op == EPOLL_CTL_DEL) {
+        fd_ctx->reactor = -1;
+    }
+    return 0;
+}
+
+int IoManager::addEvent(int fd, Event event, Task cb) {
+    FdContext* fd_ctx = m_fdContexts.get(fd, true);
+    if (!fd_ctx) {
+        return -1;
+    }
+    FdContext::MutexType::Lock lock(fd_ctx->mutex);
+
+    //第一次等待时注册读写两个方向，之后事件只更新ready，直到close才删除
+    if (fd_ctx->reactor < 0
+            && updateEvents(fd_ctx, EPOLL_CTL_ADD, EPOLLIN | EPOLLOUT | EPOLLET)) {
         return -1;
     }
 
     ++m_pendingEventCount;
+    ++m_eventWaitCount;
     fd_ctx->events = (Event)(fd_ctx->events | event);
 
     FdContext::EventContext& event_ctx = fd_ctx->getContext(event);
 
     event_ctx.scheduler = fang::Scheduler::GetThis();
+    //分片模式下等待io的协程回到注册事件的线程，不被其他线程窃取
+    if (m_sharded && event_ctx.scheduler == this) {
+        event_ctx.thread = fang::GetThreadId();
+    }
     if (cb) {
-        event_ctx.cb.swap(cb);
+        event_ctx.cb = std::move(cb);
+        event_ctx.flags = PriorityFlag(GetTaskPriority());
     } else {
         event_ctx.fiber = Fiber::GetThis();
     }
+
+    if (fd_ctx->ready & event) {
+        //上次等待之后已经收到过就绪，立即触发，当前协程挂起后在本线程恢复
+        fd_ctx->ready = (Event)(fd_ctx->ready & ~event);
+        ++m_readyHitCount;
+        if (event_ctx.fiber && event_ctx.scheduler == this && getWorkerIndex() >= 0) {
+            event_ctx.thread = fang::GetThreadId();
+        }
+        fd_ctx->triggerEvent(event);
+        --m_pendingEventCount;
+    }
     return 0;
 }
 
 bool IoManager::delEvent(int fd, Event event) {
-    RWMutexType::RdLock lock(m_mutex);
-    if ((int)m_fdContexts.size() <= fd) {
+    FdContext* fd_ctx = m_fdContexts.get(fd);
+    if (!fd_ctx) {
         return false;
     }
-    FdContext* fd_ctx = m_fdContexts[fd];
-    lock.unlock();
-
-    FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-    
-    Event new_events = (Event)(fd_ctx->events & ~event);
-    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
-
-    int ret = epoll_ctl(m_epfd, op, fd, &epevent);
 
-    if (ret) {
-        FANG_LOG_ERROR(g_logger) << "epoll_ctl error, " 
-                            << strerror(errno);
+    FdContext::MutexType::Lock lock(fd_ctx->mutex);
+    if ((fd_ctx->events & event) == 0) {
         return false;
     }
 
     --m_pendingEventCount;
-    fd_ctx->events = new_events;
+    fd_ctx->events = (Event)(fd_ctx->events & ~event);
     FdContext::EventContext& event_ctx = fd_ctx->getContext(event);
     fd_ctx->resetContext(event_ctx);
     return true;
@@ -251,30 +509,16 @@ bool IoManager::delEvent(int fd, Event event) {
 
 
 bool IoManager::cancelEvent(int fd, Event event) {
-    RWMutexType::RdLock lock(m_mutex);
-    if ((int)m_fdContexts.size() <= fd) {
+    FdContext* fd_ctx = m_fdContexts.get(fd);
+    if (!fd_ctx) {
         return false;
     }
-    FdContext* fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
-    FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+    FdContext::MutexType::Lock lock(fd_ctx->mutex);
     if ((fd_ctx->events & event) == 0) {
         return false;
     }
 
-    Event new_events = (Event)(fd_ctx->events & ~event);
-    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
-
-    int ret = epoll_ctl(m_epfd, op, fd, &epevent);
-    if (ret) {
-        FANG_LOG_ERROR(g_logger) << "epoll_ctl error,"
-                            << strerror(errno);
-        return false;
-    }
     fd_ctx->triggerEvent(event);
     --m_pendingEventCount;
     return true;
@@ -282,28 +526,21 @@ bool IoManager::cancelEvent(int fd, Event event) {
 }
 
 bool IoManager::cancelAll(int fd) {
-    RWMutexType::RdLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    FdContext* fd_ctx = m_fdContexts.get(fd);
+    if (!fd_ctx) {
         return false;
     }
-    FdContext* fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
-    FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-    if (!fd_ctx->events) {
+    FdContext::MutexType::Lock lock(fd_ctx->mutex);
+    if (fd_ctx->reactor < 0 && !fd_ctx->events) {
         return false;
     }
 
-    int op = EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events = 0;
-    epevent.data.ptr = fd_ctx;
-    int ret = epoll_ctl(m_epfd, op, fd, &epevent);
-    if (ret) {
-        FANG_LOG_ERROR(g_logger) << "epoll_ctl error, "
-                                << strerror(errno);
-        return false;
+    //fd关闭后编号会被复用，注册和就绪状态不能留给下一个fd
+    if (fd_ctx->reactor >= 0 && updateEvents(fd_ctx, EPOLL_CTL_DEL, 0)) {
+        fd_ctx->reactor = -1;
     }
+    fd_ctx->ready = NONE;
 
     if (fd_ctx->events & READ) {
         fd_ctx->triggerEvent(READ);
@@ -316,6 +553,14 @@ bool IoManager::cancelAll(int fd) {
     return true;
 }
 
+void IoManager::CloseFd(int fd) {
+    IoManagerRegistry& registry = GetRegistry();
+    RWMutex::RdLock lock(registry.mutex);
+    for (auto iom : registry.iomanagers) {
+        iom->cancelAll(fd);
+    }
+}
+
 IoManager::FdContext::EventContext& IoManager::FdContext::getContext(IoManager::Event event) {
     switch(event) {
         case IoManager::READ:
@@ -333,18 +578,28 @@ void IoManager::FdContext::resetContext(EventContext& ctx) {
     ctx.scheduler = nullptr;
     ctx.fiber.reset();
     ctx.cb = nullptr;
+    ctx.thread = -1;
+    ctx.flags = TASK_NONE;
 }
 
-void IoManager::FdContext::triggerEvent(IoManager::Event event) {
+void IoManager::FdContext::triggerEvent(IoManager::Event event, TaskBatch* batch) {
     FANG_ASSERT(events & event);
     events = (Event)(events & ~event);
     EventContext& ctx = getContext(event);
-    if (ctx.cb) {
-        ctx.scheduler->schedul(&ctx.cb);
+    if (batch && batch->getScheduler() == ctx.scheduler) {
+        if (ctx.cb) {
+            batch->add(&ctx.cb, ctx.thread, ctx.flags);
+        } else {
+            batch->add(&ctx.fiber, ctx.thread);
+        }
+    } else if (ctx.cb) {
+        ctx.scheduler->schedul(&ctx.cb, ctx.thread, ctx.flags);
     } else {
-        ctx.scheduler->schedul(&ctx.fiber);
+        ctx.scheduler->schedul(&ctx.fiber, ctx.thread);
     }
     ctx.scheduler = nullptr;
+    ctx.thread = -1;
+    ctx.flags = TASK_NONE;
     return;
 }
 }
@@ -9,6 +9,7 @@
  */
 #include "log.h"
 #include "helpc.h"
+#include "fiber_local.h"
 #include <map>
 #include <functional>
 namespace fang
@@ -47,6 +48,31 @@ namespace fang
         return LogLevel::UNDEFINE;
     }
 
+    //函数内的静态变量，保证其他全局对象构造时打日志已经分配了槽
+    static FiberLocal<std::string> &TraceIdLocal()
+    {
+        static FiberLocal<std::string> s_trace_id(true);
+        return s_trace_id;
+    }
+
+    void SetTraceId(const std::string &id)
+    {
+        if (id.empty())
+        {
+            TraceIdLocal().reset();
+        }
+        else
+        {
+            TraceIdLocal().set(id);
+        }
+    }
+
+    const std::string &GetTraceId()
+    {
+        static const std::string s_empty;
+        return TraceIdLocal().getOr(s_empty);
+    }
+
     LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level,
                        const char *filename, int32_t line, uint32_t elapse,
                        uint32_t thread_id, uint32_t fiber_id, time_t time,
@@ -56,6 +82,7 @@ namespace fang
           m_threadId(thread_id),
           m_fiberId(fiber_id),
           m_threadName(thread_name),
+          m_traceId(GetTraceId()),
           m_time(time),
           m_elapse(elapse),
           m_level(level), 
@@ -210,6 +237,16 @@ namespace fang
         }
     };
 
+    class TraceIdFormatItem : public LogFormatter::FormatItem
+    {
+    public:
+        TraceIdFormatItem(const std::string &str = "") {}
+        void format(std::ostream &os, LogEvent::ptr event) override
+        {
+            os << event->getTraceId();
+        }
+    };
+
     class ThreadNameFormatItem : public LogFormatter::FormatItem
     {
     public:
@@ -418,6 +455,7 @@ namespace fang
             DEF_XX(T, TabFormatItem),        // T:Tab
             DEF_XX(F, FiberIdFormatItem),    // F:协程id
             DEF_XX(N, ThreadNameFormatItem), // N:线程名称
+            DEF_XX(X, TraceIdFormatItem),    // X:跟踪id
 #undef DEF_XX
         };
         for (auto &i : vec)
@@ -0,0 +1,183 @@
+#include "../inc/parallel.h"
+#include "../inc/future.h"
+#include "../inc/helpc.h"
+#include "../inc/scheduler.h"
+#include "../inc/mydef.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace fang {
+
+//每块的目标执行时间，块执行得更快就加倍，更慢就减半(不小于grain)
+static const uint64_t s_chunk_target_us = 100;
+
+namespace {
+
+/**
+* @Synopsis  一个任务剩余的区间，高32位为起点，低32位为终点(相对于begin)
+*            所有者从起点取块，其他任务偷走后一半，都通过CAS修改
+*/
+struct ParallelSlot {
+    std::atomic<uint64_t> range;
+    char m_pad[64 - sizeof(std::atomic<uint64_t>)];
+};
+
+struct ParallelJob {
+    typedef std::shared_ptr<ParallelJob> ptr;
+
+    ParallelJob(size_t n)
+        :slots(new ParallelSlot[n]) {
+    }
+
+    static uint64_t Pack(uint64_t lo, uint64_t hi) { return (lo << 32) | hi; }
+    static uint64_t Lo(uint64_t range) { return range >> 32; }
+    static uint64_t Hi(uint64_t range) { return range & 0xffffffffull; }
+
+    /**
+     * @Synopsis  从自己的区间头部取最多chunk个
+     */
+    bool claim(size_t slot, size_t chunk, size_t& b, size_t& e) {
+        std::atomic<uint64_t>& range = slots[slot].range;
+        uint64_t r = range.load(std::memory_order_relaxed);
+        while (true) {
+            uint64_t lo = Lo(r), hi = Hi(r);
+            if (lo >= hi) {
+                return false;
+            }
+            uint64_t take = std::min<uint64_t>(chunk, hi - lo);
+            if (range.compare_exchange_weak(r, Pack(lo + take, hi), std::memory_order_acq_rel)) {
+                b = lo;
+                e = lo + take;
+                return true;
+            }
+        }
+    }
+
+    /**
+     * @Synopsis  自己的区间取完后，从剩余最多的任务偷走后一半作为自己的区间
+     *            剩余不到2*grain的留给所有者
+     */
+    bool steal(size_t slot) {
+        while (true) {
+            size_t victim = count;
+            uint64_t victim_range = 0;
+            uint64_t most = 0;
+            for (size_t i = 1; i < count; ++i) {
+                size_t idx = (slot + i) % count;
+                uint64_t r = slots[idx].range.load(std::memory_order_relaxed);
+                uint64_t left = Hi(r) > Lo(r) ? Hi(r) - Lo(r) : 0;
+                if (left >= 2 * grain && left > most) {
+                    victim = idx;
+                    victim_range = r;
+                    most = left;
+                }
+            }
+            if (victim == count) {
+                return false;
+            }
+            uint64_t lo = Lo(victim_range), hi = Hi(victim_range);
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (slots[victim].range.compare_exchange_strong(victim_range, Pack(lo, mid)
+                        , std::memory_order_acq_rel)) {
+                //自己的区间已经取空，其他任务不会再修改它
+                slots[slot].range.store(Pack(mid, hi), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    void run(size_t slot) {
+        size_t chunk = grain;
+        size_t b = 0, e = 0;
+        do {
+            while (!failed.load(std::memory_order_relaxed) && claim(slot, chunk, b, e)) {
+                uint64_t start = GetMonotonicUS();
+                try {
+                    (*body)(slot, begin + b, begin + e);
+                } catch (...) {
+                    if (!failed.exchange(true)) {
+                        error = std::current_exception();
+                    }
+                    break;
+                }
+                uint64_t used = GetMonotonicUS() - start;
+                if (used < s_chunk_target_us / 2 && chunk < size) {
+                    chunk *= 2;
+                } else if (used > s_chunk_target_us * 2 && chunk > grain) {
+                    chunk = std::max(grain, chunk / 2);
+                }
+            }
+        } while (!failed.load(std::memory_order_relaxed) && steal(slot));
+
+        if (active.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            done.setValue();
+        }
+    }
+
+    const std::function<void(size_t, size_t, size_t)>* body = nullptr;
+    size_t begin = 0;
+    size_t size = 0;
+    size_t grain = 1;
+    size_t count = 0;
+    std::unique_ptr<ParallelSlot[]> slots;
+    std::atomic<size_t> active{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;   //第一个异常，failed置位的任务写入
+    Promise<void> done;
+};
+
+}
+
+size_t ParallelSlots(Scheduler* scheduler, size_t count) {
+    if (!scheduler) {
+        return 1;
+    }
+    size_t threads = std::max<size_t>(1, scheduler->getThreadIds().size());
+    return std::max<size_t>(1, std::min(threads, count));
+}
+
+void ParallelRun(Scheduler* scheduler, size_t begin, size_t end, size_t grain, size_t slots
+        , const std::function<void(size_t, size_t, size_t)>& body) {
+    if (begin >= end) {
+        return;
+    }
+    size_t n = end - begin;
+    if (!scheduler || slots <= 1) {
+        body(0, begin, end);
+        return;
+    }
+    FANG_ASSERT2(n <= 0xffffffffull, "parallel range too large");
+    if (grain == 0) {
+        //默认每个任务至少切成64块，给偷取留出余地
+        grain = std::max<size_t>(1, n / (slots * 64));
+    }
+
+    ParallelJob::ptr job(new ParallelJob(slots));
+    job->body = &body;
+    job->begin = begin;
+    job->size = n;
+    job->grain = grain;
+    job->count = slots;
+    job->active = slots;
+    for (size_t i = 0; i < slots; ++i) {
+        job->slots[i].range = ParallelJob::Pack(n * i / slots, n * (i + 1) / slots);
+    }
+    Future<void> done = job->done.getFuture();
+
+    std::vector<Task> tasks;
+    tasks.reserve(slots);
+    for (size_t i = 0; i < slots; ++i) {
+        tasks.push_back([job, i]() { job->run(i); });
+    }
+    scheduler->schedul(tasks.begin(), tasks.end());
+
+    //body在调用者的栈上，所有任务结束之前不能返回
+    done.get();
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+}
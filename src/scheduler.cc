@@ -1,14 +1,124 @@
 #include "../inc/scheduler.h"
+#include "../inc/fiber_local.h"
+#include "../inc/affinity.h"
+#include "../inc/config.h"
 #include "../inc/log.h"
 #include "../inc/hook.h"
 #include "../inc/mydef.h"
 #include "../inc/helpc.h"
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 namespace fang {
 
 static fang::Logger::ptr g_logger = FANG_LOG_NAME("system"); 
 
+static fang::ConfigVar<uint32_t>::ptr g_scheduler_idle_spin
+    = fang::Config::Lookup<uint32_t>("scheduler.idle_spin", 0
+            , "max spin iterations before an idle worker parks, 0 parks at once");
+
+static fang::ConfigVar<std::map<std::string, std::vector<int> > >::ptr g_scheduler_affinity
+    = fang::Config::Lookup("scheduler.affinity", std::map<std::string, std::vector<int> >()
+            , "cpus for the worker threads of each scheduler by name, worker i is pinned to cpus[i % size]");
+
+static fang::ConfigVar<std::map<std::string, uint32_t> >::ptr g_scheduler_max_threads
+    = fang::Config::Lookup("scheduler.max_threads", std::map<std::string, uint32_t>()
+            , "max threads of each scheduler by name, more than the constructed threads makes it elastic");
+
+static fang::ConfigVar<uint32_t>::ptr g_scheduler_grow_delay
+    = fang::Config::Lookup<uint32_t>("scheduler.grow_delay_ms", 50
+            , "elastic scheduler adds a thread when tasks wait this long with no idle thread");
+
+static fang::ConfigVar<uint32_t>::ptr g_scheduler_retire
+    = fang::Config::Lookup<uint32_t>("scheduler.retire_ms", 60000
+            , "elastic scheduler retires an extra thread idle for this long");
+
+static fang::ConfigVar<std::vector<uint32_t> >::ptr g_scheduler_priority_weights
+    = fang::Config::Lookup("scheduler.priority_weights", std::vector<uint32_t>{8, 4, 1}
+            , "dequeue weights of the high, normal and background lanes");
+
+static fang::ConfigVar<uint32_t>::ptr g_scheduler_starvation
+    = fang::Config::Lookup<uint32_t>("scheduler.starvation_ms", 100
+            , "a lane with tasks not served for this long is served next");
+
+static uint32_t s_idle_spin = 0;
+static uint32_t s_grow_delay = 50;
+static uint32_t s_retire = 60000;
+static uint32_t s_starvation = 100;
+static int s_lane_weights[Scheduler::PRIORITY_COUNT] = {8, 4, 1};
+
+//权值至少为1，缺少的按默认值
+static void SetLaneWeights(const std::vector<uint32_t>& weights) {
+    static const int defaults[Scheduler::PRIORITY_COUNT] = {8, 4, 1};
+    for (int i = 0; i < Scheduler::PRIORITY_COUNT; ++i) {
+        int w = i < (int)weights.size() ? (int)weights[i] : defaults[i];
+        s_lane_weights[i] = w > 0 ? w : 1;
+    }
+}
+
+struct _SchedulerIniter {
+    _SchedulerIniter() {
+        s_idle_spin = g_scheduler_idle_spin->getValue();
+        s_grow_delay = g_scheduler_grow_delay->getValue();
+        s_retire = g_scheduler_retire->getValue();
+        s_starvation = g_scheduler_starvation->getValue();
+        SetLaneWeights(g_scheduler_priority_weights->getValue());
+        g_scheduler_idle_spin->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+                s_idle_spin = new_value;
+        });
+        g_scheduler_grow_delay->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+                s_grow_delay = new_value;
+        });
+        g_scheduler_retire->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+                s_retire = new_value;
+        });
+        g_scheduler_starvation->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+                s_starvation = new_value;
+        });
+        g_scheduler_priority_weights->addListener([](const std::vector<uint32_t>& old_value
+                    , const std::vector<uint32_t>& new_value){
+                SetLaneWeights(new_value);
+        });
+    }
+};
+
+static _SchedulerIniter s_scheduler_initer;
+
+//返回是否超时，timeout_ms为0一直等待
+static bool futex_wait(std::atomic<int>* addr, int val, uint64_t timeout_ms = 0) {
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+    return syscall(SYS_futex, (int*)addr, FUTEX_WAIT_PRIVATE, val
+            , timeout_ms ? &ts : nullptr, nullptr, 0) == -1 && errno == ETIMEDOUT;
+}
+
+//饥饿判断只需要毫秒级，粗粒度时钟只读内存，比精确时钟快很多
+static uint64_t GetCoarseMS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+}
+
+static void futex_wake(std::atomic<int>* addr) {
+    syscall(SYS_futex, (int*)addr, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
 static thread_local Scheduler* t_scheruler = nullptr;
 static thread_local Fiber* t_scheruler_fiber = nullptr;
+static thread_local int t_worker_index = -1;   //当前线程在所属调度器中的工作队列下标
+static thread_local int t_task_priority = Scheduler::PRIORITY_NORMAL;  //当前线程正在执行的任务的优先级
+static thread_local uint32_t t_wait_sample = 0;    //普通任务排队时间的抽样计数
+
+static const uint32_t WAIT_SAMPLE_MASK = 15;    //普通任务每16个统计一次排队时间
 
 Scheduler* Scheduler::GetThis() {
     return t_scheruler;
@@ -22,6 +132,10 @@ Scheduler::Scheduler(size_t threads, bool use_caller,
         const std::string& name)
     :m_name(name) {
     FANG_ASSERT(threads > 0);
+    for (int i = 0; i < PRIORITY_COUNT; ++i) {
+        m_laneDepth[i] = 0;
+        m_laneServed[i] = 0;
+    }
     if (use_caller) {
         fang::Fiber::GetThis();
         --threads;
@@ -36,6 +150,43 @@ Scheduler::Scheduler(size_t threads, bool use_caller,
         m_rootThread = -1;
     }
     m_threadCount = threads;
+
+    //配置的最多线程数与构造参数一样包括use_caller的主线程
+    m_maxThreads = m_threadCount;
+    auto max_threads = g_scheduler_max_threads->getValue();
+    auto it = max_threads.find(m_name);
+    if (it != max_threads.end()) {
+        size_t max = it->second - (m_rootThread == -1 ? 0 : 1);
+        if (it->second > 0 && max > m_threadCount) {
+            m_maxThreads = max;
+            m_elastic = true;
+        }
+    }
+
+    //每个工作线程(包括use_caller的主线程)一个任务队列，主线程固定使用0号队列
+    //弹性调度器按最多线程数预先分配，退出的线程让出队列给新线程复用
+    m_workers.resize(m_maxThreads + (m_rootThread == -1 ? 0 : 1));
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        m_workers[i] = new Worker(i);
+    }
+    if (m_rootThread != -1) {
+        m_workers[0]->threadId = m_rootThread;
+        m_workers[0]->used = true;
+    }
+}
+
+void Scheduler::disableElastic() {
+    FANG_ASSERT(m_stopping && m_threadPool.empty());
+    if (!m_elastic) {
+        return;
+    }
+    size_t n = m_threadCount + (m_rootThread == -1 ? 0 : 1);
+    for (size_t i = n; i < m_workers.size(); ++i) {
+        delete m_workers[i];
+    }
+    m_workers.resize(n);
+    m_maxThreads = m_threadCount;
+    m_elastic = false;
 }
 
 Scheduler::~Scheduler() {
@@ -43,6 +194,23 @@ Scheduler::~Scheduler() {
     if (GetThis() == this) {
         t_scheruler = nullptr;
     }
+
+    for (auto w : m_workers) {
+        while (FiberAndThread* task = w->local.pop()) {
+            delete task;
+        }
+        for (auto& lane : w->pinned) {
+            for (auto task : lane) {
+                delete task;
+            }
+        }
+        delete w;
+    }
+    for (auto& lane : m_lanes) {
+        for (auto task : lane) {
+            delete task;
+        }
+    }
 }
 void Scheduler::start() {
     MutexType::Lock lock(m_mutex);
@@ -56,19 +224,31 @@ void Scheduler::start() {
     FANG_ASSERT(m_threadPool.empty()); //新的调度器的线程池应该为零
 
     m_threadPool.resize(m_threadCount); 
+    m_liveThreads = m_threadCount;
 
     for (size_t i = 0; i < m_threadCount; i++) {    //创建线程池
         m_threadPool[i].reset(new Thread(std::bind(&Scheduler::run, this), 
                     m_name + "_" + std::to_string(i)));
         m_threadIds.push_back(m_threadPool[i]->getId());
     }
+    if (m_elastic) {
+        m_monitorStop = false;
+        m_monitor.reset(new Thread(std::bind(&Scheduler::monitor, this), m_name + "_monitor"));
+    }
     lock.unlock();
 }
 
 void Scheduler::stop() {
     m_autoStop = true;
+    //先停止扩容，之后线程数只会减少
+    if (m_monitor) {
+        m_monitorStop = true;
+        m_monitor->join();
+        m_monitor.reset();
+    }
     if (m_rootFiber 
             && m_threadCount == 0
+            && !m_elastic
             && (m_rootFiber->getState() == Fiber::TREM
                 || m_rootFiber->getState() == Fiber::INIT)) {
         //FANG_LOG_INFO(g_logger) << "stopped";
@@ -84,11 +264,9 @@ void Scheduler::stop() {
     } 
 
     m_stopping = true;
-    for (size_t i = 0; i < m_threadCount; ++i) {
-        tickle();
-    }
-
-    if (m_rootFiber) {
+    //与空闲线程markSleeping之后检查stopping配对: 要么它看到m_stopping，要么tickle看到SLEEPING
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (size_t i = 0; i < m_workers.size(); ++i) {
         tickle();
     }
 
@@ -105,7 +283,7 @@ void Scheduler::stop() {
     for (auto& i : thrs) {
         i->join();
     }
-
+    joinRetired();
 }
 void Scheduler::switchTo(int thread) {
     FANG_ASSERT(Scheduler::GetThis() != nullptr);
@@ -119,43 +297,643 @@ void Scheduler::switchTo(int thread) {
 }
 
 std::ostream& Scheduler::dump(std::ostream& os) {
+    MutexType::Lock lock(m_mutex);
     os << "[Scheduler name=" << m_name
-       << ", size=" << m_threadCount
-       << ", active_count=" << m_activeThreadCount
+       << ", size=" << m_threadCount;
+    if (m_elastic) {
+        os << ", live=" << m_liveThreads
+           << ", max=" << m_maxThreads
+           << ", grown=" << m_growCount
+           << ", retired=" << m_retireCount
+           << ", last_resize=" << m_lastResize;
+    }
+    os << ", active_count=" << m_activeThreadCount
        << ", idle_thread=" << m_idleThreadCount
        << ", stopping=" << m_stopping
+       << ", tasks=" << m_taskCount
+       << ", global_queue=" << m_fiberListSize
        << "]" << std::endl << "   ";
+    static const char* s_lane_names[PRIORITY_COUNT] = {"high", "normal", "background"};
+    for (int i = 0; i < PRIORITY_COUNT; ++i) {
+        if (i) {
+            os << ", ";
+        }
+        LaneStats stats = getLaneStats((Priority)i);
+        os << "[lane=" << s_lane_names[i]
+           << " weight=" << s_lane_weights[i]
+           << " depth=" << stats.depth
+           << " dequeued=" << stats.dequeued
+           << " avg_wait_us=" << (uint64_t)stats.avgWaitUs()
+           << " max_wait_us=" << stats.maxWaitUs
+           << "]";
+    }
+    os << std::endl << "   ";
     for (size_t i = 0; i < m_threadPool.size(); i++) {
         if (i) {
             os << ", ";
         }
         os << m_threadPool[i];
     }
+    os << std::endl << "   ";
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        if (i) {
+            os << ", ";
+        }
+        os << "[worker=" << i
+           << " thread=" << m_workers[i]->threadId
+           << " busy_ms=" << (m_workers[i]->busySince
+                   ? fang::GetCurrentMS() - m_workers[i]->busySince : 0)
+           << " local=" << m_workers[i]->local.size()
+           << " pinned=" << m_workers[i]->pinnedSize
+           << "]";
+    }
     return os;
 }
 
+Scheduler::LaneStats Scheduler::getLaneStats(Priority priority) const {
+    LaneStats stats;
+    if (priority == PRIORITY_NORMAL) {
+        size_t total = m_taskCount;
+        size_t others = m_laneDepth[PRIORITY_HIGH] + m_laneDepth[PRIORITY_BACKGROUND];
+        stats.depth = total > others ? total - others : 0;
+    } else {
+        stats.depth = m_laneDepth[priority];
+    }
+    for (auto w : m_workers) {
+        stats.dequeued += w->dequeued[priority].load(std::memory_order_relaxed);
+        stats.sampled += w->sampled[priority].load(std::memory_order_relaxed);
+        stats.totalWaitUs += w->waitUs[priority].load(std::memory_order_relaxed);
+        uint64_t max = w->maxWaitUs[priority].load(std::memory_order_relaxed);
+        stats.maxWaitUs = max > stats.maxWaitUs ? max : stats.maxWaitUs;
+    }
+    return stats;
+}
+
+int Scheduler::GetTaskPriority() {
+    return t_task_priority;
+}
+
 void Scheduler::tickle() {
-    //FANG_LOG_INFO(g_logger) << "have task to run";
+    //只有认领到一个还没有被通知的睡眠线程才需要唤醒
+    int idx = claimSleeper();
+    if (idx >= 0) {
+        futex_wake(&m_workers[idx]->sleepState);
+    }
 }
 
-bool Scheduler::stopping() {
-    MutexType::Lock lock(m_mutex);
+void Scheduler::tickleWorker(size_t idx) {
+    if (claimWorker(idx)) {
+        futex_wake(&m_workers[idx]->sleepState);
+    }
+}
 
+bool Scheduler::stopping() {
     //FANG_LOG_DEBUG(g_logger) << "run stopping ";
     return m_autoStop && m_stopping 
-        && m_fiberList.empty() && m_activeThreadCount == 0;
+        && m_taskCount == 0 && m_activeThreadCount == 0
+        && m_externalCount == 0;
 }
 
 void Scheduler::idle() {
     FANG_LOG_INFO(g_logger) << "idle";
-    while(!stopping()) { 
+    Worker* self = m_workers[t_worker_index];
+    while (!stopping()) {
+        if (shouldRetire()) {
+            return;
+        }
+        //自旋期间拿到任务说明任务来得密，下次多自旋，否则减半直到直接睡眠
+        uint32_t spin = self->spinLimit < s_idle_spin ? self->spinLimit : s_idle_spin;
+        uint32_t i = 0;
+        for (; i < spin && m_taskCount == 0 && !m_stopping; ++i) {
+            cpu_relax();
+        }
+        if (i < spin) {
+            self->spinLimit = self->spinLimit ? self->spinLimit * 2 : 1;
+        } else {
+            self->spinLimit = spin ? spin / 2 : (s_idle_spin ? 1 : 0);
+        }
+
+        //markSleeping之后要么看到新任务，要么push时的tickle看到SLEEPING并唤醒
+        //弹性调度器中睡眠有超时，醒来后检查是否可以退出
+        if (!markSleeping() && !stopping()) {
+            while (self->sleepState.load() == SLEEPING) {
+                if (futex_wait(&self->sleepState, SLEEPING, m_elastic ? s_retire : 0)) {
+                    break;
+                }
+            }
+        }
+        markAwake();
         fang::Fiber::YieldToHold();
     }
+    //还在睡眠的线程不会再收到任务，唤醒它们检查退出条件
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        tickle();
+    }
 }
 void Scheduler::setThis() {
     t_scheruler = this;
 }
 
+bool Scheduler::markSleeping() {
+    if (t_worker_index == -1) {
+        return m_taskCount > 0;
+    }
+    m_workers[t_worker_index]->sleepState = SLEEPING;
+    //与push中m_taskCount++配对: 要么看到新任务，要么tickle看到SLEEPING
+    return m_taskCount > 0;
+}
+
+bool Scheduler::markAwake() {
+    if (t_worker_index == -1) {
+        return false;
+    }
+    return m_workers[t_worker_index]->sleepState.exchange(RUNNING) == NOTIFIED;
+}
+
+int Scheduler::getWorkerIndex() const {
+    return GetThis() == this ? t_worker_index : -1;
+}
+
+int Scheduler::claimSleeper() {
+    size_t n = m_workers.size();
+    size_t start = m_sleeperCursor++;
+    for (size_t i = 0; i < n; ++i) {
+        size_t idx = (start + i) % n;
+        if (claimWorker(idx)) {
+            return idx;
+        }
+    }
+    return -1;
+}
+
+bool Scheduler::claimWorker(size_t idx) {
+    Worker* w = m_workers[idx];
+    int expected = SLEEPING;
+    return w->sleepState.load() == SLEEPING
+        && w->sleepState.compare_exchange_strong(expected, NOTIFIED);
+}
+
+void Scheduler::releaseNotified() {
+    for (auto w : m_workers) {
+        int expected = NOTIFIED;
+        if (w->sleepState.load(std::memory_order_relaxed) == NOTIFIED
+                && w->sleepState.compare_exchange_strong(expected, SLEEPING)) {
+            return;
+        }
+    }
+}
+
+Scheduler::Worker* Scheduler::getWorker(int thread) {
+    for (auto w : m_workers) {
+        if (w->threadId == thread) {
+            return w;
+        }
+    }
+    return nullptr;
+}
+
+void Scheduler::pinWorker(Worker* w) {
+    auto affinity = g_scheduler_affinity->getValue();
+    auto it = affinity.find(m_name);
+    if (it == affinity.end() || it->second.empty()) {
+        return;
+    }
+    int cpu = it->second[w->index % it->second.size()];
+    if (SetThreadAffinity({cpu})) {
+        FANG_LOG_INFO(g_logger) << m_name << " worker " << w->index
+            << " pinned to cpu " << cpu << " node " << GetThreadNumaNode();
+    }
+}
+
+Scheduler::Worker* Scheduler::registerWorker() {
+    int tid = fang::GetThreadId();
+    size_t idx = 0;
+    if (tid != m_rootThread) {
+        //占用一个空闲的队列，刚退出的弹性线程可能还没有让出，稍等一下
+        for (idx = 0; ; idx = (idx + 1) % m_workers.size()) {
+            bool expected = false;
+            if (m_workers[idx]->used.compare_exchange_strong(expected, true)) {
+                break;
+            }
+            if (idx + 1 == m_workers.size()) {
+                sched_yield();
+            }
+        }
+    }
+    Worker* w = m_workers[idx];
+    {
+        MutexType::Lock lock(w->mutex);
+        w->retired = false;
+        w->sharedStack = false;
+        w->idleSince = 0;
+        w->busySince = 0;
+        w->threadId = tid;
+    }
+    t_worker_index = idx;
+    return w;
+}
+
+void Scheduler::retireWorker(Worker* w) {
+    {
+        MutexType::Lock lock(m_mutex);
+        Thread* cur = Thread::GetThis();
+        for (auto it = m_threadPool.begin(); it != m_threadPool.end(); ++it) {
+            if (it->get() == cur) {
+                m_retired.push_back(*it);
+                m_threadPool.erase(it);
+                break;
+            }
+        }
+        ++m_retireCount;
+        m_lastResize = "retire idle worker " + std::to_string(w->index);
+    }
+    FANG_LOG_INFO(g_logger) << m_name << " worker " << w->index << " retired, live="
+        << m_liveThreads << " max=" << m_maxThreads;
+    w->sleepState = RUNNING;
+    w->spinLimit = 0;
+    t_worker_index = -1;
+    w->used = false;
+}
+
+bool Scheduler::shouldRetire() {
+    if (!m_elastic || t_worker_index == -1 || m_stopping
+            || fang::GetThreadId() == m_rootThread) {
+        return false;
+    }
+    Worker* self = m_workers[t_worker_index];
+    if (self->sharedStack || !self->idleSince || m_taskCount > 0
+            || fang::GetCurrentMS() - self->idleSince < s_retire) {
+        return false;
+    }
+    //保留构造时的线程数
+    size_t live = m_liveThreads;
+    do {
+        if (live <= m_threadCount) {
+            return false;
+        }
+    } while (!m_liveThreads.compare_exchange_weak(live, live - 1));
+
+    MutexType::Lock lock(self->mutex);
+    if (self->pinnedSize > 0 || self->local.size() > 0) {
+        ++m_liveThreads;
+        return false;
+    }
+    //之后getWorker找不到它，投递给它的任务改由任意线程执行
+    self->retired = true;
+    self->threadId = -1;
+    return true;
+}
+
+void Scheduler::monitor() {
+    uint64_t backlog_since = 0;
+    while (!m_monitorStop) {
+        uint32_t delay = s_grow_delay ? s_grow_delay : 1;
+        usleep(delay * 500);
+        joinRetired();
+        //有任务在等待且没有空闲线程，持续超过阈值就扩容
+        if (m_taskCount == 0 || m_idleThreadCount > 0) {
+            backlog_since = 0;
+            continue;
+        }
+        uint64_t now = fang::GetCurrentMS();
+        if (!backlog_since) {
+            backlog_since = now;
+            continue;
+        }
+        if (now - backlog_since < delay) {
+            continue;
+        }
+        size_t blocked = 0;
+        for (auto w : m_workers) {
+            uint64_t since = w->busySince;
+            if (since && now - since >= delay) {
+                ++blocked;
+            }
+        }
+        grow(blocked ? "workers blocked" : "queue delay");
+        backlog_since = 0;
+    }
+}
+
+void Scheduler::grow(const char* reason) {
+    MutexType::Lock lock(m_mutex);
+    if (m_stopping || m_liveThreads >= m_maxThreads) {
+        return;
+    }
+    ++m_liveThreads;
+    ++m_growCount;
+    m_lastResize = reason;
+    m_threadPool.push_back(Thread::ptr(new Thread(std::bind(&Scheduler::run, this)
+                    , m_name + "_e" + std::to_string(m_growCount))));
+    FANG_LOG_INFO(g_logger) << m_name << " grow: " << reason << ", live="
+        << m_liveThreads << " max=" << m_maxThreads << " tasks=" << m_taskCount;
+}
+
+void Scheduler::joinRetired() {
+    std::vector<Thread::ptr> thrs;
+    {
+        MutexType::Lock lock(m_mutex);
+        thrs.swap(m_retired);
+    }
+    for (auto& i : thrs) {
+        i->join();
+    }
+}
+
+void Scheduler::bindThread(FiberAndThread* task) {
+    if (task->fiber && task->fiber->getBoundThread() != -1) {
+        //共享栈协程的栈内容只在绑定线程的共享栈上，只能回到该线程执行
+        FANG_ASSERT(task->threadId == -1
+                || task->threadId == task->fiber->getBoundThread());
+        task->threadId = task->fiber->getBoundThread();
+    }
+}
+
+bool Scheduler::push(FiberAndThread* task) {
+    bool need_tickle = (m_taskCount++ == 0);
+    Worker* cur = (GetThis() == this && t_worker_index != -1)
+        ? m_workers[t_worker_index] : nullptr;
+    bindThread(task);
+    assignLane(task);
+    if (task->threadId != -1) {
+        //指定线程的任务直接投递到该线程的队列，不会被窃取
+        Worker* w = getWorker(task->threadId);
+        if (w && pushPinned(w, task)) {
+            if (w != cur) {
+                //只有目标线程能执行，直接唤醒它
+                tickleWorker(w->index);
+                return false;
+            }
+            return need_tickle;
+        }
+    } else if (cur && task->lane == PRIORITY_NORMAL) {
+        //工作线程自己产生的普通任务放入本地队列
+        if (cur->local.push(task)) {
+            return need_tickle;
+        }
+    }
+
+    //非工作线程提交的任务、其他优先级的任务、本地队列已满、指定线程尚未启动，放入全局队列
+    MutexType::Lock lock(m_mutex);
+    m_lanes[task->lane].push_back(task);
+    ++m_fiberListSize;
+    return need_tickle;
+}
+
+bool Scheduler::pushPinned(Worker* w, FiberAndThread* task) {
+    MutexType::Lock lock(w->mutex);
+    if (w->retired) {
+        //弹性线程已经退出，任意线程都可以执行
+        task->threadId = -1;
+        return false;
+    }
+    w->pinned[task->lane].push_back(task);
+    ++w->pinnedSize;
+    return true;
+}
+
+void Scheduler::assignLane(FiberAndThread* task) {
+    int priority = task->flags & TASK_PRIORITY_MASK;
+    if (priority) {
+        task->lane = (priority >> 2) - 1;
+    } else if (task->fiber) {
+        task->lane = task->fiber->m_priority;
+    } else {
+        task->lane = t_task_priority;
+    }
+    if (task->fiber) {
+        task->fiber->m_priority = task->lane;
+    } else if (Fiber::HasInheritableLocals()) {
+        //回调带上提交者的可继承局部变量(跟踪id等)
+        task->cb = FiberLocalContext::Capture().wrap(std::move(task->cb));
+    }
+    //普通任务的数量由m_taskCount推算，其他优先级的队列从空变为有任务时重新开始计算饥饿时间
+    if (task->lane != PRIORITY_NORMAL && m_laneDepth[task->lane]++ == 0) {
+        m_laneServed[task->lane] = GetCoarseMS();
+    }
+    //普通任务的排队时间抽样统计，省去大部分精确时钟的读取
+    if (task->lane != PRIORITY_NORMAL || (++t_wait_sample & WAIT_SAMPLE_MASK) == 0) {
+        task->enqueueUs = GetMonotonicUS();
+    }
+}
+
+Scheduler::TaskBatch::~TaskBatch() {
+    for (auto i : m_tasks) {
+        delete i;
+    }
+}
+
+void Scheduler::schedul(TaskBatch& batch) {
+    FANG_ASSERT(batch.m_scheduler == this);
+    if (batch.m_tasks.empty()) {
+        return ;
+    }
+    bool need_tickle = (m_taskCount.fetch_add(batch.m_tasks.size()) == 0);
+    Worker* cur = (GetThis() == this && t_worker_index != -1)
+        ? m_workers[t_worker_index] : nullptr;
+
+    //按目标队列分组，指定线程的任务按工作线程分组
+    std::vector<std::list<FiberAndThread*> > pinned(m_workers.size());
+    std::list<FiberAndThread*> global;
+    bool shared = false;    //是否有不只是给其他指定线程的任务
+    for (auto task : batch.m_tasks) {
+        bindThread(task);
+        assignLane(task);
+        if (task->threadId != -1) {
+            Worker* w = getWorker(task->threadId);
+            if (w) {
+                pinned[w->index].push_back(task);
+                shared = shared || w == cur;
+                continue;
+            }
+        } else if (cur && task->lane == PRIORITY_NORMAL && cur->local.push(task)) {
+            shared = true;
+            continue;
+        }
+        global.push_back(task);
+        shared = true;
+    }
+    batch.m_tasks.clear();
+
+    for (size_t i = 0; i < pinned.size(); ++i) {
+        if (pinned[i].empty()) {
+            continue;
+        }
+        Worker* w = m_workers[i];
+        size_t n = pinned[i].size();
+        {
+            MutexType::Lock lock(w->mutex);
+            if (w->retired) {
+                //弹性线程已经退出，改为任意线程执行
+                for (auto task : pinned[i]) {
+                    task->threadId = -1;
+                }
+                global.splice(global.end(), pinned[i]);
+                shared = true;
+                continue;
+            }
+            while (!pinned[i].empty()) {
+                auto& lane = w->pinned[pinned[i].front()->lane];
+                lane.splice(lane.end(), pinned[i], pinned[i].begin());
+            }
+            w->pinnedSize += n;
+        }
+        if (w != cur) {
+            tickleWorker(i);
+        }
+    }
+    if (!global.empty()) {
+        size_t n = global.size();
+        MutexType::Lock lock(m_mutex);
+        while (!global.empty()) {
+            auto& lane = m_lanes[global.front()->lane];
+            lane.splice(lane.end(), global, global.begin());
+        }
+        m_fiberListSize += n;
+    }
+    //一个线程醒来后发现还有任务会继续唤醒下一个
+    if (need_tickle && shared) {
+        tickle();
+    }
+}
+
+Scheduler::FiberAndThread* Scheduler::take(Worker* self) {
+    size_t high = m_laneDepth[PRIORITY_HIGH];
+    size_t background = m_laneDepth[PRIORITY_BACKGROUND];
+    //只有普通任务时不需要选择优先级
+    if (high == 0 && background == 0) {
+        return takeLane(self, PRIORITY_NORMAL);
+    }
+    int lanes = (high ? 1 << PRIORITY_HIGH : 0)
+        | (background ? 1 << PRIORITY_BACKGROUND : 0)
+        | (m_taskCount > high + background ? 1 << PRIORITY_NORMAL : 0);
+    int lane = pickLane(self, lanes);
+    FiberAndThread* task = takeLane(self, lane);
+    //选中的优先级的任务可能都指定给了其他线程，按优先级顺序取其他的
+    for (int i = 0; !task && i < PRIORITY_COUNT; ++i) {
+        if (i != lane && (lanes & (1 << i))) {
+            task = takeLane(self, i);
+        }
+    }
+    return task;
+}
+
+int Scheduler::pickLane(Worker* self, int lanes) {
+    //有任务的优先级太久没有被取过，先取等得最久的
+    if (s_starvation) {
+        uint64_t now = GetCoarseMS();
+        int starved = -1;
+        uint64_t oldest = now;
+        for (int i = 0; i < PRIORITY_COUNT; ++i) {
+            uint64_t served = m_laneServed[i];
+            if ((lanes & (1 << i)) && served + s_starvation <= now && served < oldest) {
+                starved = i;
+                oldest = served;
+            }
+        }
+        if (starved != -1) {
+            return starved;
+        }
+    }
+
+    //平滑加权轮转: 有任务的优先级加上各自的权值，取最大的，被选中的减去总权值
+    int total = 0;
+    int best = -1;
+    for (int i = 0; i < PRIORITY_COUNT; ++i) {
+        if (!(lanes & (1 << i))) {
+            self->credit[i] = 0;
+            continue;
+        }
+        self->credit[i] += s_lane_weights[i];
+        total += s_lane_weights[i];
+        if (best == -1 || self->credit[i] > self->credit[best]) {
+            best = i;
+        }
+    }
+    self->credit[best] -= total;
+    return best;
+}
+
+Scheduler::FiberAndThread* Scheduler::takeLane(Worker* self, int lane) {
+    FiberAndThread* task = nullptr;
+    if (self->pinnedSize > 0) {
+        MutexType::Lock lock(self->mutex);
+        if (!self->pinned[lane].empty()) {
+            task = self->pinned[lane].front();
+            self->pinned[lane].pop_front();
+            --self->pinnedSize;
+            return task;
+        }
+    }
+
+    //本地队列只有普通任务
+    if (lane == PRIORITY_NORMAL) {
+        task = self->local.pop();
+        if (task) {
+            return task;
+        }
+    }
+
+    if (m_fiberListSize > 0) {
+        MutexType::Lock lock(m_mutex);
+        std::list<FiberAndThread*>& list = m_lanes[lane];
+        auto it = list.begin();
+        while (it != list.end()) {
+            if ((*it)->threadId != -1 && (*it)->threadId != self->threadId) {
+                ++it;
+                continue;
+            }
+            task = *it;
+            list.erase(it);
+            --m_fiberListSize;
+            return task;
+        }
+    }
+
+    if (lane != PRIORITY_NORMAL) {
+        return nullptr;
+    }
+    //从其他线程的本地队列窃取
+    size_t n = m_workers.size();
+    for (size_t i = 1; i < n; ++i) {
+        Worker* w = m_workers[(t_worker_index + i) % n];
+        task = w->local.steal();
+        if (task) {
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+void Scheduler::onDequeue(Worker* self, FiberAndThread* task) {
+    int lane = task->lane;
+    if (lane != PRIORITY_NORMAL) {
+        --m_laneDepth[lane];
+    }
+    //只有普通任务时不会饥饿，不需要记录
+    if (lane != PRIORITY_NORMAL || m_laneDepth[PRIORITY_HIGH] || m_laneDepth[PRIORITY_BACKGROUND]) {
+        uint64_t now_ms = GetCoarseMS();
+        if (m_laneServed[lane].load(std::memory_order_relaxed) != now_ms) {
+            m_laneServed[lane].store(now_ms, std::memory_order_relaxed);
+        }
+    }
+    //统计只由本线程修改，不需要原子的读改写
+    self->dequeued[lane].store(self->dequeued[lane].load(std::memory_order_relaxed) + 1
+            , std::memory_order_relaxed);
+    if (!task->enqueueUs) {
+        return;
+    }
+    uint64_t now = GetMonotonicUS();
+    uint64_t wait = now > task->enqueueUs ? now - task->enqueueUs : 0;
+    self->sampled[lane].store(self->sampled[lane].load(std::memory_order_relaxed) + 1
+            , std::memory_order_relaxed);
+    self->waitUs[lane].store(self->waitUs[lane].load(std::memory_order_relaxed) + wait
+            , std::memory_order_relaxed);
+    if (wait > self->maxWaitUs[lane].load(std::memory_order_relaxed)) {
+        self->maxWaitUs[lane].store(wait, std::memory_order_relaxed);
+    }
+}
+
 void Scheduler::run() {
     //FANG_LOG_DEBUG(g_logger) << "DEBUG ---->"
                     //<< fang::Thread::GetThis()->getId()
@@ -166,38 +944,47 @@ void Scheduler::run() {
         t_scheruler_fiber = Fiber::GetThis().get();
     }
 
+    Worker* self = registerWorker();
+    if (fang::GetThreadId() != m_rootThread) {
+        pinWorker(self);
+    }
+
     Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
     Fiber::ptr cb_fiber;
+    Fiber::ptr shared_cb_fiber;
     FiberAndThread ft;
     while(true){
         ft.reset();
+        t_task_priority = PRIORITY_NORMAL;
+        if (m_elastic && self->busySince) {
+            self->busySince = 0;
+        }
         bool tickle_me = false;
         bool is_active = false;
-        {
-            MutexType::Lock lock(m_mutex);
-            auto it = m_fiberList.begin();
-            while(it != m_fiberList.end()) {
-                if (it->threadId != -1 && it->threadId != fang::GetThreadId()) {
-                    ++it;
-                    tickle_me = true;
-                    continue;
-                }
-
-                FANG_ASSERT(it->fiber || it->cb);
-
-                if (it->fiber && it->fiber->getState() == Fiber::EXEC) {
-                    ++it;
-                    continue;
-                }
-
-                ft = *it;
-                m_fiberList.erase(it++);
-                ++m_activeThreadCount;
-                is_active = true;
-                break;
+        FiberAndThread* task = take(self);
+        if (task) {
+            FANG_ASSERT(task->fiber || task->cb);
+            if (task->fiber && task->fiber->getState() == Fiber::EXEC) {
+                //协程还没有切出，放回全局队列稍后再执行
+                MutexType::Lock lock(m_mutex);
+                m_lanes[task->lane].push_back(task);
+                ++m_fiberListSize;
+                continue;
+            }
+            onDequeue(self, task);
+            ft = std::move(*task);
+            delete task;
+            ++m_activeThreadCount;
+            --m_taskCount;
+            is_active = true;
+            //任务中提交的回调默认沿用这个优先级
+            t_task_priority = ft.lane;
+            if (m_elastic) {
+                self->busySince = fang::GetCurrentMS();
+                self->idleSince = 0;
             }
-            tickle_me |= it != m_fiberList.end();
         }
+        tickle_me = m_taskCount > 0;
         if (tickle_me) {
             tickle();
         }
@@ -212,24 +999,42 @@ void Scheduler::run() {
                 ft.fiber->m_state = Fiber::HOLD;
             }
             ft.reset();
+        } else if (ft.cb && (ft.flags & TASK_INLINE)) {
+            //不会让出的回调直接在调度协程上执行，让出时Fiber::YieldTo*会断言
+            Task cb(std::move(ft.cb));
+            ft.reset();
+            try {
+                cb();
+            } catch (std::exception& ex) {
+                FANG_LOG_ERROR(g_logger) << "inline task except: " << ex.what();
+            } catch (...) {
+                FANG_LOG_ERROR(g_logger) << "inline task except: unknown exception";
+            }
+            --m_activeThreadCount;
         } else if (ft.cb) {
-            if (cb_fiber) {
-                cb_fiber->reset(ft.cb);
+            //共享栈任务使用单独的复用协程
+            if (ft.flags & TASK_SHARED_STACK) {
+                self->sharedStack = true;
+            }
+            Fiber::ptr& fiber = (ft.flags & TASK_SHARED_STACK) ? shared_cb_fiber : cb_fiber;
+            if (fiber) {
+                fiber->reset(std::move(ft.cb));
             } else {
-                cb_fiber.reset(new Fiber(ft.cb));
+                fiber.reset(new Fiber(std::move(ft.cb), 0, false, ft.flags & TASK_SHARED_STACK));
             }
+            fiber->m_priority = ft.lane;
             ft.reset();
-            cb_fiber->swapIn();
+            fiber->swapIn();
             --m_activeThreadCount;
-            if (cb_fiber->getState() == Fiber::READY) {
-                schedul(cb_fiber);
-                cb_fiber.reset();
-            } else if (cb_fiber->getState() == Fiber::EXCEPT 
-                    || cb_fiber->getState() == Fiber::TREM) {
-                cb_fiber->reset(nullptr);
+            if (fiber->getState() == Fiber::READY) {
+                schedul(fiber);
+                fiber.reset();
+            } else if (fiber->getState() == Fiber::EXCEPT 
+                    || fiber->getState() == Fiber::TREM) {
+                fiber->reset(nullptr);
             } else {
-                cb_fiber->m_state = Fiber::HOLD;
-                cb_fiber.reset();
+                fiber->m_state = Fiber::HOLD;
+                fiber.reset();
             }
         } else {
             if (is_active) {
@@ -241,15 +1046,25 @@ void Scheduler::run() {
                 break;
             }
 
+            if (m_elastic && !self->idleSince) {
+                self->idleSince = fang::GetCurrentMS();
+            }
             ++m_idleThreadCount;
             idle_fiber->swapIn();
             --m_idleThreadCount;
+            if (self->retired) {
+                //空闲太久的弹性线程，不再取任务
+                break;
+            }
             if (idle_fiber->getState() != Fiber::TREM
                     && idle_fiber->getState() != Fiber::EXCEPT) {
                 idle_fiber->m_state = Fiber::HOLD;
             }
         }
     }
+    if (self->retired) {
+        retireWorker(self);
+    }
 }
 
 }
@@ -66,7 +66,7 @@ namespace fang {
     }
     
     uint64_t Socket::getSendTimeout() {
-        FdCtx::ptr ctx = FdMgr::GetInstance()->get(m_sock);
+        FdCtx* ctx = FdMgr::GetInstance()->get(m_sock);
         if (ctx) {
             return ctx->getTimeout(SO_SNDTIMEO);
         }
@@ -79,7 +79,7 @@ namespace fang {
     }
 
     uint64_t Socket::getRecvTimeout() {
-        FdCtx::ptr ctx = FdMgr::GetInstance()->get(m_sock);
+        FdCtx* ctx = FdMgr::GetInstance()->get(m_sock);
         if (ctx) {
             return ctx->getTimeout(SO_RCVTIMEO);
         }
@@ -112,6 +112,17 @@ namespace fang {
         }
         return true;
     }
+
+    bool Socket::setReusePort() {
+        if (!isValid()) {
+            newSock();
+            if (!isValid()) {
+                return false;
+            }
+        }
+        int val = 1;
+        return setOption(SOL_SOCKET, SO_REUSEPORT, val);
+    }
             
     Socket::ptr Socket::accept() {
         Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
@@ -128,7 +139,7 @@ namespace fang {
     }
 
     bool Socket::init(int sock) {
-        FdCtx::ptr ctx = FdMgr::GetInstance()->get(sock);
+        FdCtx* ctx = FdMgr::GetInstance()->get(sock);
         if (ctx && ctx->isSocket() && !ctx->isClose()) {
             m_sock = sock;
             m_isConnected = true;
@@ -155,7 +166,7 @@ namespace fang {
         }
 
         UnixAddress::ptr uaddr = std::dynamic_pointer_cast<UnixAddress>(addr);
-        if (addr) {
+        if (uaddr) {
             Socket::ptr sock = Socket::CreateUnixTCPScoket();
             if (sock->connect(uaddr)) {
                 return false;
@@ -440,8 +451,8 @@ void Socket::initSock() {
 }
 
 void Socket::newSock() {
-    int sock = socket(m_family, m_type, m_protocol);
-    if (sock != -1){
+    m_sock = socket(m_family, m_type, m_protocol);
+    if (m_sock != -1){
         initSock();
     } else {
         FANG_LOG_ERROR(g_logger) << "socket(" << m_family
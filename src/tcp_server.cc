@@ -11,9 +11,9 @@ namespace fang {
 static fang::Logger::ptr g_logger = FANG_LOG_NAME("system");
 
 
-TcpServer::TcpServer(fang::IOManager* worker
-            , fang::IOManager* io_worker
-            , fang::IOManager* accept_worker)
+TcpServer::TcpServer(fang::IoManager* worker
+            , fang::IoManager* io_worker
+            , fang::IoManager* accept_worker)
         :m_worker(worker)
         ,m_ioWorker(io_worker)
         ,m_acceptWorker(accept_worker)
@@ -41,25 +41,44 @@ bool TcpServer::bind(const std::vector<fang::Address::ptr>& addrs
             , bool ssl) {
     m_ssl = ssl;
     for (auto& addr : addrs) {
-        Socket::ptr sock = ssl ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
-        if (!sock->bind(addr)) {
-            FANG_LOG_ERROR(g_logger) << "bind fail errno=" << errno
-                << "errstr=" << strerror(errno)
-                << " addr=[" << addr->toString() << "]";
-            fails.push_back(addr);
-            continue;
+        //reuseport时每个io线程一个监听socket，unix socket不支持只建一个
+        std::vector<int> threads(1, -1);
+        bool reuse = m_reusePort && addr->getFamily() != AF_UNIX
+            && !m_ioWorker->getThreadIds().empty();
+        if (reuse) {
+            threads = m_ioWorker->getThreadIds();
+            //共享epoll时唤醒不能指定线程，监听socket不固定线程
+            if (!m_ioWorker->isSharded()) {
+                threads.assign(threads.size(), -1);
+            }
         }
-        if (!sock->listen()) {
-            FANG_LOG_ERROR(g_logger) << "listen fail errno=" << errno
-                << " errstr=" << strerror(errno)
-                << " addr=[" << addr->toString() << "]";
-            fails.push_back(addr);
-            continue;
+        for (auto thread : threads) {
+            Socket::ptr sock = ssl ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
+            if (reuse && !sock->setReusePort()) {
+                fails.push_back(addr);
+                break;
+            }
+            if (!sock->bind(addr)) {
+                FANG_LOG_ERROR(g_logger) << "bind fail errno=" << errno
+                    << "errstr=" << strerror(errno)
+                    << " addr=[" << addr->toString() << "]";
+                fails.push_back(addr);
+                break;
+            }
+            if (!sock->listen()) {
+                FANG_LOG_ERROR(g_logger) << "listen fail errno=" << errno
+                    << " errstr=" << strerror(errno)
+                    << " addr=[" << addr->toString() << "]";
+                fails.push_back(addr);
+                break;
+            }
+            m_socks.push_back(sock);
+            m_sockThreads.push_back(thread);
         }
-        m_socks.push_back(sock);
     }
     if (!fails.empty()) {
         m_socks.clear();
+        m_sockThreads.clear();
         return false;
     }
     for (auto& i : m_socks) {
@@ -76,9 +95,15 @@ bool TcpServer::start() {
         return true;
     }
     m_isStop = false;
-    for (auto& sock : m_socks) {
-        m_acceptWorker->schedul(std::bind(&TcpServer::startAccept
-                    , shared_from_this(), sock));
+    for (size_t i = 0; i < m_socks.size(); ++i) {
+        //分片的reuseport监听socket固定在对应的io线程上accept
+        if (m_sockThreads[i] != -1) {
+            m_ioWorker->schedul(std::bind(&TcpServer::startAccept
+                        , shared_from_this(), m_socks[i]), m_sockThreads[i]);
+        } else {
+            m_acceptWorker->schedul(std::bind(&TcpServer::startAccept
+                        , shared_from_this(), m_socks[i]));
+        }
     }
     return true;
 }
@@ -92,15 +117,22 @@ void TcpServer::stop() {
             sock->close();
             }
             m_socks.clear();
+            m_sockThreads.clear();
             });
 }
 
+void TcpServer::setConf(const TcpServerConf& v) {
+    m_conf.reset(new TcpServerConf(v));
+    m_reusePort = v.reuseport;
+}
+
 std::string TcpServer::toString(const std::string& prefix) {
     std::stringstream ss;
     ss << prefix << "[type=" << m_type
         << " name=" << m_name
         << " worker=" << (m_worker ? m_worker->getName() : "UNKKNOW")
         << " accept=" << (m_acceptWorker ? m_acceptWorker->getName() : "UNKNOW")
+        << " reuseport=" << m_reusePort
         << " recv_timeout=" << m_recvTimeout << "]" << std::endl;
     std::string pfx = prefix.empty() ? "    " : prefix;
     for (auto& i : m_socks) {
@@ -109,7 +141,7 @@ std::string TcpServer::toString(const std::string& prefix) {
     return ss.str();
 }
     
-bool loadCertificates(const std::string& cerf_file, const std::string& key_file) {
+bool TcpServer::loadCertificates(const std::string& cerf_file, const std::string& key_file) {
     for (auto& i : m_socks) {
         auto ssl_socket = std::dynamic_pointer_cast<SSLSocket>(i);
         if (ssl_socket) {
@@ -130,8 +162,12 @@ void TcpServer::startAccept(Socket::ptr sock) {
         Socket::ptr client = sock->accept();
         if (client) {
             client->setRecvTimeout(m_recvTimeout);
+            //分片的reuseport连接在接受它的线程上处理，不跨线程
+            bool pin = m_reusePort && m_ioWorker->isSharded()
+                && m_ioWorker == IoManager::GetThis();
             m_ioWorker->schedul(std::bind(&TcpServer::handleClient
-                        , shared_from_this(), client));
+                        , shared_from_this(), client)
+                    , pin ? fang::GetThreadId() : -1);
         } else {
             FANG_LOG_ERROR(g_logger) << "accept errno=" << errno
                 << " errstr=" << strerror(errno);
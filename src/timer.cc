@@ -1,69 +1,64 @@
 #include "../inc/timer.h"
 #include "../inc/helpc.h"
-#include <sys/time.h>
+#include "../inc/scheduler.h"
+#include <time.h>
 
 
 namespace fang {
 
+static std::atomic<size_t> s_wheel_seq{0};
+static thread_local size_t t_wheel_seq = ~(size_t)0;    //当前线程的时间轮序号
 
-bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const {
-    if (!lhs && !rhs) {
-        return false;
-    }
-    if (!lhs) {
-        return true;
-    }
-    if (!rhs) {
-        return false;
-    }
-    if (lhs->m_next < rhs->m_next) {
-        return true;
-    } else if (lhs->m_next > rhs->m_next) {
-        return false;
-    } else {
-        return lhs.get() < rhs.get();
-    }
-}
+//定时器使用单调时钟(GetMonotonicMS)，不受系统时间调整的影响
+
+//循环定时器每次到期调度的任务，共享同一个回调
+struct SharedCall {
+    std::shared_ptr<Task> cb;
+    void operator()() { (*cb)(); }
+};
 
-Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager * tmgr)
+Timer::Timer(uint64_t ms, Task cb, bool recurring, TimerManager * tmgr)
     : m_recurring(recurring)
     , m_ms(ms)
-    , m_cb(cb)
-    , m_TMgr(tmgr) {
-        m_next = GetCurrentMS() + m_ms;//加上设定时间   
+    , m_TMgr(tmgr)
+    , m_priority(Scheduler::GetTaskPriority()) {
+        m_next = GetMonotonicMS() + m_ms;//加上设定时间
+        if (m_recurring && cb) {
+            m_shared = std::make_shared<Task>(std::move(cb));
+            m_cb = SharedCall{m_shared};
+        } else {
+            m_cb = std::move(cb);
+        }
       }
 
-Timer::Timer(uint64_t next) : m_next(next) {};
-
 
 bool Timer::cancel() {
-    //开启写锁
-    RWMutex::WrLock lock(m_TMgr->m_mutex);
+    Timer::ptr self;    //析构在解锁之后
+    TimerManager::Wheel* wheel = m_TMgr->m_wheels[m_wheel];
+    Mutex::Lock lock(wheel->mutex);
 
     if (m_cb) {//该定时器是否设置了处理函数
         m_cb = nullptr;
-        auto it = m_TMgr->m_timers.find(shared_from_this());//在容器中查找
-        m_TMgr->m_timers.erase(it);//删除该定时器
+        m_shared.reset();
+        if (m_level >= 0) {
+            self = std::move(m_self);
+            TimerManager::Unlink(wheel, this);//从时间轮中删除
+        }
         return true;
     }
     return false;
 }
 
 bool Timer::refresh() {
-    //开启读锁
-    RWMutex::WrLock lock(m_TMgr->m_mutex);
-    if (!m_cb) {
+    TimerManager::Wheel* wheel = m_TMgr->m_wheels[m_wheel];
+    Mutex::Lock lock(wheel->mutex);
+    if (!m_cb || m_level < 0) {
         return false;
     }
 
-    auto it = m_TMgr->m_timers.find(shared_from_this());
-    if (it == m_TMgr->m_timers.end()) {
-        return false;
-    }
-
-    m_TMgr->m_timers.erase(it);
-    m_next = GetCurrentMS() + m_ms;
-    m_TMgr->m_timers.insert(shared_from_this());
+    TimerManager::Unlink(wheel, this);
+    m_next = GetMonotonicMS() + m_ms;
+    TimerManager::Link(wheel, this);
     return true;
 }
 
@@ -71,144 +66,303 @@ bool Timer::reset(uint64_t ms, bool from_now) {
     if (ms == m_ms && !from_now) {
         return true;
     }
-    
-    RWMutex::WrLock lock(m_TMgr->m_mutex);
-    if (!m_cb) {
-        return false;
-    }
 
-    auto it = m_TMgr->m_timers.find(shared_from_this());
-    if (it == m_TMgr->m_timers.end()) {
+    TimerManager::Wheel* wheel = m_TMgr->m_wheels[m_wheel];
+    Mutex::Lock lock(wheel->mutex);
+    if (!m_cb || m_level < 0) {
         return false;
     }
 
-    m_TMgr->m_timers.erase(it);
+    TimerManager::Unlink(wheel, this);
     uint64_t start = 0;
     if (from_now) {
-        start = GetCurrentMS();
+        start = GetMonotonicMS();
     } else {
         start = m_next - m_ms;
     }
     m_ms = ms;
     m_next = m_ms + start;
-    m_TMgr->m_timers.insert(shared_from_this());
+    TimerManager::Link(wheel, this);
+    uint64_t next = m_next;
+    lock.unlock();
+
+    m_TMgr->checkFront(next);
     return true;
 }
 
-TimerManager::TimerManager() {
-    m_previouseTime = GetCurrentMS();
+TimerManager::TimerManager(size_t wheels)
+    :m_tickled(false)
+    ,m_nextExpire(~0ull) {
+    uint64_t now = GetMonotonicMS();
+    m_wheels.resize(wheels ? wheels : 1);
+    for (auto& i : m_wheels) {
+        i = new Wheel;
+        i->current = now;
+    }
 }
 
+TimerManager::~TimerManager() {
+    for (auto& wheel : m_wheels) {
+        for (int l = 0; l < WHEEL_LEVELS; ++l) {
+            for (int s = 0; s < WHEEL_SIZE; ++s) {
+                Timer* t = wheel->slots[l][s];
+                while (t) {
+                    Timer* next = t->m_nextNode;
+                    t->m_level = -1;
+                    t->m_self.reset();
+                    t = next;
+                }
+            }
+        }
+        delete wheel;
+    }
+}
+
+TimerManager::Wheel* TimerManager::getWheel(size_t& idx) {
+    if (t_wheel_seq == ~(size_t)0) {
+        t_wheel_seq = s_wheel_seq++;
+    }
+    idx = t_wheel_seq % m_wheels.size();
+    return m_wheels[idx];
+}
 
 //添加一个定时器
-Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, 
+Timer::ptr TimerManager::addTimer(uint64_t ms, Task cb,
         bool recurring) {
-    Timer::ptr timer(new Timer(ms, cb, recurring, this));
-    RWMutex::WrLock lock(m_mutex);
-    addTimer(timer, lock);
-    return timer;    
+    Timer::ptr timer(new Timer(ms, std::move(cb), recurring, this));
+    Wheel* wheel = getWheel(timer->m_wheel);
+    {
+        Mutex::Lock lock(wheel->mutex);
+        timer->m_self = timer;
+        Link(wheel, timer.get());
+    }
+    checkFront(timer->m_next);
+    return timer;
 }
-        
 
-static void OnTimer(std::weak_ptr<void>weak_cond, std::function<void()> cb) {
-    std::shared_ptr<void> tmp = weak_cond.lock();
-    if (tmp) {
-        cb();
+
+//条件还存在时才执行回调
+struct ConditionCall {
+    std::weak_ptr<void> weak_cond;
+    Task cb;
+    void operator()() {
+        std::shared_ptr<void> tmp = weak_cond.lock();
+        if (tmp) {
+            cb();
+        }
     }
-}
+};
 //添加条件定时器
-Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb,
+Timer::ptr TimerManager::addConditionTimer(uint64_t ms, Task cb,
         std::weak_ptr<void> weak_cond, bool recurring) {
-    return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
+    return addTimer(ms, ConditionCall{std::move(weak_cond), std::move(cb)}, recurring);
 }
 
 //获取最近的定时器的时间差
 uint64_t TimerManager::getNextTimer() {
-    RWMutex::RdLock lock(m_mutex);
     m_tickled = false;
-    if (m_timers.empty()) {
-        return ~0;
+    //先清空，扫描期间加入的定时器一定会触发唤醒
+    m_nextExpire = ~0ull;
+    uint64_t next = ~0ull;
+    for (auto& wheel : m_wheels) {
+        Mutex::Lock lock(wheel->mutex);
+        uint64_t v = NextExpire(wheel);
+        if (v < next) {
+            next = v;
+        }
+    }
+    if (next == ~0ull) {
+        return ~0ull;
     }
+    m_nextExpire = next;
 
-    const Timer::ptr& next = *m_timers.begin();
-    uint64_t now_ms = GetCurrentMS();
-    if (now_ms >= next->m_next) {
+    uint64_t now_ms = GetMonotonicMS();
+    if (now_ms >= next) {
         return 0;
     } else {
-        return  next->m_next - now_ms;
+        return  next - now_ms;
     }
 }
 
 //获取需要执行处理函数的定时器的处理函数列表
-void TimerManager::listExpiredCb(std::vector<std::function<void()> > &cbs) {
-    uint64_t now_ms = GetCurrentMS();
+void TimerManager::listExpiredCb(std::vector<Task> &cbs, std::vector<int>* priorities) {
+    uint64_t now_ms = GetMonotonicMS();
     std::vector<Timer::ptr> expired;
-    {
-        RWMutex::RdLock lock(m_mutex);
-        if (m_timers.empty()) {
-            return ;
+    for (auto& wheel : m_wheels) {
+        Mutex::Lock lock(wheel->mutex);
+        if (wheel->current >= now_ms) {
+            continue;
+        }
+        if (wheel->count == 0) {
+            wheel->current = now_ms;
+            continue;
         }
-    }
 
-    RWMutex::WrLock lock(m_mutex);
-    if (m_timers.empty()) {
-        return ;
+        Advance(wheel, now_ms, expired);
+        cbs.reserve(cbs.size() + expired.size());
+        for (auto& timer : expired) {
+            if (priorities) {
+                priorities->push_back(timer->m_priority);
+            }
+            if (timer->m_recurring) {
+                cbs.push_back(SharedCall{timer->m_shared});
+                timer->m_next = now_ms + timer->m_ms;
+                timer->m_self = timer;
+                Link(wheel, timer.get());
+            } else {
+                cbs.push_back(std::move(timer->m_cb));
+            }
+        }
+        lock.unlock();
+        expired.clear();
     }
+}
 
-    bool rollover = detectClockRollover(now_ms);
-    if (!rollover && ((*m_timers.begin())->m_next > now_ms)) {
-        return ;
+//是否有定时器
+bool TimerManager::hasTimer() {
+    for (auto& wheel : m_wheels) {
+        Mutex::Lock lock(wheel->mutex);
+        if (wheel->count) {
+            return true;
+        }
     }
+    return false;
+}
 
-    Timer::ptr now_timer(new Timer(now_ms));
-    auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
-    while (it != m_timers.end() && (*it)->m_next == now_ms) {
-        ++it;
+void TimerManager::checkFront(uint64_t next) {
+    if (next < m_nextExpire && !m_tickled.exchange(true)) {
+        onTimerInsertedAtFront();
     }
+}
 
-    expired.insert(expired.begin(), m_timers.begin(), it);
-    m_timers.erase(m_timers.begin(), it);
-
-    cbs.reserve(expired.size());
+void TimerManager::Link(Wheel* wheel, Timer* timer) {
+    //base是下一个还没有处理的时间，降级时等于正在处理的边界
+    uint64_t base = wheel->current + 1;
+    uint64_t expire = timer->m_next > base ? timer->m_next : base;
+    uint64_t delta = expire - base;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1
+            && delta >= (1ull << (WHEEL_BITS * (level + 1)))) {
+        ++level;
+    }
+    //超过时间轮范围的放在最高层，降级时会按真实时间重新放置
+    uint64_t range = 1ull << (WHEEL_BITS * WHEEL_LEVELS);
+    if (delta >= range) {
+        expire = base + range - 1;
+    }
+    int slot = (expire >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+    Timer*& head = wheel->slots[level][slot];
+    timer->m_level = level;
+    timer->m_slot = slot;
+    timer->m_prevNode = nullptr;
+    timer->m_nextNode = head;
+    if (head) {
+        head->m_prevNode = timer;
+    }
+    head = timer;
+    wheel->bitmap[level] |= 1ull << slot;
+    ++wheel->count;
+}
 
-    for (auto& timer : expired) {
-        cbs.push_back(timer->m_cb);
-        if (timer->m_recurring) {
-            timer->m_next = now_ms + timer->m_ms;
-            m_timers.insert(timer);
-        } else {
-            timer->m_cb = nullptr;
+void TimerManager::Unlink(Wheel* wheel, Timer* timer) {
+    if (timer->m_prevNode) {
+        timer->m_prevNode->m_nextNode = timer->m_nextNode;
+    } else {
+        wheel->slots[timer->m_level][timer->m_slot] = timer->m_nextNode;
+        if (!timer->m_nextNode) {
+            wheel->bitmap[timer->m_level] &= ~(1ull << timer->m_slot);
         }
     }
+    if (timer->m_nextNode) {
+        timer->m_nextNode->m_prevNode = timer->m_prevNode;
+    }
+    timer->m_prevNode = timer->m_nextNode = nullptr;
+    timer->m_level = -1;
+    --wheel->count;
 }
 
-void TimerManager::addTimer(Timer::ptr val, RWMutex::WrLock& lock) {
-    auto it = m_timers.insert(val).first;
-    bool at_front = (it == m_timers.begin()) && !m_tickled;
-    if (at_front) {
-        m_tickled = true;
+void TimerManager::Cascade(Wheel* wheel, int level, uint64_t tick) {
+    int slot = (tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    Timer* timer = wheel->slots[level][slot];
+    if (!timer) {
+        return;
     }
-    lock.unlock();
-
-    if (at_front) {
-        //tickle()
+    wheel->slots[level][slot] = nullptr;
+    wheel->bitmap[level] &= ~(1ull << slot);
+    while (timer) {
+        Timer* next = timer->m_nextNode;
+        --wheel->count;
+        Link(wheel, timer);
+        timer = next;
     }
 }
-//是否有定时器
-bool TimerManager::hasTimer() {
-    RWMutex::RdLock lock(m_mutex);
-    return m_timers.empty();
+
+void TimerManager::Advance(Wheel* wheel, uint64_t now, std::vector<Timer::ptr>& expired) {
+    while (wheel->current < now) {
+        if (wheel->count == 0) {
+            wheel->current = now;
+            break;
+        }
+        uint64_t tick = wheel->current + 1;
+        //到达上层槽位的边界，先把上层对应槽位的定时器降下来，高层先降
+        if ((tick & WHEEL_MASK) == 0) {
+            int top = 1;
+            while (top < WHEEL_LEVELS - 1
+                    && ((tick >> (WHEEL_BITS * top)) & WHEEL_MASK) == 0) {
+                ++top;
+            }
+            for (int l = top; l >= 1; --l) {
+                Cascade(wheel, l, tick);
+            }
+        }
+        wheel->current = tick;
+
+        int pos = tick & WHEEL_MASK;
+        Timer* timer = wheel->slots[0][pos];
+        if (timer) {
+            wheel->slots[0][pos] = nullptr;
+            wheel->bitmap[0] &= ~(1ull << pos);
+            while (timer) {
+                Timer* next = timer->m_nextNode;
+                timer->m_prevNode = timer->m_nextNode = nullptr;
+                timer->m_level = -1;
+                --wheel->count;
+                expired.push_back(std::move(timer->m_self));
+                timer = next;
+            }
+        }
+
+        //跳过本层中间的空槽位，直接到下一个非空槽位或者下一个边界
+        uint64_t rest = pos == WHEEL_MASK ? 0 : (wheel->bitmap[0] >> (pos + 1)) << (pos + 1);
+        uint64_t target = rest ? (tick & ~(uint64_t)WHEEL_MASK) + __builtin_ctzll(rest)
+                               : (tick | WHEEL_MASK) + 1;
+        if (target - 1 > wheel->current) {
+            wheel->current = target - 1 < now ? target - 1 : now;
+        }
+    }
 }
 
-//检测服务器时间是否被调后
-bool TimerManager::detectClockRollover(uint64_t now_ms) {
-    bool rollover = false;
-    if (now_ms < m_previouseTime &&
-            now_ms < (m_previouseTime -60 * 60 * 1000)) {
-        rollover = true;
+uint64_t TimerManager::NextExpire(Wheel* wheel) {
+    if (wheel->count == 0) {
+        return ~0ull;
+    }
+    uint64_t next = ~0ull;
+    for (int l = 0; l < WHEEL_LEVELS; ++l) {
+        uint64_t bitmap = wheel->bitmap[l];
+        if (!bitmap) {
+            continue;
+        }
+        //从下一个槽位开始找第一个非空槽位，高层得到的是降级时间
+        uint64_t block = wheel->current >> (WHEEL_BITS * l);
+        int start = (block + 1) & WHEEL_MASK;
+        uint64_t rot = start ? (bitmap >> start) | (bitmap << (WHEEL_SIZE - start)) : bitmap;
+        uint64_t tick = (block + 1 + __builtin_ctzll(rot)) << (WHEEL_BITS * l);
+        if (tick < next) {
+            next = tick;
+        }
     }
-    m_previouseTime = now_ms;
-    return rollover;
+    return next;
 }
 
 
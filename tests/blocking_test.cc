@@ -0,0 +1,66 @@
+#include "../inc/blocking.h"
+#include "../inc/iomanager.h"
+#include "../inc/address.h"
+#include "../inc/helpc.h"
+#include "../inc/log.h"
+#include <stdexcept>
+#include <unistd.h>
+
+fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+static int s_ticks = 0;
+
+//模拟不能hook的阻塞调用，池中的线程不开启hook，usleep真正阻塞线程
+static int slow_square(int v) {
+    usleep(100 * 1000);
+    return v * v;
+}
+
+void test_await(int v) {
+    uint64_t start = fang::GetCurrentMS();
+    int rt = fang::await_blocking([v]() { return slow_square(v); });
+    FANG_LOG_INFO(g_logger) << "await_blocking " << v << "^2=" << rt
+        << " used=" << fang::GetCurrentMS() - start << "ms ticks=" << s_ticks;
+}
+
+void test_exception() {
+    try {
+        fang::await_blocking([]() { throw std::runtime_error("blocking error"); });
+    } catch (std::exception& ex) {
+        FANG_LOG_INFO(g_logger) << "await_blocking rethrow: " << ex.what();
+    }
+}
+
+//不是std::exception的异常只记录日志，协程照常被重新调度
+void test_unknown_exception() {
+    fang::BlockingPool::GetDefault()->await([]() { throw 42; });
+    FANG_LOG_INFO(g_logger) << "await resumed after unknown exception";
+}
+
+void test_lookup() {
+    fang::Address::ptr addr = fang::Address::LookupAny("localhost:80");
+    FANG_LOG_INFO(g_logger) << "lookup localhost: " << (addr ? addr->toString() : "null");
+}
+
+int main() {
+    //只有一个io线程，阻塞调用放到池中后其他协程照常执行
+    fang::IoManager iom(1, false, "blocking");
+    iom.schedul([]() {
+        for (int i = 0; i < 20; ++i) {
+            ++s_ticks;
+            usleep(10 * 1000);
+        }
+    });
+    for (int i = 1; i <= 8; ++i) {
+        iom.schedul(std::bind(&test_await, i));
+    }
+    iom.schedul(&test_exception);
+    iom.schedul(&test_unknown_exception);
+    iom.schedul(&test_lookup);
+    iom.stop();
+
+    std::stringstream ss;
+    fang::BlockingPool::GetDefault()->dump(ss);
+    FANG_LOG_INFO(g_logger) << ss.str();
+    return 0;
+}
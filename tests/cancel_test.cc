@@ -0,0 +1,121 @@
+#include "../inc/cancel.h"
+#include "../inc/fd_manager.h"
+#include "../inc/fiber_sync.h"
+#include "../inc/future.h"
+#include "../inc/helpc.h"
+#include "../inc/iomanager.h"
+#include "../inc/log.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+static fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+//截止时间到达后hook的recv返回ETIMEDOUT，子协程沿用同一个令牌
+void test_deadline() {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    fang::FdMgr::GetInstance()->get(fds[0], true);
+    fang::CancelScope scope(fang::CancelToken::WithTimeout(100));
+
+    fang::Future<bool> same = fang::async_on(fang::IoManager::GetThis(), []() {
+        return fang::CancelToken::GetCurrent() != nullptr;
+    });
+    FANG_LOG_INFO(g_logger) << "child inherits token=" << same.get();
+
+    char buf[16];
+    uint64_t start = fang::GetCurrentMS();
+    ssize_t rt = recv(fds[0], buf, sizeof(buf), 0);
+    FANG_LOG_INFO(g_logger) << "recv rt=" << rt << " errno=" << strerror(errno)
+        << " used=" << fang::GetCurrentMS() - start << "ms";
+
+    //已经超时的令牌不再等待
+    start = fang::GetCurrentMS();
+    rt = recv(fds[0], buf, sizeof(buf), 0);
+    FANG_LOG_INFO(g_logger) << "recv again rt=" << rt << " errno=" << strerror(errno)
+        << " used=" << fang::GetCurrentMS() - start << "ms";
+    close(fds[0]);
+    close(fds[1]);
+}
+
+//其他协程主动取消，等待中的recv和信号量立即返回
+void test_cancel() {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    fang::FdMgr::GetInstance()->get(fds[0], true);
+    fang::CancelToken::ptr token(new fang::CancelToken);
+    fang::IoManager::GetThis()->schedul([token]() {
+        usleep(50 * 1000);
+        token->cancel();
+    });
+
+    fang::CancelScope scope(token);
+    char buf[16];
+    uint64_t start = fang::GetCurrentMS();
+    ssize_t rt = recv(fds[0], buf, sizeof(buf), 0);
+    FANG_LOG_INFO(g_logger) << "cancelled recv rt=" << rt << " errno=" << strerror(errno)
+        << " used=" << fang::GetCurrentMS() - start << "ms";
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void test_semaphore() {
+    fang::FiberSemaphore sem(0);
+    fang::CancelScope scope(fang::CancelToken::WithTimeout(100));
+    uint64_t start = fang::GetCurrentMS();
+    bool ok = sem.waitFor(5000);
+    FANG_LOG_INFO(g_logger) << "semaphore waitFor(5000) ok=" << ok
+        << " used=" << fang::GetCurrentMS() - start << "ms";
+}
+
+//监听队列为0且已经被不accept的连接占满，新的SYN被丢弃，连接在截止时间到达时放弃
+void test_connect() {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listen_fd, (const sockaddr*)&addr, sizeof(addr));
+    listen(listen_fd, 0);
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, (sockaddr*)&addr, &len);
+
+    //用户设置非阻塞的socket不经过hook，发起连接后不等待
+    std::vector<int> fillers;
+    for (int i = 0; i < 4; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        connect(fd, (const sockaddr*)&addr, sizeof(addr));
+        fillers.push_back(fd);
+    }
+    usleep(50 * 1000);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    fang::CancelScope scope(fang::CancelToken::WithTimeout(200));
+    uint64_t start = fang::GetCurrentMS();
+    int rt = connect(fd, (const sockaddr*)&addr, sizeof(addr));
+    int err = errno;
+    FANG_LOG_INFO(g_logger) << "connect rt=" << rt << " errno=" << strerror(err)
+        << " used=" << fang::GetCurrentMS() - start << "ms";
+    close(fd);
+    for (int i : fillers) {
+        close(i);
+    }
+    close(listen_fd);
+}
+
+int main() {
+    fang::IoManager iom(2, false, "cancel");
+    iom.schedul([]() {
+        test_deadline();
+        test_cancel();
+        test_semaphore();
+        test_connect();
+    });
+    iom.stop();
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "../inc/channel.h"
+#include "../inc/iomanager.h"
+#include "../inc/helpc.h"
+#include "../inc/log.h"
+#include <unistd.h>
+
+fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+static const int s_producers = 4;
+static const int s_items = 100000;
+
+void test_mpmc(fang::IoManager& iom) {
+    auto ch = std::make_shared<fang::Channel<std::unique_ptr<int> > >(128);
+    auto sum = std::make_shared<std::atomic<long> >(0);
+    auto left = std::make_shared<std::atomic<int> >(s_producers);
+    uint64_t start = fang::GetCurrentMS();
+
+    for (int i = 0; i < s_producers; ++i) {
+        iom.schedul([ch, left]() {
+            for (int j = 1; j <= s_items; ++j) {
+                ch->send(std::unique_ptr<int>(new int(j)));
+            }
+            if (--(*left) == 0) {
+                ch->close();
+            }
+        });
+    }
+    for (int i = 0; i < 4; ++i) {
+        iom.schedul([ch, sum, start, i]() {
+            std::unique_ptr<int> v;
+            long n = 0;
+            while (ch->recv(v)) {
+                *sum += *v;
+                ++n;
+            }
+            FANG_LOG_INFO(g_logger) << "consumer " << i << " recv " << n
+                << " sum=" << *sum << " used=" << fang::GetCurrentMS() - start << "ms";
+        });
+    }
+}
+
+void test_select() {
+    fang::Channel<int> a(4), b(4);
+    fang::Channel<std::string> quit(2);
+
+    fang::IoManager::GetThis()->schedul([&a, &b, &quit]() {
+        for (int i = 0; i < 10; ++i) {
+            (i % 2 ? a : b).send(i);
+        }
+        quit.send("quit");
+    });
+
+    int va = 0, vb = 0;
+    std::string msg;
+    int count = 0;
+    while (true) {
+        fang::Selector sel;
+        sel.recv(a, va);
+        sel.recv(b, vb);
+        sel.recv(quit, msg);
+        int idx = sel.select();
+        if (idx == 2) {
+            break;
+        }
+        ++count;
+    }
+    //quit可能先于a/b中剩余的数据被选中
+    while (a.tryRecv(va) || b.tryRecv(vb)) {
+        ++count;
+    }
+    FANG_LOG_INFO(g_logger) << "select recv " << count << " msg=" << msg;
+
+    fang::Selector sel;
+    sel.recv(a, va);
+    int idx = sel.select(100);
+    FANG_LOG_INFO(g_logger) << "select timeout idx=" << idx;
+}
+
+//两个select和一个普通接收者在两个通道上竞争，唤醒不能丢失，所有数据都要被取走
+void test_select_race() {
+    static const int s_count = 20000;
+    auto a = std::make_shared<fang::Channel<int> >(1);
+    auto b = std::make_shared<fang::Channel<int> >(1);
+    auto received = std::make_shared<std::atomic<int> >(0);
+    fang::IoManager* iom = fang::IoManager::GetThis();
+
+    for (auto ch : {a, b}) {
+        iom->schedul([ch]() {
+            for (int i = 0; i < s_count; ++i) {
+                ch->send(i);
+            }
+        });
+    }
+    for (int i = 0; i < 2; ++i) {
+        iom->schedul([a, b, received]() {
+            int va = 0, vb = 0;
+            while (true) {
+                bool ok = false;
+                fang::Selector sel;
+                sel.recv(*a, va, &ok);
+                sel.recv(*b, vb, &ok);
+                if (sel.select() < 0 || !ok) {
+                    break;
+                }
+                ++*received;
+            }
+        });
+    }
+    iom->schedul([a, received]() {
+        int v = 0;
+        while (a->recv(v)) {
+            ++*received;
+        }
+    });
+
+    //丢失唤醒时剩余的数据留在通道里，接收者一直睡眠
+    uint64_t start = fang::GetCurrentMS();
+    while (*received < 2 * s_count && fang::GetCurrentMS() - start < 5000) {
+        usleep(10 * 1000);
+    }
+    FANG_LOG_INFO(g_logger) << "select race received=" << *received
+        << " expect " << 2 * s_count;
+    a->close();
+    b->close();
+}
+
+int main()
+{
+    fang::IoManager iom(4, false, "channel");
+    test_mpmc(iom);
+    iom.schedul(&test_select);
+    iom.schedul(&test_select_race);
+    iom.stop();
+    return 0;
+}
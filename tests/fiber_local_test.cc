@@ -0,0 +1,49 @@
+#include "../inc/fiber_local.h"
+#include "../inc/future.h"
+#include "../inc/iomanager.h"
+#include "../inc/log.h"
+#include <unistd.h>
+
+static fang::Logger::ptr g_logger(new fang::Logger("fiber_local"));
+
+static fang::FiberLocal<int> s_request_no;                  //不继承
+static fang::FiberLocal<std::string> s_user(true);          //继承给子协程和回调
+
+void handle_request(int no) {
+    fang::SetTraceId("req-" + std::to_string(no));
+    s_request_no.set(no);
+    s_user.set("user" + std::to_string(no));
+    int tid = fang::GetThreadId();
+    //hook的usleep挂起协程，恢复时可能在其他线程，局部变量跟随协程
+    usleep(10 * 1000);
+    FANG_LOG_INFO(g_logger) << "request_no=" << *s_request_no.get()
+        << " user=" << *s_user.get() << " thread " << tid << "->" << fang::GetThreadId();
+
+    //提交的回调继承跟踪id和user，不继承request_no
+    fang::IoManager::GetThis()->schedul([]() {
+        FANG_LOG_INFO(g_logger) << "callback user=" << s_user.getOr("none")
+            << " request_no=" << (s_request_no.get() ? "set" : "null");
+    });
+    fang::Future<std::string> f = fang::async_on(fang::IoManager::GetThis(), []() {
+        return fang::GetTraceId();
+    });
+    FANG_LOG_INFO(g_logger) << "async_on trace=" << f.get();
+    s_user.set("changed");
+}
+
+int main() {
+    //%X输出跟踪id
+    fang::LogAppender::ptr appender(new fang::ConsoleAppender);
+    appender->setFormatter(fang::LogFormatter::logFormatter_share_ptr(
+                new fang::LogFormatter("%t\t%F\t[%X]\t%m%n")));
+    g_logger->addAppender(appender);
+
+    fang::IoManager iom(4, false, "fiber_local");
+    for (int i = 0; i < 4; ++i) {
+        iom.schedul(std::bind(&handle_request, i));
+    }
+    iom.stop();
+    //复用执行回调的协程不会带上上一个任务的值
+    FANG_LOG_INFO(g_logger) << "main trace=" << fang::GetTraceId() << " user=" << s_user.getOr("none");
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "../inc/scheduler.h"
+#include "../inc/log.h"
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+static std::atomic<uint64_t> s_parked {0};
+
+static uint64_t GetRssBytes() {
+    long pages = 0;
+    long rss = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%ld %ld", &pages, &rss) != 2) {
+            rss = 0;
+        }
+        fclose(fp);
+    }
+    return rss * sysconf(_SC_PAGESIZE);
+}
+
+//模拟一个连接处理了请求后挂起等待下一次读事件
+static int handle_conn(int depth) {
+    volatile char buf[512];
+    for (size_t i = 0; i < sizeof(buf); ++i) {
+        buf[i] = depth;
+    }
+    if (depth > 0) {
+        return handle_conn(depth - 1) + buf[depth];
+    }
+    ++s_parked;
+    fang::Fiber::YieldToHold();
+    return buf[0];
+}
+
+int main(int argc, char** argv) {
+    bool shared = argc > 1 && strcmp(argv[1], "shared") == 0;
+    uint64_t n = argc > 2 ? atoll(argv[2]) : 20000;
+
+    fang::Scheduler sc(1, false, "mem");
+    sc.start();
+
+    std::vector<fang::Fiber::ptr> fibers;
+    fibers.reserve(n);
+    uint64_t rss_before = GetRssBytes();
+    for (uint64_t i = 0; i < n; ++i) {
+        fang::Fiber::ptr fiber(new fang::Fiber([](){
+            handle_conn(4);
+        }, 0, false, shared));
+        fibers.push_back(fiber);
+        sc.schedul(fiber);
+    }
+    while (s_parked < n) {
+        usleep(1000);
+    }
+    uint64_t rss_after = GetRssBytes();
+
+    FANG_LOG_INFO(g_logger) << "mode=" << (shared ? "shared" : "private")
+        << " fibers=" << n
+        << " rss=" << (rss_after - rss_before) / 1024 << "KB"
+        << " per_fiber=" << (rss_after - rss_before) / n << "B"
+        << " stack_mapped=" << fang::Fiber::GetStackStats().mappedBytes / 1024 << "KB";
+
+    for (auto& i : fibers) {
+        sc.schedul(i);
+    }
+    sc.stop();
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include "../inc/fiber.h"
+#include "../inc/fcontext.h"
+#include "../inc/log.h"
+#include <stdlib.h>
+#include <sys/time.h>
+
+static fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+static uint64_t GetCurrentUS() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000 * 1000ul + tv.tv_usec;
+}
+
+int main(int argc, char** argv) {
+    uint64_t n = argc > 1 ? atoll(argv[1]) : 10000000;
+    fang::Fiber::GetThis();
+
+    fang::Fiber::ptr fiber(new fang::Fiber([n](){
+        fang::Fiber* cur = fang::Fiber::GetThis().get();
+        for (uint64_t i = 0; i < n; ++i) {
+            cur->back();
+        }
+    }, 0, true));
+
+    uint64_t start = GetCurrentUS();
+    for (uint64_t i = 0; i <= n; ++i) {
+        fiber->call();
+    }
+    uint64_t used = GetCurrentUS() - start;
+
+    //每次call/back是两次切换
+    FANG_LOG_INFO(g_logger) << "backend=" << (FANG_USE_FCONTEXT ? "fcontext" : "ucontext")
+        << " switches=" << n * 2
+        << " used=" << used << "us"
+        << " switches/s=" << (uint64_t)(n * 2 * 1000000.0 / (used ? used : 1));
+    return 0;
+}
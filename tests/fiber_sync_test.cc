@@ -0,0 +1,84 @@
+#include "../inc/fiber_sync.h"
+#include "../inc/iomanager.h"
+#include "../inc/log.h"
+
+fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+static fang::FiberMutex s_mutex;
+static fang::FiberCondition s_cond;
+static fang::FiberSemaphore s_sem(0);
+static fang::FiberRWMutex s_rwmutex;
+static int s_count = 0;
+static int s_ready = 0;
+
+void test_mutex() {
+    for (int i = 0; i < 1000; ++i) {
+        fang::FiberMutex::Lock lock(s_mutex);
+        ++s_count;
+        if (i % 100 == 0) {
+            fang::Fiber::YieldToReady();    //持锁切出，其他协程只能挂起等待
+        }
+    }
+}
+
+void test_cond_wait() {
+    fang::FiberMutex::Lock lock(s_mutex);
+    while (!s_ready) {
+        s_cond.wait(s_mutex);
+    }
+    FANG_LOG_INFO(g_logger) << "cond wakeup s_count=" << s_count;
+    s_sem.post();
+}
+
+void test_rwmutex(bool writer) {
+    for (int i = 0; i < 100; ++i) {
+        if (writer) {
+            fang::FiberRWMutex::WrLock lock(s_rwmutex);
+            ++s_count;
+        } else {
+            fang::FiberRWMutex::RdLock lock(s_rwmutex);
+            fang::Fiber::YieldToReady();
+        }
+    }
+}
+
+//post和超时同时发生，等待者返回后信号量立即析构，过期的定时器回调不能再访问它
+void test_timeout_race() {
+    fang::IoManager* iom = fang::IoManager::GetThis();
+    for (int i = 0; i < 2000; ++i) {
+        std::shared_ptr<fang::FiberSemaphore> sem(new fang::FiberSemaphore(0));
+        iom->addTimer(1, [sem]() { sem->post(); });
+        sem->waitFor(1);
+    }
+    FANG_LOG_INFO(g_logger) << "timeout race done";
+}
+
+int main()
+{
+    fang::IoManager iom(4, false, "sync");
+    for (int i = 0; i < 10; ++i) {
+        iom.schedul(&test_mutex);
+    }
+    iom.schedul(&test_cond_wait);
+    iom.schedul(&test_timeout_race);
+    iom.schedul([]() {
+        //没有post，等待超时
+        bool rt = s_sem.waitFor(100);
+        FANG_LOG_INFO(g_logger) << "semaphore waitFor(100) rt=" << rt;
+
+        fang::FiberMutex::Lock lock(s_mutex);
+        s_ready = 1;
+        s_cond.notifyAll();
+        lock.unlock();
+
+        s_sem.wait();
+        FANG_LOG_INFO(g_logger) << "semaphore wait done";
+
+        for (int i = 0; i < 4; ++i) {
+            fang::IoManager::GetThis()->schedul(std::bind(&test_rwmutex, i == 0));
+        }
+    });
+    iom.stop();
+    FANG_LOG_INFO(g_logger) << "s_count=" << s_count;
+    return 0;
+}
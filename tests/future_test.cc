@@ -0,0 +1,70 @@
+#include "../inc/future.h"
+#include "../inc/iomanager.h"
+#include "../inc/helpc.h"
+#include "../inc/log.h"
+#include <stdexcept>
+#include <unistd.h>
+
+fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+//模拟一次后端调用，hook的usleep只挂起协程
+static int backend_call(int v, int delay_ms) {
+    usleep(delay_ms * 1000);
+    return v * v;
+}
+
+void test_when_all(fang::IoManager* iom) {
+    uint64_t start = fang::GetCurrentMS();
+    std::vector<fang::Future<int> > futures;
+    for (int i = 1; i <= 10; ++i) {
+        futures.push_back(fang::async_on(iom, [i]() { return backend_call(i, 100); }));
+    }
+    bool rt = fang::when_all(futures).waitFor(1000);
+    int sum = 0;
+    for (auto& i : futures) {
+        sum += i.get();
+    }
+    FANG_LOG_INFO(g_logger) << "when_all rt=" << rt << " sum=" << sum << " expect 385"
+        << " used=" << fang::GetCurrentMS() - start << "ms";
+}
+
+void test_when_any(fang::IoManager* iom) {
+    fang::Future<int> slow = fang::async_on(iom, []() { return backend_call(2, 300); });
+    fang::Future<int> fast = fang::async_on(iom, []() { return backend_call(3, 50); });
+    size_t idx = fang::when_any(slow, fast).get();
+    FANG_LOG_INFO(g_logger) << "when_any idx=" << idx << " expect 1 value=" << fast.get();
+}
+
+void test_timeout_and_exception() {
+    fang::Promise<std::string> never;
+    fang::Future<std::string> f = never.getFuture();
+    bool rt = f.waitFor(100);
+    FANG_LOG_INFO(g_logger) << "waitFor(100) rt=" << rt << " expect 0";
+
+    fang::Future<void> err = fang::async_on(fang::IoManager::GetThis(), []() {
+        throw std::runtime_error("backend error");
+    });
+    try {
+        err.get();
+    } catch (std::exception& ex) {
+        FANG_LOG_INFO(g_logger) << "get rethrow: " << ex.what();
+    }
+}
+
+int main() {
+    fang::IoManager iom(2, false, "future");
+    fang::IoManager other(1, false, "then");
+    iom.schedul(std::bind(&test_when_all, &iom));
+    iom.schedul(std::bind(&test_when_any, &iom));
+    iom.schedul(&test_timeout_and_exception);
+
+    //后续任务在另一个调度器上执行，主线程不在调度器中，get阻塞线程
+    fang::Future<std::string> chained = fang::async_on(&iom, []() { return backend_call(4, 10); })
+        .then(&other, [](fang::Future<int>& f) {
+            return fang::Scheduler::GetThis()->getName() + ":" + std::to_string(f.get());
+        });
+    FANG_LOG_INFO(g_logger) << "then result=" << chained.get() << " expect then:16";
+    iom.stop();
+    other.stop();
+    return 0;
+}
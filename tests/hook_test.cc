@@ -1,12 +1,115 @@
 #include "../inc/hook.h"
+#include "../inc/iomanager.h"
+#include "../inc/helpc.h"
+#include "../inc/log.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
 
+fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+//100个协程同时sleep(1)，总耗时应该在1秒左右
 void test_sleep() {
-    sleep(10);
+    static std::atomic<int> s_done{0};
+    static uint64_t s_start = fang::GetCurrentMS();
+    for (int i = 0; i < 100; ++i) {
+        fang::IoManager::GetThis()->schedul([]() {
+            sleep(1);
+            usleep(10 * 1000);
+            if (++s_done == 100) {
+                FANG_LOG_INFO(g_logger) << "100 fibers sleep used "
+                    << fang::GetCurrentMS() - s_start << "ms";
+            }
+        });
+    }
+}
+
+void test_recv_timeout() {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    fang::FdMgr::GetInstance()->get(fds[0], true);
+    fang::FdMgr::GetInstance()->get(fds[1], true);
+    struct timeval tv = {0, 200 * 1000};
+    setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char buf[16];
+    uint64_t start = fang::GetCurrentMS();
+    ssize_t rt = recv(fds[0], buf, sizeof(buf), 0);
+    FANG_LOG_INFO(g_logger) << "recv rt=" << rt << " errno=" << strerror(errno)
+        << " used=" << fang::GetCurrentMS() - start << "ms";
+
+    fang::IoManager::GetThis()->addTimer(50, [fds]() {
+        write(fds[1], "hello", 5);
+    });
+    rt = recv(fds[0], buf, sizeof(buf), 0);
+    FANG_LOG_INFO(g_logger) << "recv rt=" << rt << " data="
+        << std::string(buf, rt > 0 ? rt : 0);
+    close(fds[0]);
+    close(fds[1]);
 }
 
+void test_connect() {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    bind(listen_fd, (const sockaddr*)&addr, sizeof(addr));
+    listen(listen_fd, 16);
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, (sockaddr*)&addr, &len);
+
+    fang::IoManager::GetThis()->schedul([listen_fd]() {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        char buf[64];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        write(fd, buf, n);
+        close(fd);
+        close(listen_fd);
+    });
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int rt = connect(fd, (const sockaddr*)&addr, sizeof(addr));
+    FANG_LOG_INFO(g_logger) << "connect rt=" << rt;
+    send(fd, "ping", 4, 0);
+    char buf[64];
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    FANG_LOG_INFO(g_logger) << "echo " << std::string(buf, n > 0 ? n : 0);
+    close(fd);
+}
+
+//等待中的fd被关闭，编号立即被新的socket复用，等待者应该得到EBADF而不是读新socket的数据
+void test_close_reuse() {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    fang::FdMgr::GetInstance()->get(fds[0], true);
+    int fd = fds[0];
+    fang::IoManager::GetThis()->schedul([fd]() {
+        char buf[16];
+        ssize_t rt = recv(fd, buf, sizeof(buf), 0);
+        FANG_LOG_INFO(g_logger) << "recv after close rt=" << rt << " errno=" << strerror(errno);
+    });
+    usleep(50 * 1000);
+    close(fds[0]);
+    //dup2保证新socket使用同一个编号
+    int reuse[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, reuse);
+    dup2(reuse[0], fd);
+    fang::FdMgr::GetInstance()->get(fd, true);
+    write(reuse[1], "other", 5);
+    usleep(50 * 1000);
+    close(fd);
+    close(fds[1]);
+    close(reuse[0]);
+    close(reuse[1]);
+}
 
 int main()
 {
-    fang::set_hook_enable(true);
-    test_sleep();
+    fang::IoManager iom(2, false, "hook");
+    iom.schedul(&test_sleep);
+    iom.schedul(&test_recv_timeout);
+    iom.schedul(&test_connect);
+    iom.schedul(&test_close_reuse);
+    return 0;
 }
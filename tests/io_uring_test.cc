@@ -0,0 +1,135 @@
+#include "../inc/iomanager.h"
+#include "../inc/config.h"
+#include "../inc/hook.h"
+#include "../inc/helpc.h"
+#include "../inc/log.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+static const int CLIENTS = 100;
+static const int ROUNDS = 1000;
+static const int PORT = 18766;
+
+static std::atomic<int> s_done{0};
+
+static void handle_client(int fd) {
+    char buf[64];
+    while (true) {
+        int n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            break;
+        }
+        send(fd, buf, n, 0);
+    }
+    close(fd);
+}
+
+static void server(int lfd) {
+    while (true) {
+        int fd = accept(lfd, nullptr, nullptr);
+        if (fd < 0) {
+            break;
+        }
+        fang::IoManager::GetThis()->schedul(std::bind(&handle_client, fd));
+    }
+}
+
+static void client() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+        FANG_LOG_ERROR(g_logger) << "connect errno=" << strerror(errno);
+        close(fd);
+        return;
+    }
+    char buf[8];
+    for (int i = 0; i < ROUNDS; ++i) {
+        send(fd, "ping", 4, 0);
+        int got = 0;
+        while (got < 4) {
+            int n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                break;
+            }
+            got += n;
+        }
+    }
+    close(fd);
+    ++s_done;
+}
+
+//没有数据时recv应该在SO_RCVTIMEO之后返回ETIMEDOUT
+static void test_recv_timeout() {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    fang::FdMgr::GetInstance()->get(fds[0], true);
+    fang::FdMgr::GetInstance()->get(fds[1], true);
+    struct timeval tv = {0, 200 * 1000};
+    setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char buf[16];
+    uint64_t start = fang::GetCurrentMS();
+    ssize_t rt = recv(fds[0], buf, sizeof(buf), 0);
+    FANG_LOG_INFO(g_logger) << "recv rt=" << rt << " errno=" << strerror(errno)
+        << " used=" << fang::GetCurrentMS() - start << "ms";
+    close(fds[0]);
+    close(fds[1]);
+}
+
+//io_uring_test [epoll|io_uring] [线程数]
+int main(int argc, char** argv) {
+    std::string backend = argc > 1 ? argv[1] : "epoll";
+    int threads = argc > 2 ? atoi(argv[2]) : 1;
+    fang::Config::Lookup<std::string>("iomanager.backend")->setValue(backend);
+
+    int lfd = -1;
+    uint64_t start = 0;
+    {
+        fang::IoManager iom(threads, false, "uring");
+        FANG_LOG_INFO(g_logger) << "backend=" << backend << " io_uring=" << iom.isUring();
+        iom.schedul(&test_recv_timeout);
+        iom.schedul([&lfd, &start]() {
+            lfd = socket(AF_INET, SOCK_STREAM, 0);
+            int val = 1;
+            setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(PORT);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (bind(lfd, (sockaddr*)&addr, sizeof(addr)) || listen(lfd, 1024)) {
+                FANG_LOG_ERROR(g_logger) << "bind errno=" << strerror(errno);
+                return;
+            }
+            start = fang::GetCurrentMS();
+            for (int i = 0; i < CLIENTS; ++i) {
+                fang::IoManager::GetThis()->schedul(&client);
+            }
+            server(lfd);
+        });
+        while (s_done < CLIENTS) {
+            usleep(10 * 1000);
+        }
+        uint64_t used = fang::GetCurrentMS() - start;
+        FANG_LOG_INFO(g_logger) << "backend=" << backend << " clients=" << CLIENTS
+            << " rounds=" << ROUNDS << " used=" << used << "ms";
+        //每个回合客户端和服务端各recv一次，没有空唤醒时每次recv最多等待一次
+        FANG_LOG_INFO(g_logger) << "waits/recv="
+            << (double)iom.getEventWaitCount() / (2 * CLIENTS * ROUNDS)
+            << " ready_hits=" << iom.getReadyHitCount();
+        //关闭监听socket让accept返回
+        iom.schedul([lfd]() {
+            close(lfd);
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "../inc/parallel.h"
+#include "../inc/iomanager.h"
+#include "../inc/helpc.h"
+#include "../inc/log.h"
+#include <math.h>
+#include <stdexcept>
+
+fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+static const size_t N = 200000;
+
+//后面的下标计算量更大，按线程平分区间时负载不均衡
+static double work(size_t i) {
+    double v = 0;
+    for (size_t j = 0; j < i / 1000 + 1; ++j) {
+        v += sqrt((double)(i + j));
+    }
+    return v;
+}
+
+void test_parallel(fang::Scheduler* scheduler) {
+    uint64_t start = fang::GetCurrentMS();
+    double serial = 0;
+    for (size_t i = 0; i < N; ++i) {
+        serial += work(i);
+    }
+    uint64_t serial_used = fang::GetCurrentMS() - start;
+
+    start = fang::GetCurrentMS();
+    double parallel = fang::parallel_reduce(scheduler, 0, N, 0, 0.0
+            , [](size_t b, size_t e, double acc) {
+        for (size_t i = b; i < e; ++i) {
+            acc += work(i);
+        }
+        return acc;
+    }, [](double a, double b) { return a + b; });
+    uint64_t parallel_used = fang::GetCurrentMS() - start;
+    FANG_LOG_INFO(g_logger) << "parallel_reduce match=" << (fabs(serial - parallel) < 1e-6 * serial)
+        << " serial=" << serial_used << "ms parallel=" << parallel_used << "ms";
+
+    std::vector<int> out(N);
+    fang::parallel_for(scheduler, 0, N, 1000, [&out](size_t i) { out[i] = (int)i * 2; });
+    bool ok = true;
+    for (size_t i = 0; i < N; ++i) {
+        ok = ok && out[i] == (int)i * 2;
+    }
+    FANG_LOG_INFO(g_logger) << "parallel_for ok=" << ok;
+
+    try {
+        fang::parallel_for(scheduler, 0, N, 0, [](size_t i) {
+            if (i == N / 2) {
+                throw std::runtime_error("bad item");
+            }
+        });
+    } catch (std::exception& ex) {
+        FANG_LOG_INFO(g_logger) << "parallel_for rethrow: " << ex.what();
+    }
+}
+
+int main() {
+    //在调度器的协程中调用，协程挂起期间它的线程也参与计算
+    fang::IoManager iom(4, false, "parallel");
+    iom.schedul(std::bind(&test_parallel, &iom));
+    iom.stop();
+
+    //不在调度器中调用，阻塞当前线程
+    fang::Scheduler sc(4, false, "parallel_sc");
+    sc.start();
+    test_parallel(&sc);
+    sc.stop();
+    return 0;
+}
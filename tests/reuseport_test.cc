@@ -0,0 +1,116 @@
+#include "../inc/tcp_server.h"
+#include "../inc/iomanager.h"
+#include "../inc/hook.h"
+#include "../inc/helpc.h"
+#include "../inc/log.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+static const int CLIENTS = 200;
+static const int ROUNDS = 50;
+static const int PORT = 18765;
+
+static fang::Mutex s_mutex;
+static std::map<int, int> s_threads;        //线程 -> 处理的连接数
+static std::atomic<int> s_cross{0};         //io返回后换了线程的次数
+static std::atomic<int> s_done{0};
+
+//echo服务，统计连接是否一直在接受它的线程上处理
+class EchoServer : public fang::TcpServer {
+public:
+    EchoServer(fang::IoManager* iom)
+        :TcpServer(iom, iom, iom) {}
+
+protected:
+    void handleClient(fang::Socket::ptr client) override {
+        int tid = fang::GetThreadId();
+        {
+            fang::Mutex::Lock lock(s_mutex);
+            ++s_threads[tid];
+        }
+        char buf[64];
+        while (true) {
+            int n = client->recv(buf, sizeof(buf));
+            if (fang::GetThreadId() != tid) {
+                ++s_cross;
+            }
+            if (n <= 0) {
+                break;
+            }
+            client->send(buf, n);
+        }
+    }
+};
+
+static void client() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+        FANG_LOG_ERROR(g_logger) << "connect errno=" << strerror(errno);
+        close(fd);
+        return;
+    }
+    char buf[8];
+    for (int i = 0; i < ROUNDS; ++i) {
+        send(fd, "ping", 4, 0);
+        int got = 0;
+        while (got < 4) {
+            int n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                break;
+            }
+            got += n;
+        }
+    }
+    close(fd);
+    ++s_done;
+}
+
+//sharded=0 对比共享epoll
+int main(int argc, char** argv) {
+    bool sharded = argc > 1 ? atoi(argv[1]) : true;
+    fang::IoManager iom(4, false, "reuseport", sharded);
+    fang::TcpServer::ptr server(new EchoServer(&iom));
+    std::atomic<bool> ready{false};
+    //socket需要在开启hook的线程中创建
+    iom.schedul([&]() {
+        server->setReusePort(true);
+        auto addr = fang::Address::LookupAny("127.0.0.1:" + std::to_string(PORT));
+        while (!server->bind(addr)) {
+            sleep(1);
+        }
+        server->start();
+        ready = true;
+    });
+    while (!ready) {
+        usleep(1000);
+    }
+
+    uint64_t start = fang::GetCurrentMS();
+    {
+        fang::IoManager cli(2, false, "client");
+        for (int i = 0; i < CLIENTS; ++i) {
+            cli.schedul(&client);
+        }
+    }
+    uint64_t used = fang::GetCurrentMS() - start;
+
+    for (auto& i : s_threads) {
+        FANG_LOG_INFO(g_logger) << "thread=" << i.first << " clients=" << i.second;
+    }
+    FANG_LOG_INFO(g_logger) << "sharded=" << sharded
+        << " done=" << s_done << " cross=" << s_cross
+        << " tickle=" << iom.getTickleCount()
+        << " wakeup=" << iom.getWakeupCount()
+        << " used=" << used << "ms";
+    server->stop();
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "../inc/scheduler.h"
+#include "../inc/task.h"
+#include "../inc/helpc.h"
+#include "../inc/log.h"
+#include <deque>
+#include <stdlib.h>
+#include <unistd.h>
+
+static fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+//统计内存分配次数，不内联避免编译器把new和free配对检查
+static std::atomic<uint64_t> s_allocs{0};
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    ++s_allocs;
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+static std::atomic<uint64_t> s_sum{0};
+
+//典型的任务: 捕获几个指针和整数，比std::function的内部缓冲区大
+struct Payload {
+    void* a;
+    void* b;
+    uint64_t c;
+    uint64_t d;
+    int e;
+};
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+}
+
+static void report(const char* name, int n, uint64_t used_us, uint64_t allocs) {
+    FANG_LOG_INFO(g_logger) << name << " n=" << n
+        << " ns/task=" << used_us * 1000.0 / n
+        << " allocs/task=" << (double)allocs / n;
+}
+
+//入队出队不经过调度器，只比较回调对象本身的开销
+template<class Cb>
+static void bench_queue(const char* name, int n) {
+    Payload p = {nullptr, nullptr, 1, 2, 3};
+    std::deque<Cb> queue;
+    uint64_t allocs = s_allocs;
+    uint64_t start = now_us();
+    for (int i = 0; i < n; ++i) {
+        queue.push_back(Cb([p]() { s_sum += p.c; }));
+        if (queue.size() >= 64) {
+            while (!queue.empty()) {
+                Cb cb(std::move(queue.front()));
+                queue.pop_front();
+                cb();
+            }
+        }
+    }
+    report(name, n, now_us() - start, s_allocs - allocs);
+}
+
+//调度器中的协程派生任务并在调度器上执行，flags为TASK_INLINE时不切换协程
+static void bench_schedul(const char* name, int n, int flags) {
+    fang::Scheduler sc(1, false, "bench");
+    sc.start();
+    s_sum = 0;
+    Payload p = {nullptr, nullptr, 1, 2, 3};
+    uint64_t allocs = s_allocs;
+    uint64_t start = now_us();
+    sc.schedul([n, p, flags]() {
+        for (int i = 0; i < n; ++i) {
+            fang::Scheduler::GetThis()->schedul([p]() { s_sum += p.c; }, -1, flags);
+            if (i % 64 == 63) {
+                fang::Fiber::YieldToReady();
+            }
+        }
+    });
+    while (s_sum < (uint64_t)n) {
+        usleep(100);
+    }
+    report(name, n, now_us() - start, s_allocs - allocs);
+    sc.stop();
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    FANG_LOG_INFO(g_logger) << "sizeof(Task)=" << sizeof(fang::Task)
+        << " sizeof(std::function)=" << sizeof(std::function<void()>);
+    bench_queue<std::function<void()> >("std::function queue", n);
+    bench_queue<fang::Task>("Task queue", n);
+    bench_schedul("schedul+dispatch", n, fang::Scheduler::TASK_NONE);
+    bench_schedul("schedulInline+dispatch", n, fang::Scheduler::TASK_INLINE);
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "../inc/iomanager.h"
+#include "../inc/helpc.h"
+#include "../inc/log.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+static fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+static std::atomic<uint64_t> s_done{0};
+
+static void nop_task() {
+    ++s_done;
+}
+
+static void wait_done(uint64_t n) {
+    while (s_done < n) {
+        usleep(100);
+    }
+}
+
+static void report(const char* name, fang::IoManager& iom, uint64_t tasks,
+        uint64_t tickles, uint64_t wakeups, uint64_t used) {
+    tickles = iom.getTickleCount() - tickles;
+    wakeups = iom.getWakeupCount() - wakeups;
+    FANG_LOG_INFO(g_logger) << name << " tasks=" << tasks
+        << " tickles=" << tickles << " wakeups=" << wakeups
+        << " wakeups/task=" << (double)wakeups / tasks
+        << " used=" << used << "ms";
+}
+
+int main(int argc, char** argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    int burst = argc > 2 ? atoi(argv[2]) : 64;
+    fang::IoManager iom(4, false, "bench");
+    usleep(10 * 1000);
+
+    //外部线程成批提交，每批之间让工作线程回到空闲状态
+    uint64_t tickles = iom.getTickleCount();
+    uint64_t wakeups = iom.getWakeupCount();
+    uint64_t start = fang::GetCurrentMS();
+    uint64_t total = 0;
+    for (int i = 0; i < rounds; ++i) {
+        for (int j = 0; j < burst; ++j) {
+            iom.schedul(&nop_task);
+        }
+        total += burst;
+        wait_done(total);
+    }
+    report("external burst", iom, total, tickles, wakeups, fang::GetCurrentMS() - start);
+
+    //工作协程成批派生任务
+    tickles = iom.getTickleCount();
+    wakeups = iom.getWakeupCount();
+    start = fang::GetCurrentMS();
+    uint64_t base = total;
+    for (int i = 0; i < rounds; ++i) {
+        iom.schedul([burst]() {
+            for (int j = 0; j < burst; ++j) {
+                fang::IoManager::GetThis()->schedul(&nop_task);
+            }
+        });
+        total += burst;
+        wait_done(total);
+    }
+    report("fiber fan-out", iom, total - base, tickles, wakeups, fang::GetCurrentMS() - start);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "../inc/iomanager.h"
+#include "../inc/helpc.h"
+#include "../inc/log.h"
+
+fang::Logger::ptr g_logger = FANG_LOG_ROOT();
+
+static std::atomic<int> s_fired{0};
+static std::atomic<uint64_t> s_late{0};
+
+//模拟每个连接一个读超时: 大量添加后几乎全部取消
+void bench_add_cancel(int n) {
+    std::vector<fang::Timer::ptr> timers;
+    timers.reserve(n);
+    uint64_t start = fang::GetCurrentMS();
+    for (int i = 0; i < n; ++i) {
+        timers.push_back(fang::IoManager::GetThis()->addTimer(
+                    30000 + i % 5000, [](){ ++s_fired; }));
+    }
+    uint64_t add_used = fang::GetCurrentMS() - start;
+    for (auto& i : timers) {
+        i->refresh();
+    }
+    uint64_t refresh_used = fang::GetCurrentMS() - start - add_used;
+    for (auto& i : timers) {
+        i->cancel();
+    }
+    uint64_t used = fang::GetCurrentMS() - start;
+    FANG_LOG_INFO(g_logger) << n << " timers add=" << add_used
+        << "ms refresh=" << refresh_used << "ms cancel="
+        << used - add_used - refresh_used << "ms";
+}
+
+void test_expire(int n) {
+    for (int i = 0; i < n; ++i) {
+        uint64_t ms = rand() % 2000;
+        uint64_t expect = fang::GetCurrentMS() + ms;
+        fang::IoManager::GetThis()->addTimer(ms, [expect]() {
+            uint64_t now = fang::GetCurrentMS();
+            //定时器用单调时钟，与系统时间换算有1毫秒误差
+            if (now + 1 < expect) {
+                FANG_LOG_ERROR(g_logger) << "timer fired early " << expect - now << "ms";
+            } else if (now > expect && now - expect > s_late) {
+                s_late = now - expect;
+            }
+            ++s_fired;
+        });
+    }
+}
+
+void test_api() {
+    static int count = 0;
+    auto iom = fang::IoManager::GetThis();
+    fang::Timer::ptr timer = iom->addTimer(100, [](){
+        FANG_LOG_INFO(g_logger) << "recurring timer " << ++count;
+    }, true);
+    iom->addTimer(550, [timer]() {
+        timer->reset(200, true);
+    });
+    iom->addTimer(1200, [timer]() {
+        FANG_LOG_INFO(g_logger) << "cancel recurring timer rt=" << timer->cancel();
+    });
+}
+
+int main()
+{
+    fang::IoManager iom(2, false, "timer");
+    iom.schedul(std::bind(&bench_add_cancel, 200000));
+    iom.schedul(std::bind(&test_expire, 10000));
+    iom.schedul(&test_api);
+    iom.stop();
+    FANG_LOG_INFO(g_logger) << "fired=" << s_fired << " max late=" << s_late << "ms";
+    return 0;
+}